@@ -0,0 +1,42 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : board definitions (w_bsp style names used by the app)
+ */
+#ifndef H_SIM_BSP_H
+#define H_SIM_BSP_H
+
+#include <inttypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_1           (1)
+#define LED_2           (2)
+#define EXT_I2C_PWR     (12)
+#define UART_SELECT_DD  (3)
+
+#define UART0_DEV       "uart0"
+#define UART1_DEV       "uart1"
+#define UART2_DEV       "uart2"
+#define UARTDBG_DEV     "uartdbg"
+
+uint8_t BSP_getHwVer();
+void BSP_setHwVer(uint8_t v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_SIM_BSP_H */
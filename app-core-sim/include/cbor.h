@@ -0,0 +1,19 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : tinycbor is only referenced by commented out code in the modules, nothing to provide.
+ */
+#ifndef H_SIM_CBOR_H
+#define H_SIM_CBOR_H
+
+#endif  /* H_SIM_CBOR_H */
@@ -0,0 +1,42 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_LORAAPI_H
+#define H_LORAAPI_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { LORAWAN_RES_OK, LORAWAN_RES_JOIN_OK, LORAWAN_RES_NOT_JOIN, LORAWAN_RES_NO_RESP, LORAWAN_RES_DUTYCYCLE, 
+    LORAWAN_RES_OCC, LORAWAN_RES_HWERR, LORAWAN_RES_FWERR, LORAWAN_RES_BADPARAM, LORAWAN_RES_NO_BW, LORAWAN_RES_TIMEOUT } LORAWAN_RESULT_t;
+typedef enum { LORAWAN_SF7=7, LORAWAN_SF8=8, LORAWAN_SF9=9, LORAWAN_SF10=10, LORAWAN_SF11=11, LORAWAN_SF12=12, LORAWAN_SF_DEFAULT=12 } LORAWAN_SF_t;
+
+typedef void (*LORAAPI_JOIN_CB_t)(void* userctx, LORAWAN_RESULT_t res);
+typedef void (*LORAAPI_TX_CB_t)(void* userctx, LORAWAN_RESULT_t res);
+typedef void (*LORAAPI_RX_CB_t)(void* userctx, LORAWAN_RESULT_t res, uint8_t port, int rssi, int snr, uint8_t* msg, uint8_t sz);
+
+void lora_api_init(uint8_t* devEUI, uint8_t* appEUI, uint8_t* appKey, bool enableADR, LORAWAN_SF_t defaultSF, int8_t defaultTxPower);
+LORAWAN_RESULT_t lora_api_join(LORAAPI_JOIN_CB_t callback, LORAWAN_SF_t sf, void* userctx);
+LORAWAN_RESULT_t lora_api_send(LORAWAN_SF_t sf, uint8_t port, bool ack, bool willListen, uint8_t* data, uint8_t sz, LORAAPI_TX_CB_t callback, void* userctx);
+LORAWAN_RESULT_t lora_api_registerRxCB(int port, LORAAPI_RX_CB_t callback, void* userctx);
+bool lora_api_isJoined();
+int lora_api_getCurrentRegion();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_LORAAPI_H */
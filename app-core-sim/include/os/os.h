@@ -0,0 +1,36 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : minimal stand in for the mynewt os header. The libc bits the app sources rely on, and the os time.
+ */
+#ifndef H_SIM_OS_H
+#define H_SIM_OS_H
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include "syscfg/syscfg.h"
+// mynewt pulls in the bsp definitions (LED_x, UARTx_DEV...) used as syscfg values
+#include "bsp.h"
+
+// os time since boot (kernel/os/os_time.h)
+int64_t os_get_uptime_usec(void);
+
+#endif  /* H_SIM_OS_H */
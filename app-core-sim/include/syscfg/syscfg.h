@@ -0,0 +1,101 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : hand maintained equivalent of the newt generated syscfg header.
+ * Values are the syscfg.defs defaults from each package's syscfg.yml - keep in step when adding settings.
+ */
+#ifndef H_SIM_SYSCFG_H
+#define H_SIM_SYSCFG_H
+
+#define MYNEWT_VAL(_name) MYNEWT_VAL_ ## _name
+
+// Target/bsp level
+#define MYNEWT_VAL_UART_0 (1)
+#define MYNEWT_VAL_UART_1 (0)
+#define MYNEWT_VAL_UART_2 (0)
+#define MYNEWT_VAL_UART_DBG (0)
+
+// app-core
+#define MYNEWT_VAL_MODS_ACTIVE_LED (LED_1)
+#define MYNEWT_VAL_MODS_SCAN_PATTERN ("1010101010")
+#define MYNEWT_VAL_NET_ACTIVE_LED (LED_2)
+#define MYNEWT_VAL_NET_SCAN_PATTERN ("1010101010")
+#define MYNEWT_VAL_WCONSOLE_ENABLED (0)
+#define MYNEWT_VAL_WCONSOLE_UART_DEV (NULL)
+#define MYNEWT_VAL_WCONSOLE_UART_BAUD (19200)
+#define MYNEWT_VAL_WCONSOLE_UART_SELECT (-1)
+#define MYNEWT_VAL_STARTUP_CONSOLE_SENSE_SECS (5)
+#define MYNEWT_VAL_APP_CORE_PROFILE (1)
+#define MYNEWT_VAL_IDLETIME_CHECK_SECS (60)
+#define MYNEWT_VAL_IDLETIME_MOVING_SECS (300)
+#define MYNEWT_VAL_IDLETIME_NOTMOVING_MINS (120)
+#define MYNEWT_VAL_IDLETIME_INACTIVE_MINS (120)
+#define MYNEWT_VAL_JOIN_RETRY_SHORT_SECS (60)
+#define MYNEWT_VAL_JOIN_RETRY_LONG_MINS (120)
+#define MYNEWT_VAL_JOIN_DAY_AIRTIME_MS (8700)
+#define MYNEWT_VAL_LORA_DEFAULT_ADR (0)
+#define MYNEWT_VAL_LORA_DEFAULT_SF (10)
+#define MYNEWT_VAL_LORA_TX_PORT (3)
+#define MYNEWT_VAL_SM_STATS_UL_HOURS (24)
+#define MYNEWT_VAL_UL_BACKLOG_SZ (4)
+#define MYNEWT_VAL_UL_APP_ACK (0)
+#define MYNEWT_VAL_UL_APP_ACK_MAX_PENDING (4)
+#define MYNEWT_VAL_UL_APP_ACK_WAIT_ULS (1)
+#define MYNEWT_VAL_UL_APP_ACK_MAX_RESENDS (2)
+#define MYNEWT_VAL_LORA_DUTYCYCLE_DIV (100)
+#define MYNEWT_VAL_LORA_LINK_MARGIN_DB (10)
+#define MYNEWT_VAL_LORA_LINK_GW_TX_DBM (27)
+#define MYNEWT_VAL_LORA_LINK_GW_RX_ADV_DB (6)
+#define MYNEWT_VAL_LORA_LINK_NODL_ULS (6)
+#define MYNEWT_VAL_UL_VALUE_MIN (30)
+#define MYNEWT_VAL_LORA_RX2_DELAY_MS (2000)
+#define MYNEWT_VAL_LORA_RX2_SF (12)
+#define MYNEWT_VAL_UL_ROUND_MAX_SECS (180)
+#define MYNEWT_VAL_UL_MAX_ROUND_BYTES (192)
+#define MYNEWT_VAL_UL_COMPACT_TLVS (0)
+#define MYNEWT_VAL_UL_DELTA_RESYNC_ROUNDS (0)
+#define MYNEWT_VAL_ENABLE_ACTIVE_LEDS (0)
+
+// mod-ble
+#define MYNEWT_VAL_MOD_BLE_PWRIO (-1)
+#define MYNEWT_VAL_MOD_BLE_UARTIO (-1)
+#define MYNEWT_VAL_MOD_BLE_UART (UART0_DEV)
+#define MYNEWT_VAL_MOD_BLE_UART_BAUDRATE (115200)
+#define MYNEWT_VAL_MOD_BLE_UART_SELECT (1)
+#define MYNEWT_VAL_MOD_BLE_UL_COMPACT_LISTS (0)
+// mod-ble-scan-nav
+#define MYNEWT_VAL_MOD_BLE_MAXIBS_NAV (3)
+// mod-ble-scan-tag / mod-ble-scanA-tag / mod-ble-scan-proximity (defined by each, same default)
+#define MYNEWT_VAL_MOD_BLE_MAXIBS_TAG_INZONE (100)
+// mod-ble-scan-proximity
+#define MYNEWT_VAL_MOD_BLE_PROX_SIGNIF_CONTACT (10)
+#define MYNEWT_VAL_MOD_BLE_PROX_SIGNIF_RSSI (-80)
+// mod-ble-scan-alert
+#define MYNEWT_VAL_MOD_BLE_MAXIBS_ALERT (3)
+#define MYNEWT_VAL_MOD_BLE_DEFAULT_SCAN_TIME_MS (5000)
+#define MYNEWT_VAL_MOD_BLE_MAX_TIMEOUT_BEACONS (30)
+
+// mod-gps
+#define MYNEWT_VAL_MOD_GPS_PWRIO (EXT_I2C_PWR)
+#define MYNEWT_VAL_MOD_GPS_UART (UART0_DEV)
+#define MYNEWT_VAL_MOD_GPS_UART_BAUDRATE (9600)
+#define MYNEWT_VAL_MOD_GPS_UART_SELECT (UART_SELECT_DD)
+
+// mod-prodtest
+#define MYNEWT_VAL_DCARD_BLE (0)
+#define MYNEWT_VAL_DCARD_BLEGPS (0)
+
+// mod-pti
+#define MYNEWT_VAL_BUTTON_IO (-1)
+
+#endif  /* H_SIM_SYSCFG_H */
@@ -0,0 +1,49 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_CONFIGMGR_H
+#define H_CONFIGMGR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Config keys are 16 bits : module in top byte, element id in bottom
+#define CFGKEY(__mod, __id) ((uint16_t)((((__mod) & 0xFF) << 8) | ((__id) & 0xFF)))
+#define CFG_KEY_ILLEGAL     (0x0000)
+#define CFG_MODULE_UTIL     (0x00)
+#define CFG_MODULE_LORA     (0x01)
+#define CFG_MODULE_APP_CORE (0x04)
+#define CFG_MODULE_APP_MOD  (0x05)
+
+typedef void (*CFG_CBFN_t)(void* ctx, uint16_t key);
+typedef void (*CFG_ITERATE_FN_t)(void* ctx, uint16_t key);
+
+bool CFMgr_getOrAddElement(uint16_t key, void* data, uint8_t len);
+bool CFMgr_getOrAddElementCheckRangeUINT8(uint16_t key, uint8_t* data, uint8_t min, uint8_t max);
+bool CFMgr_getOrAddElementCheckRangeUINT32(uint16_t key, uint32_t* data, uint32_t min, uint32_t max);
+bool CFMgr_getOrAddElementCheckRangeINT8(uint16_t key, int8_t* data, int8_t min, int8_t max);
+bool CFMgr_getOrAddElementCheckRangeINT32(uint16_t key, int32_t* data, int32_t min, int32_t max);
+int CFMgr_getElement(uint16_t key, void* data, uint8_t maxlen);
+int CFMgr_getElementLen(uint16_t key);
+bool CFMgr_setElement(uint16_t key, void* data, uint8_t len);
+bool CFMgr_registerCB(CFG_CBFN_t cb);
+void CFMgr_iterateKeys(int8_t module, CFG_ITERATE_FN_t cb, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_CONFIGMGR_H */
@@ -0,0 +1,49 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_GPSMGR_H
+#define H_GPSMGR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { GPS_DONE, GPS_COMM_FAIL, GPS_COMM_OK, GPS_SATOK, GPS_NEWFIX, GPS_SATLOSS, GPS_NO_FIX } GPS_EVENT_TYPE_t;
+typedef void (*GPS_CB_FN_t)(GPS_EVENT_TYPE_t e);
+// Power modes as stored in config
+enum { POWER_ONOFF=1, POWER_ALWAYSON=2, POWER_ONSTANDBY=3 };
+
+typedef struct {
+    int32_t lat;
+    int32_t lon;
+    int32_t alt;
+    int32_t prec;
+    uint32_t rxAt;
+    uint8_t nSats;
+} gps_data_t;
+
+void gps_mgr_init(const char* dname, uint32_t baudrate, int8_t pwrPin, int8_t uartSelect);
+bool gps_start(GPS_CB_FN_t cb, uint32_t tsecs);
+void gps_stop();
+bool gps_getData(gps_data_t* d);
+int32_t gps_lastGPSFixAgeMins();
+uint32_t gps_lastGPSFixTimeSecs();
+void gps_setPowerMode(uint8_t m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_GPSMGR_H */
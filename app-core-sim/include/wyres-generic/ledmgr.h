@@ -0,0 +1,39 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_LEDMGR_H
+#define H_LEDMGR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASH_MIN   "10000000000000000000"
+#define FLASH_ON    "1"
+#define FLASH_05HZ  "11110000000000000000"
+#define FLASH_1HZ   "1111100000"
+#define FLASH_2HZ   "11000"
+#define FLASH_5HZ   "10"
+typedef enum { LED_REQ_ENQUEUE, LED_REQ_INTERUPT } LED_REQ_t;
+
+bool ledStart(int8_t gpio, const char* pattern, int32_t dur);
+bool ledRequest(int8_t gpio, const char* pattern, int32_t dur, LED_REQ_t type);
+void ledCancel(int8_t gpio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_LEDMGR_H */
@@ -0,0 +1,34 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_LOWPOWERMGR_H
+#define H_LOWPOWERMGR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { LP_RUN, LP_DOZE, LP_SLEEP, LP_DEEPSLEEP, LP_OFF } LP_MODE_t;
+typedef void (*LP_CBFN_t)(LP_MODE_t prevmode, LP_MODE_t newmode);
+
+uint8_t LPMgr_register(LP_CBFN_t cb);
+void LPMgr_setLPMode(uint8_t id, LP_MODE_t m);
+LP_MODE_t LPMgr_getMode();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_LOWPOWERMGR_H */
@@ -0,0 +1,42 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_MOVEMENTMGR_H
+#define H_MOVEMENTMGR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Callback when a movement is detected
+typedef void (*MM_CBFN_t)();
+
+bool MMMgr_start();
+bool MMMgr_registerMovementCB(MM_CBFN_t cb);
+void MMMgr_stop();
+bool MMMgr_check();
+bool MMMgr_hasMovedSince(uint32_t t);
+uint32_t MMMgr_getLastMovedTime();
+uint32_t MMMgr_getLastFallTime();
+uint32_t MMMgr_getLastShockTime();
+uint32_t MMMgr_getLastOrientTime();
+uint8_t MMMgr_getOrientation();
+void MMMgr_getXYZ(int8_t* x, int8_t* y, int8_t* z);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_MOVEMENTMGR_H */
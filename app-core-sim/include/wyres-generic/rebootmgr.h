@@ -0,0 +1,35 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_REBOOTMGR_H
+#define H_REBOOTMGR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { RM_HARD_RESET, RM_ASSERT, RM_WATCHDOG, RM_DM_ACTION, RM_AT_ACTION, RM_ENTER_STOCK_MODE } RM_REASON_t;
+
+void RMMgr_reboot(RM_REASON_t reason);
+uint16_t RMMgr_getResetReasonCode();
+void RMMgr_getResetReasonBuffer(uint8_t* buf, uint8_t len);
+void* RMMgr_getLastAssertCallerFn();
+void* RMMgr_getLogFn(uint8_t idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_REBOOTMGR_H */
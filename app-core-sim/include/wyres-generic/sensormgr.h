@@ -0,0 +1,64 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_SENSORMGR_H
+#define H_SENSORMGR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { SR_BUTTON_RELEASED=0, SR_BUTTON_PRESSED=1 } SR_BUTTON_STATE_t;
+typedef enum { SR_BUTTON_SHORT=0, SR_BUTTON_LONG=1, SR_BUTTON_VLONG=2 } SR_BUTTON_PRESS_TYPE_t;
+typedef void (*SR_BUTTON_CB_FN_t)(void* ctx, SR_BUTTON_STATE_t currentState, SR_BUTTON_PRESS_TYPE_t currentPressType);
+
+bool SRMgr_start();
+void SRMgr_stop();
+bool SRMgr_registerButtonCB(int8_t io, SR_BUTTON_CB_FN_t cb, void* ctx);
+uint32_t SRMgr_getLastButtonPressTS(int8_t io);
+uint32_t SRMgr_getLastButtonReleaseTS(int8_t io);
+SR_BUTTON_STATE_t SRMgr_getButton(int8_t io);
+SR_BUTTON_PRESS_TYPE_t SRMgr_getLastButtonPressType(int8_t io);
+void SRMgr_updateButton(int8_t io);
+uint8_t SRMgr_getLight();
+bool SRMgr_hasLightChanged();
+void SRMgr_updateLight();
+uint16_t SRMgr_getBatterymV();
+bool SRMgr_hasBattChanged();
+void SRMgr_updateBatt();
+int16_t SRMgr_getTempcC();
+bool SRMgr_hasTempChanged();
+void SRMgr_updateTemp();
+int32_t SRMgr_getPressurePa();
+bool SRMgr_hasPressureChanged();
+void SRMgr_updatePressure();
+uint8_t SRMgr_getRelHumidity();
+bool SRMgr_hasRelHumidityChanged();
+void SRMgr_updateRelHumidity();
+uint16_t SRMgr_getADC1mV();
+bool SRMgr_hasADC1Changed();
+void SRMgr_updateADC1();
+uint16_t SRMgr_getADC2mV();
+bool SRMgr_hasADC2Changed();
+void SRMgr_updateADC2();
+uint32_t SRMgr_getLastNoiseTimeSecs();
+uint8_t SRMgr_getNoiseFreqkHz();
+uint8_t SRMgr_getNoiseLeveldB();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_SENSORMGR_H */
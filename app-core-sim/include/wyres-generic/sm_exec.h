@@ -0,0 +1,50 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_SM_EXEC_H
+#define H_SM_EXEC_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int SM_STATE_ID_t;
+typedef void* SM_ID_t;
+typedef SM_STATE_ID_t (*SM_STATE_FN_t)(void* arg, int e, void* data);
+typedef struct {
+    SM_STATE_ID_t id;
+    const char* name;
+    SM_STATE_FN_t fn;
+} SM_STATE_t;
+
+// Return from state fn to stay in current state
+#define SM_STATE_CURRENT    (-1)
+// Events sent by the executor itself (user events are >=0)
+#define SM_ENTER            (-1)
+#define SM_EXIT             (-2)
+#define SM_TIMEOUT          (-3)
+
+SM_ID_t sm_init(const char* name, SM_STATE_t* states, uint8_t nstates, SM_STATE_ID_t initialState, void* ctx);
+void sm_start(SM_ID_t sm);
+bool sm_sendEvent(SM_ID_t sm, int e, void* data);
+void sm_timer_start(SM_ID_t sm, uint32_t tms);
+void sm_timer_stop(SM_ID_t sm);
+void sm_default_event_log(SM_ID_t sm, const char* logpref, int e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_SM_EXEC_H */
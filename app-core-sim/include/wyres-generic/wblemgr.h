@@ -0,0 +1,56 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_WBLEMGR_H
+#define H_WBLEMGR_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEVADDR_SZ  (6)
+typedef enum { WBLE_COMM_FAIL, WBLE_COMM_OK, WBLE_COMM_IB_RUNNING, WBLE_SCAN_RX_IB, WBLE_UART_CONN, WBLE_UART_DISC, WBLE_UART_RX } WBLE_EVENT_t;
+typedef void (*WBLE_CB_FN_t)(WBLE_EVENT_t e, void* d);
+
+typedef struct {
+    uint16_t major;
+    uint16_t minor;
+    int8_t rssi;
+    uint8_t extra;
+    uint32_t firstSeenAt;
+    uint32_t lastSeenAt;
+    bool new;
+    uint8_t inULCnt;
+    uint8_t devaddr[DEVADDR_SZ];
+} ibeacon_data_t;
+
+void* wble_mgr_init(const char* dname, uint32_t baudrate, int8_t pwrPin, int8_t uartPin, int8_t uartSelect);
+void wble_start(void* ctx, WBLE_CB_FN_t cb);
+void wble_stop(void* ctx);
+void wble_scan_start(void* ctx, const uint8_t* uuid, uint16_t majorStart, uint16_t majorEnd, uint32_t sz, ibeacon_data_t* list);
+void wble_scan_stop(void* ctx);
+void wble_ibeacon_start(void* ctx, uint8_t* uuid, uint16_t maj, uint16_t min, uint8_t extra, uint32_t interMS, int8_t txpower);
+int wble_getNbIBActive(void* ctx, uint32_t activeInLastX);
+int wble_getSortedIBList(void* ctx, int sz, ibeacon_data_t* list);
+void wble_resetList(void* ctx, uint32_t timeoutsecs);
+void wble_line_open(void* ctx);
+void wble_line_close(void* ctx);
+int wble_line_write(void* ctx, uint8_t* data, uint32_t sz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_WBLEMGR_H */
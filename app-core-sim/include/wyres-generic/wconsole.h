@@ -0,0 +1,42 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_WCONSOLE_H
+#define H_WCONSOLE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { ATCMD_OK, ATCMD_GENERR, ATCMD_BADCMD, ATCMD_BADARG, ATCMD_PROCESSED } ATRESULT;
+typedef bool (*PRINTLN_t)(const char* l, ...);
+typedef ATRESULT (*ATCMD_CBFN_t)(PRINTLN_t pfn, uint8_t nargs, char* argv[]);
+typedef struct {
+    const char* cmd;
+    const char* desc;
+    ATCMD_CBFN_t fn;
+} ATCMD_DEF_t;
+
+bool wconsole_mgr_init(const char* dname, uint32_t baudrate, int8_t uartSelect);
+bool wconsole_start(uint8_t nCmds, ATCMD_DEF_t* cmds, uint32_t idleTimeoutS);
+void wconsole_stop();
+bool wconsole_isInit();
+bool wconsole_isActive();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_WCONSOLE_H */
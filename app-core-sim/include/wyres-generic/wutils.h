@@ -0,0 +1,50 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_WUTILS_H
+#define H_WUTILS_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Logging : in the simulation output goes to stdout prefixed by the simulated time (see sim_main.c)
+typedef enum { LOGS_DEBUG, LOGS_INFO, LOGS_RUN, LOGS_OFF } LOG_LEVEL;
+void set_log_level(LOG_LEVEL l);
+LOG_LEVEL get_log_level();
+const char* get_log_level_str();
+void log_debug(const char* ls, ...);
+void log_info(const char* ls, ...);
+void log_warn(const char* ls, ...);
+void log_error(const char* ls, ...);
+void log_noout(const char* ls, ...);
+void log_check_uart_active();
+
+// Little endian buffer helpers
+void Util_writeLE_uint16_t(uint8_t* b, uint8_t offset, uint16_t v);
+void Util_writeLE_int16_t(uint8_t* b, uint8_t offset, int16_t v);
+void Util_writeLE_uint32_t(uint8_t* b, uint8_t offset, uint32_t v);
+void Util_writeLE_int32_t(uint8_t* b, uint8_t offset, int32_t v);
+uint16_t Util_readLE_uint16_t(uint8_t* b, uint8_t l);
+uint32_t Util_readLE_uint32_t(uint8_t* b, uint8_t l);
+uint32_t Util_hashstrn(const char* s, int maxlen);
+bool Util_notAll0(const uint8_t* p, uint8_t sz);
+int Util_scanhex(const char* s, int sz, uint8_t* v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_WUTILS_H */
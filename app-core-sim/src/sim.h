@@ -0,0 +1,107 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation internals : discrete event clock, simulated world and statistics shared between the sim_*.c files
+ */
+#ifndef H_SIM_H
+#define H_SIM_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Discrete event clock : everything that 'takes time' on the target is a posted event on the simulated ms timeline
+typedef void (*SIM_EVENT_FN_t)(void* arg, int e, void* data);
+uint64_t sim_now();
+void sim_post(uint32_t delayMS, SIM_EVENT_FN_t fn, void* arg, int e, void* data);
+// Cancel all pending events for this fn/arg pair
+void sim_cancel(SIM_EVENT_FN_t fn, void* arg);
+// Run events until simulated time reaches endMS or sim_stop() is called. Returns false if stopped early.
+bool sim_run(uint64_t endMS);
+void sim_stop(const char* why);
+const char* sim_stopReason();
+
+// Deterministic pseudo random source (seeded from the command line)
+void sim_seed(uint32_t seed);
+uint32_t sim_rand(uint32_t range);
+bool sim_chance(uint32_t pct);
+
+// Simulated world parameters (set from the command line in sim_main.c)
+typedef struct {
+    uint32_t movingPct;         // % of time device is moving
+    uint32_t moveMeanMins;      // mean length of a moving period
+    uint32_t joinOkPct;         // % of join attempts accepted
+    uint32_t txOkPct;           // % of UL tx that complete OK
+    uint32_t txNoResultPct;     // % of UL tx whose result the stack never gives
+    uint32_t appAckPct;         // % of the app ack requests the backend answers
+    uint32_t gpsFixPct;         // % of gps sessions that get a fix
+    uint32_t nbNavBeacons;      // fixed navigation beacons around
+    uint32_t nbTags;            // enter/exit tags around
+    uint32_t nbProxDevices;     // other devices doing proximity ibeaconning around (contacts for ble-prox)
+    uint32_t dlPct;             // % of the ULs tx ok that get a DL from the backend
+    bool linkModel;             // UL/DL lost below the demodulation floor of their SF (else only txOkPct)
+    int32_t linkSNR;            // mean SNR of the link (dB), each packet gets +/-3dB
+    uint16_t resetReason;       // of the boot (RM_REASON_t)
+    bool consoleWired;          // uart console present (with nobody typing on it)
+    uint8_t dlActions[64];      // DL actions TLVs (the DL header, with a new DL id each time, is added)
+    uint8_t dlActionsSz;
+} SIM_WORLD_t;
+extern SIM_WORLD_t sim_world;
+void sim_world_init();
+// Time in secs since boot of last movement (now if currently moving), 0 if never moved
+uint32_t sim_world_lastMovedSecs();
+
+// Backend : rebuild the v1 UL from a compact one (as received). ulTime is the device time (secs since boot) when the UL was txd if known
+// (timestamps are sent as their age at tx), if 0 the timestamps are given as ages.
+// Returns the size of the decoded UL, or -1 if it is not a valid compact UL or out is too small
+int sim_decodeCompactUL(uint8_t* in, uint8_t sz, uint8_t* out, uint8_t outMax, uint32_t ulTime);
+
+// Statistics collected during the run
+typedef struct {
+    uint32_t nbJoinReqs;
+    uint64_t firstULMS;         // time of the first UL tx since boot
+    uint32_t nbULTx;            // UL packets sent over the air
+    uint32_t nbULTxSF[13];      // by SF
+    uint32_t nbULBytes;         // UL payload bytes sent (app payload only)
+    uint32_t nbULRefused;       // UL requests refused by the stack (duty cycle)
+    uint32_t nbULCompact;       // ULs in the compact encoding (checked by decoding them)
+    uint32_t nbULBytesSaved;    // bytes saved by the compact encoding
+    uint32_t nbULDelta;         // ULs with an APP_CORE_UL_DELTA TLV listing unchanged tags
+    uint32_t nbULDeltaTags;     // tags not resent as unchanged
+    uint32_t nbDL;              // DLs received
+    uint32_t nbULEvents;        // event TLVs (button, enter/exit) received by the backend, including repeats
+    uint32_t nbULEventBytes;
+    uint32_t nbULAppAckReqs;    // ULs with an app ack request
+    uint32_t nbDLAppAcks;       // app acks sent back in DLs
+    uint64_t airtimeMS;         // total radio tx time (join + UL)
+    uint32_t nbCfgWrites;       // config element writes (ie flash writes on target)
+    uint32_t nbCfgReads;        // config element lookups
+    uint32_t nbWakeups;         // events processed while the app had asked for deep sleep
+    uint64_t lpModeMS[5];       // time in each LP_MODE_t
+} SIM_STATS_t;
+extern SIM_STATS_t sim_stats;
+// Print the per state machine state residency table
+void sim_sm_report(FILE* out);
+
+// LoRa time on air in ms for a given SF (125kHz, CR4/5) and app payload size (LoRaWAN overhead added if isJoin is false)
+uint32_t sim_lora_toaMS(uint8_t sf, uint8_t payloadSz, bool isJoin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_SIM_H */
@@ -0,0 +1,133 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : what the backend does with the ULs. Reference decoder of the compact UL encoding (see app-core README.md),
+ * with its own copy of the dictionary, so the firmware encoder is checked against the protocol and not against itself.
+ */
+#include <string.h>
+#include "os/os.h"
+
+#include "wyres-generic/wutils.h"
+#include "app-core/app_core.h"
+#include "app-core/app_msg.h"
+
+#include "sim.h"
+
+#define COMPACT_CODE_BASE (APP_CORE_UL_COMPACT_START)
+static const struct {
+    uint8_t tag;
+    uint8_t len;
+    const char* fields;
+} COMPACT_DICT[] = {
+    { APP_CORE_UL_ENV_MOVE, 4, "A" },
+    { APP_CORE_UL_ENV_FALL, 4, "A" },
+    { APP_CORE_UL_ENV_SHOCK, 4, "A" },
+    { APP_CORE_UL_GPS, 22, "BIIzzAB" },
+    { APP_CORE_UL_GPS, 1, "B" },
+    { APP_CORE_UL_VERSION, 8, "BBuI" },
+    { APP_CORE_UL_ENV_TEMP, 2, "s" },
+    { APP_CORE_UL_ENV_PRESSURE, 4, "z" },
+    { APP_CORE_UL_ENV_BATTERY, 2, "u" },
+    { APP_CORE_UL_ENV_LIGHT, 1, "B" },
+    { APP_CORE_UL_ENV_HUMIDIT, 1, "B" },
+    { APP_CORE_UL_ENV_ORIENT, 4, "I" },
+    { APP_CORE_UL_ENV_NOISE, 6, "ABB" },
+    { APP_CORE_UL_BACKLOG_AGE, 2, "u" },
+};
+#define COMPACT_DICT_SZ (sizeof(COMPACT_DICT)/sizeof(COMPACT_DICT[0]))
+
+static bool evenParity(uint8_t d) {
+    bool ret=true;
+    for(int i=0;i<8;i++) {
+        if (d & (1<<i)) {
+            ret = !ret;
+        }
+    }
+    return ret;
+}
+// returns new offset, or -1 if runs off the end
+static int getVarint(uint8_t* b, int off, int sz, uint32_t* v) {
+    *v = 0;
+    for(int shift=0; shift<35; shift+=7) {
+        if (off>=sz) {
+            return -1;
+        }
+        *v |= ((uint32_t)(b[off] & 0x7f)) << shift;
+        if ((b[off++] & 0x80)==0) {
+            return off;
+        }
+    }
+    return -1;
+}
+static int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+int sim_decodeCompactUL(uint8_t* in, uint8_t sz, uint8_t* out, uint8_t outMax, uint32_t ulTime) {
+    if (sz<2 || ((in[0]>>4) & 0x03)!=APP_CORE_MSGS_VERSION_UL_COMPACT || (in[1]+2)!=sz || outMax<2) {
+        return -1;
+    }
+    int o = 2;
+    for(int off=2; off < sz; ) {
+        uint8_t t = in[off];
+        if (t>=COMPACT_CODE_BASE && t<(COMPACT_CODE_BASE+COMPACT_DICT_SZ)) {
+            int d = t - COMPACT_CODE_BASE;
+            if ((o + 2 + COMPACT_DICT[d].len) > outMax) {
+                return -1;
+            }
+            out[o++] = COMPACT_DICT[d].tag;
+            out[o++] = COMPACT_DICT[d].len;
+            off++;
+            for(const char* f=COMPACT_DICT[d].fields; *f!='\0'; f++) {
+                uint32_t v = 0;
+                if (*f=='B' || *f=='I') {
+                    int n = (*f=='B' ? 1 : 4);
+                    if ((off+n) > sz) {
+                        return -1;
+                    }
+                    memcpy(&out[o], &in[off], n);
+                    off+=n;
+                    o+=n;
+                    continue;
+                }
+                if ((off = getVarint(in, off, sz, &v)) < 0) {
+                    return -1;
+                }
+                switch(*f) {
+                    case 'u': Util_writeLE_uint16_t(out, o, v); o+=2; break;
+                    case 's': Util_writeLE_int16_t(out, o, unzigzag(v)); o+=2; break;
+                    case 'z': Util_writeLE_int32_t(out, o, unzigzag(v)); o+=4; break;
+                    case 'A': Util_writeLE_uint32_t(out, o, (ulTime!=0 ? ulTime - unzigzag(v) : unzigzag(v))); o+=4; break;
+                    default: return -1;
+                }
+            }
+        } else {
+            if ((off+2) > sz || (off + 2 + in[off+1]) > sz || (o + 2 + in[off+1]) > outMax) {
+                return -1;
+            }
+            memcpy(&out[o], &in[off], in[off+1]+2);
+            o += (in[off+1]+2);
+            off += (in[off+1]+2);
+        }
+    }
+    if (o>255) {
+        return -1;
+    }
+    // same header as a v1 UL
+    out[0] = (in[0] & 0x4f) | ((APP_CORE_MSGS_VERSION_UL & 0x03)<<4);
+    if (!evenParity(out[0])) {
+        out[0] |= 0x80;
+    }
+    out[1] = o-2;
+    return o;
+}
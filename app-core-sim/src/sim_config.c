@@ -0,0 +1,141 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : configmgr held in RAM. Every element write is counted as a PROM write would be on the target.
+ */
+#include "os/os.h"
+
+#include "wyres-generic/wutils.h"
+#include "wyres-generic/configmgr.h"
+
+#include "sim.h"
+
+#define MAX_KEYS (128)
+#define MAX_KEY_LEN (96)
+#define MAX_CBS (8)
+
+static struct {
+    uint8_t nKeys;
+    struct {
+        uint16_t key;
+        uint8_t len;
+        uint8_t data[MAX_KEY_LEN];
+    } elements[MAX_KEYS];
+    uint8_t nCBs;
+    CFG_CBFN_t cbs[MAX_CBS];
+} _ctx;
+
+static int findKey(uint16_t key) {
+    sim_stats.nbCfgReads++;
+    for(int i=0;i<_ctx.nKeys;i++) {
+        if (_ctx.elements[i].key==key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool writeElement(uint16_t key, void* data, uint8_t len) {
+    assert(key!=CFG_KEY_ILLEGAL);
+    if (len > MAX_KEY_LEN) {
+        log_warn("SIM:cfg key %04x len %d too big", key, len);
+        return false;
+    }
+    int idx = findKey(key);
+    if (idx<0) {
+        assert(_ctx.nKeys < MAX_KEYS);
+        idx = _ctx.nKeys++;
+        _ctx.elements[idx].key = key;
+    } else if (_ctx.elements[idx].len != len) {
+        log_warn("SIM:cfg key %04x len %d but stored as %d", key, len, _ctx.elements[idx].len);
+        return false;
+    }
+    _ctx.elements[idx].len = len;
+    memcpy(_ctx.elements[idx].data, data, len);
+    sim_stats.nbCfgWrites++;
+    return true;
+}
+
+bool CFMgr_getOrAddElement(uint16_t key, void* data, uint8_t len) {
+    int idx = findKey(key);
+    if (idx<0) {
+        // Add with the caller's default value
+        return writeElement(key, data, len);
+    }
+    if (_ctx.elements[idx].len != len) {
+        log_warn("SIM:cfg get key %04x len %d but stored as %d", key, len, _ctx.elements[idx].len);
+        return false;
+    }
+    memcpy(data, _ctx.elements[idx].data, len);
+    return true;
+}
+
+// Range checked versions : an out of range stored value is replaced by the caller's default
+#define GET_CHECK_RANGE(__type) { \
+    __type v = *data; \
+    if (!CFMgr_getOrAddElement(key, &v, sizeof(__type))) { \
+        return false; \
+    } \
+    if (v < min || v > max) { \
+        log_warn("SIM:cfg key %04x out of range, reset to default", key); \
+        return writeElement(key, data, sizeof(__type)); \
+    } \
+    *data = v; \
+    return true; \
+}
+bool CFMgr_getOrAddElementCheckRangeUINT8(uint16_t key, uint8_t* data, uint8_t min, uint8_t max) GET_CHECK_RANGE(uint8_t)
+bool CFMgr_getOrAddElementCheckRangeUINT32(uint16_t key, uint32_t* data, uint32_t min, uint32_t max) GET_CHECK_RANGE(uint32_t)
+bool CFMgr_getOrAddElementCheckRangeINT8(uint16_t key, int8_t* data, int8_t min, int8_t max) GET_CHECK_RANGE(int8_t)
+bool CFMgr_getOrAddElementCheckRangeINT32(uint16_t key, int32_t* data, int32_t min, int32_t max) GET_CHECK_RANGE(int32_t)
+
+int CFMgr_getElement(uint16_t key, void* data, uint8_t maxlen) {
+    int idx = findKey(key);
+    if (idx<0) {
+        return -1;
+    }
+    int l = (_ctx.elements[idx].len < maxlen ? _ctx.elements[idx].len : maxlen);
+    memcpy(data, _ctx.elements[idx].data, l);
+    return l;
+}
+
+int CFMgr_getElementLen(uint16_t key) {
+    int idx = findKey(key);
+    return (idx<0 ? -1 : _ctx.elements[idx].len);
+}
+
+bool CFMgr_setElement(uint16_t key, void* data, uint8_t len) {
+    if (!writeElement(key, data, len)) {
+        return false;
+    }
+    // tell everyone who cares
+    for(int i=0;i<_ctx.nCBs;i++) {
+        (*_ctx.cbs[i])(NULL, key);
+    }
+    return true;
+}
+
+bool CFMgr_registerCB(CFG_CBFN_t cb) {
+    if (_ctx.nCBs >= MAX_CBS) {
+        return false;
+    }
+    _ctx.cbs[_ctx.nCBs++] = cb;
+    return true;
+}
+
+void CFMgr_iterateKeys(int8_t module, CFG_ITERATE_FN_t cb, void* ctx) {
+    for(int i=0;i<_ctx.nKeys;i++) {
+        if (module<0 || (_ctx.elements[i].key >> 8)==(uint8_t)module) {
+            (*cb)(ctx, _ctx.elements[i].key);
+        }
+    }
+}
@@ -0,0 +1,298 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : discrete event clock, and the sm_exec / timemgr / lowpowermgr services that run on it.
+ * Nothing sleeps for real : the clock jumps to the next pending event, so days of operation run in milliseconds.
+ */
+#include "os/os.h"
+
+#include "wyres-generic/wutils.h"
+#include "wyres-generic/sm_exec.h"
+#include "wyres-generic/timemgr.h"
+#include "wyres-generic/lowpowermgr.h"
+
+#include "sim.h"
+
+#define MAX_EVENTS (64)
+#define MAX_SMS (4)
+#define MAX_SM_STATES (32)
+#define MAX_LP_USERS (8)
+
+static struct {
+    uint64_t nowMS;
+    uint64_t seq;
+    bool stopped;
+    const char* stopReason;
+    struct {
+        bool used;
+        uint64_t at;
+        uint64_t seq;           // FIFO order for events due at the same time
+        SIM_EVENT_FN_t fn;
+        void* arg;
+        int e;
+        void* data;
+    } events[MAX_EVENTS];
+    uint32_t randState;
+    uint32_t utcOffsetSecs;
+    uint8_t nLPUsers;
+    LP_MODE_t lpModes[MAX_LP_USERS];
+    LP_CBFN_t lpCBs[MAX_LP_USERS];
+} _ctx = {
+    .randState = 1,
+};
+
+// State machines running on the clock
+typedef struct {
+    const char* name;
+    SM_STATE_t* states;
+    uint8_t nstates;
+    SM_STATE_ID_t current;
+    void* ctx;
+    uint64_t enteredAt;
+    struct {
+        uint64_t totalMS;
+        uint64_t maxMS;
+        uint32_t entries;
+    } res[MAX_SM_STATES];
+} SIM_SM_t;
+static SIM_SM_t _sms[MAX_SMS];
+static uint8_t _nSMs = 0;
+
+SIM_STATS_t sim_stats;
+
+uint64_t sim_now() {
+    return _ctx.nowMS;
+}
+
+void sim_post(uint32_t delayMS, SIM_EVENT_FN_t fn, void* arg, int e, void* data) {
+    for(int i=0;i<MAX_EVENTS;i++) {
+        if (!_ctx.events[i].used) {
+            _ctx.events[i].used = true;
+            _ctx.events[i].at = _ctx.nowMS + delayMS;
+            _ctx.events[i].seq = _ctx.seq++;
+            _ctx.events[i].fn = fn;
+            _ctx.events[i].arg = arg;
+            _ctx.events[i].e = e;
+            _ctx.events[i].data = data;
+            return;
+        }
+    }
+    // The target event queue would have overflowed as well
+    log_error("SIM:event queue full");
+    assert(0);
+}
+
+void sim_cancel(SIM_EVENT_FN_t fn, void* arg) {
+    for(int i=0;i<MAX_EVENTS;i++) {
+        if (_ctx.events[i].used && _ctx.events[i].fn==fn && _ctx.events[i].arg==arg) {
+            _ctx.events[i].used = false;
+        }
+    }
+}
+
+static LP_MODE_t currentLPMode() {
+    // The deepest mode allowed is the lightest one requested by any user
+    LP_MODE_t m = LP_OFF;
+    for(int i=0;i<_ctx.nLPUsers;i++) {
+        if (_ctx.lpModes[i] < m) {
+            m = _ctx.lpModes[i];
+        }
+    }
+    return (_ctx.nLPUsers>0?m:LP_RUN);
+}
+
+bool sim_run(uint64_t endMS) {
+    while(!_ctx.stopped) {
+        int next = -1;
+        for(int i=0;i<MAX_EVENTS;i++) {
+            if (_ctx.events[i].used &&
+                    (next<0 || _ctx.events[i].at < _ctx.events[next].at ||
+                        (_ctx.events[i].at == _ctx.events[next].at && _ctx.events[i].seq < _ctx.events[next].seq))) {
+                next = i;
+            }
+        }
+        uint64_t at = (next<0 || _ctx.events[next].at > endMS) ? endMS : _ctx.events[next].at;
+        // Account the time up to this event to the current low power mode
+        LP_MODE_t lpm = currentLPMode();
+        bool slept = (lpm==LP_DEEPSLEEP && at > _ctx.nowMS);
+        sim_stats.lpModeMS[lpm] += (at - _ctx.nowMS);
+        _ctx.nowMS = at;
+        if (next<0 || _ctx.events[next].at > endMS) {
+            return true;
+        }
+        if (slept) {
+            // MCU had to come out of deep sleep for this event
+            sim_stats.nbWakeups++;
+        }
+        _ctx.events[next].used = false;
+        (*_ctx.events[next].fn)(_ctx.events[next].arg, _ctx.events[next].e, _ctx.events[next].data);
+    }
+    return false;
+}
+
+void sim_stop(const char* why) {
+    _ctx.stopped = true;
+    _ctx.stopReason = why;
+}
+const char* sim_stopReason() {
+    return (_ctx.stopReason!=NULL?_ctx.stopReason:"end of simulated time");
+}
+
+void sim_seed(uint32_t seed) {
+    _ctx.randState = (seed!=0?seed:1);
+}
+uint32_t sim_rand(uint32_t range) {
+    // xorshift32 : deterministic for a given seed so runs can be compared before/after a change
+    uint32_t x = _ctx.randState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    _ctx.randState = x;
+    return (range>0 ? (x % range) : 0);
+}
+bool sim_chance(uint32_t pct) {
+    return (sim_rand(100) < pct);
+}
+
+// os time
+int64_t os_get_uptime_usec() {
+    return (int64_t)_ctx.nowMS*1000;
+}
+
+// timemgr
+uint32_t TMMgr_getRelTimeSecs() {
+    return (uint32_t)(_ctx.nowMS/1000);
+}
+uint32_t TMMgr_getTimeSecs() {
+    return (_ctx.utcOffsetSecs>0 ? _ctx.utcOffsetSecs + TMMgr_getRelTimeSecs() : 0);
+}
+void TMMgr_setTimeSecs(uint32_t t) {
+    _ctx.utcOffsetSecs = t - TMMgr_getRelTimeSecs();
+}
+
+// lowpowermgr
+uint8_t LPMgr_register(LP_CBFN_t cb) {
+    assert(_ctx.nLPUsers < MAX_LP_USERS);
+    _ctx.lpModes[_ctx.nLPUsers] = LP_RUN;
+    _ctx.lpCBs[_ctx.nLPUsers] = cb;
+    return _ctx.nLPUsers++;
+}
+void LPMgr_setLPMode(uint8_t id, LP_MODE_t m) {
+    assert(id < _ctx.nLPUsers);
+    LP_MODE_t prev = currentLPMode();
+    _ctx.lpModes[id] = m;
+    LP_MODE_t now = currentLPMode();
+    if (prev!=now) {
+        for(int i=0;i<_ctx.nLPUsers;i++) {
+            if (_ctx.lpCBs[i]!=NULL) {
+                (*_ctx.lpCBs[i])(prev, now);
+            }
+        }
+    }
+}
+LP_MODE_t LPMgr_getMode() {
+    return currentLPMode();
+}
+
+// sm_exec
+static void sm_account(SIM_SM_t* sm) {
+    uint64_t dt = _ctx.nowMS - sm->enteredAt;
+    sm->res[sm->current].totalMS += dt;
+    if (dt > sm->res[sm->current].maxMS) {
+        sm->res[sm->current].maxMS = dt;
+    }
+    sm->enteredAt = _ctx.nowMS;
+}
+static SM_STATE_FN_t sm_fn(SIM_SM_t* sm, SM_STATE_ID_t id) {
+    for(int i=0;i<sm->nstates;i++) {
+        if (sm->states[i].id==id) {
+            return sm->states[i].fn;
+        }
+    }
+    log_error("SIM:sm %s no state %d", sm->name, id);
+    assert(0);
+    return NULL;
+}
+static void sm_timeout_ev(void* arg, int e, void* data);
+// Move to the state returned by a state fn (if any), chaining as long as the ENTER handling asks for a new state
+static void sm_transition(SIM_SM_t* sm, SM_STATE_ID_t next) {
+    while (next!=SM_STATE_CURRENT) {
+        (*sm_fn(sm, sm->current))(sm->ctx, SM_EXIT, NULL);
+        // state timer does not survive a state change
+        sim_cancel(sm_timeout_ev, sm);
+        sm_account(sm);
+        sm->current = next;
+        sm->res[next].entries++;
+        next = (*sm_fn(sm, sm->current))(sm->ctx, SM_ENTER, NULL);
+    }
+}
+static void sm_dispatch(SIM_SM_t* sm, int e, void* data) {
+    sm_transition(sm, (*sm_fn(sm, sm->current))(sm->ctx, e, data));
+}
+static void sm_event_ev(void* arg, int e, void* data) {
+    sm_dispatch((SIM_SM_t*)arg, e, data);
+}
+static void sm_timeout_ev(void* arg, int e, void* data) {
+    sm_dispatch((SIM_SM_t*)arg, SM_TIMEOUT, NULL);
+}
+
+SM_ID_t sm_init(const char* name, SM_STATE_t* states, uint8_t nstates, SM_STATE_ID_t initialState, void* ctx) {
+    assert(_nSMs < MAX_SMS);
+    assert(nstates <= MAX_SM_STATES);
+    SIM_SM_t* sm = &_sms[_nSMs++];
+    sm->name = name;
+    sm->states = states;
+    sm->nstates = nstates;
+    sm->current = initialState;
+    sm->ctx = ctx;
+    return sm;
+}
+void sm_start(SM_ID_t smid) {
+    SIM_SM_t* sm = (SIM_SM_t*)smid;
+    sm->enteredAt = _ctx.nowMS;
+    sm->res[sm->current].entries++;
+    sm_transition(sm, (*sm_fn(sm, sm->current))(sm->ctx, SM_ENTER, NULL));
+}
+bool sm_sendEvent(SM_ID_t smid, int e, void* data) {
+    sim_post(0, sm_event_ev, smid, e, data);
+    return true;
+}
+void sm_timer_start(SM_ID_t smid, uint32_t tms) {
+    sim_cancel(sm_timeout_ev, smid);
+    sim_post(tms, sm_timeout_ev, smid, SM_TIMEOUT, NULL);
+}
+void sm_timer_stop(SM_ID_t smid) {
+    sim_cancel(sm_timeout_ev, smid);
+}
+void sm_default_event_log(SM_ID_t smid, const char* logpref, int e) {
+    SIM_SM_t* sm = (SIM_SM_t*)smid;
+    log_debug("%s:state %d ignores event %d", logpref, sm->current, e);
+}
+
+void sim_sm_report(FILE* out) {
+    for(int s=0;s<_nSMs;s++) {
+        SIM_SM_t* sm = &_sms[s];
+        sm_account(sm);
+        fprintf(out, "State machine [%s]\n", sm->name);
+        fprintf(out, "  %-22s %14s %7s %9s %12s %12s\n", "state", "total ms", "%", "entries", "mean ms", "max ms");
+        for(int i=0;i<sm->nstates;i++) {
+            SM_STATE_ID_t id = sm->states[i].id;
+            fprintf(out, "  %-22s %14" PRIu64 " %7.3f %9" PRIu32 " %12" PRIu64 " %12" PRIu64 "\n",
+                sm->states[i].name, sm->res[id].totalMS,
+                (_ctx.nowMS>0 ? (100.0*sm->res[id].totalMS)/_ctx.nowMS : 0.0),
+                sm->res[id].entries,
+                (sm->res[id].entries>0 ? sm->res[id].totalMS/sm->res[id].entries : 0),
+                sm->res[id].maxMS);
+        }
+    }
+}
@@ -0,0 +1,261 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : loraapi. Join and tx complete after the time on air plus the class A RX windows,
+ * with a single 1% duty cycle budget for the channels used (EU868 style).
+ */
+#include "os/os.h"
+
+#include "wyres-generic/wutils.h"
+#include "wyres-generic/timemgr.h"
+#include "loraapi/loraapi.h"
+#include "app-core/app_msg.h"
+#include "app-core/app_core.h"
+
+#include "sim.h"
+
+// LoRaWAN MAC overhead on an UL data frame : MHDR(1) + FHDR(7) + FPort(1) + MIC(4)
+#define LORAWAN_UL_OVERHEAD (13)
+// Join request PHY payload size
+#define LORAWAN_JOINREQ_SZ (23)
+#define JOIN_ACCEPT_DELAY_MS (6000)
+#define RX1_DELAY_MS (1000)
+#define RX2_DELAY_MS (2000)
+// Demodulation floor SNR at SF7 (0.1dB), 2.5dB lower for each SF up (SX127x datasheet)
+#define SNR_FLOOR_SF7 (-75)
+#define SNR_FLOOR_STEP (25)
+// The gateway : tx power (dBm) and receiver advantage over the device (dB, noise figure, antenna), so the DL SNR is the UL one +
+// (GW_TX_DBM - device tx power - GW_RX_ADV_DB)
+#define GW_TX_DBM (27)
+#define GW_RX_ADV_DB (6)
+// Time to detect a preamble in RX2 (SF12 in EU868)
+#define RX2_WINDOW_MS (200)
+#define DUTYCYCLE_FACTOR (100)
+// App ack requests received and not yet answered (the backend answers in the RX of the next listening UL)
+#define MAX_APP_ACKS (16)
+// Tags of the event TLVs (as app-core app acks them)
+#define EVENT_TAGS ((1ULL<<APP_CORE_UL_ENV_BUTTON) | (1ULL<<APP_CORE_UL_BLE_ENTER) | (1ULL<<APP_CORE_UL_BLE_EXIT) | \
+                    (1ULL<<APP_CORE_UL_BLE_PROX_ENTER) | (1ULL<<APP_CORE_UL_BLE_PROX_EXIT) | \
+                    (1ULL<<APP_CORE_UL_BLE_ENTER_LIST) | (1ULL<<APP_CORE_UL_BLE_EXIT_LIST))
+
+enum { EV_JOIN_RESULT, EV_TX_RESULT, EV_RX };
+
+static struct {
+    bool inited;
+    bool joined;
+    uint64_t bandFreeAt;          // duty cycle : no tx before this time
+    LORAAPI_JOIN_CB_t joinCB;
+    void* joinCtx;
+    LORAAPI_TX_CB_t txCB;
+    void* txCtx;
+    LORAAPI_RX_CB_t rxCB;
+    void* rxCtx;
+    uint8_t dlId;
+    int8_t dlSNR;
+    int8_t txPower;               // device tx power (dBm)
+    uint8_t dl[2+64+2+MAX_APP_ACKS];
+    uint8_t nbAppAcks;
+    uint8_t appAcks[MAX_APP_ACKS];
+} _ctx;
+
+uint32_t sim_lora_toaMS(uint8_t sf, uint8_t payloadSz, bool isJoin) {
+    // Semtech AN1200.13 : BW 125kHz, CR 4/5, 8 symbol preamble, explicit header, CRC on
+    uint32_t pl = payloadSz + (isJoin ? 0 : LORAWAN_UL_OVERHEAD);
+    int de = (sf>=11 ? 1 : 0);      // low data rate optimise
+    uint32_t tsymUS = (1u << sf) * 8;       // 2^SF / 125kHz in us
+    int num = 8*pl - 4*sf + 28 + 16;
+    int den = 4*(sf - 2*de);
+    int nPayload = 8 + (num > 0 ? ((num + den - 1) / den) * 5 : 0);
+    uint32_t toaUS = (tsymUS * 49) / 4 + nPayload * tsymUS;     // preamble is 12.25 symbols
+    return (toaUS + 999) / 1000;
+}
+
+static void lora_ev(void* arg, int e, void* data) {
+    LORAWAN_RESULT_t res = (LORAWAN_RESULT_t)(intptr_t)data;
+    switch(e) {
+        case EV_JOIN_RESULT: {
+            _ctx.joined = (res==LORAWAN_RES_JOIN_OK);
+            if (_ctx.joinCB!=NULL) {
+                (*_ctx.joinCB)(_ctx.joinCtx, res);
+            }
+            break;
+        }
+        case EV_TX_RESULT: {
+            if (_ctx.txCB!=NULL) {
+                (*_ctx.txCB)(_ctx.txCtx, res);
+            }
+            break;
+        }
+        case EV_RX: {
+            // DL built at the tx
+            sim_stats.nbDL++;
+            if (_ctx.rxCB!=NULL) {
+                (*_ctx.rxCB)(_ctx.rxCtx, LORAWAN_RES_OK, 3, -90, _ctx.dlSNR, _ctx.dl, (uint8_t)(intptr_t)data);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static bool useAirtime(uint32_t toa) {
+    if (sim_now() < _ctx.bandFreeAt) {
+        return false;
+    }
+    _ctx.bandFreeAt = sim_now() + (uint64_t)toa * DUTYCYCLE_FACTOR;
+    sim_stats.airtimeMS += toa;
+    return true;
+}
+
+void lora_api_init(uint8_t* devEUI, uint8_t* appEUI, uint8_t* appKey, bool enableADR, LORAWAN_SF_t defaultSF, int8_t defaultTxPower) {
+    _ctx.inited = true;
+    _ctx.txPower = defaultTxPower;
+}
+
+LORAWAN_RESULT_t lora_api_join(LORAAPI_JOIN_CB_t callback, LORAWAN_SF_t sf, void* userctx) {
+    if (!_ctx.inited) {
+        return LORAWAN_RES_FWERR;
+    }
+    if (_ctx.joined) {
+        return LORAWAN_RES_JOIN_OK;
+    }
+    uint32_t toa = sim_lora_toaMS(sf, LORAWAN_JOINREQ_SZ, true);
+    if (!useAirtime(toa)) {
+        return LORAWAN_RES_DUTYCYCLE;
+    }
+    sim_stats.nbJoinReqs++;
+    _ctx.joinCB = callback;
+    _ctx.joinCtx = userctx;
+    LORAWAN_RESULT_t res = (sim_chance(sim_world.joinOkPct) ? LORAWAN_RES_JOIN_OK : LORAWAN_RES_NO_RESP);
+    sim_post(toa + JOIN_ACCEPT_DELAY_MS + RX2_WINDOW_MS, lora_ev, &_ctx, EV_JOIN_RESULT, (void*)(intptr_t)res);
+    return LORAWAN_RES_OK;
+}
+
+LORAWAN_RESULT_t lora_api_send(LORAWAN_SF_t sf, uint8_t port, bool ack, bool willListen, uint8_t* data, uint8_t sz, LORAAPI_TX_CB_t callback, void* userctx) {
+    if (!_ctx.joined) {
+        return LORAWAN_RES_NOT_JOIN;
+    }
+    // EU868 max payload per data rate : the stack refuses anything bigger
+    if (sz > (sf<=LORAWAN_SF8 ? 222 : (sf==LORAWAN_SF9 ? 115 : 51))) {
+        log_error("SIM:UL sz %d too big for SF%d", sz, sf);
+        sim_stats.nbULRefused++;
+        return LORAWAN_RES_BADPARAM;
+    }
+    uint32_t toa = sim_lora_toaMS(sf, sz, false);
+    if (!useAirtime(toa)) {
+        sim_stats.nbULRefused++;
+        return LORAWAN_RES_DUTYCYCLE;
+    }
+    sim_stats.nbULTx++;
+    sim_stats.nbULTxSF[sf]++;
+    sim_stats.nbULBytes += sz;
+    if (sim_stats.nbULTx==1) {
+        sim_stats.firstULMS = sim_now();
+    }
+    // as the backend would
+    uint8_t dec[256];
+    uint8_t* ul = data;
+    int ulsz = sz;
+    if (((data[0] >> 4) & 0x03)==APP_CORE_MSGS_VERSION_UL_COMPACT) {
+        ulsz = sim_decodeCompactUL(data, sz, dec, 255, TMMgr_getRelTimeSecs());
+        if (ulsz<0) {
+            log_error("SIM:compact UL sz %d does not decode", sz);
+            assert(0);
+        }
+        ul = dec;
+        sim_stats.nbULCompact++;
+        sim_stats.nbULBytesSaved += (ulsz - sz);
+    }
+    LORAWAN_RESULT_t res = (sim_chance(sim_world.txOkPct) ? LORAWAN_RES_OK : LORAWAN_RES_TIMEOUT);
+    _ctx.dlSNR = 5;
+    if (sim_world.linkModel) {
+        // The DL in RX1 is at the same SF, on the same path but stronger (gateway tx power, less its better receiver)
+        int ulSNR = sim_world.linkSNR - 3 + (int)sim_rand(7);
+        _ctx.dlSNR = ulSNR + (GW_TX_DBM - _ctx.txPower - GW_RX_ADV_DB);
+        if ((ulSNR * 10) < (SNR_FLOOR_SF7 - SNR_FLOOR_STEP * ((int)sf - LORAWAN_SF7))) {
+            res = LORAWAN_RES_TIMEOUT;
+        }
+    }
+    // the backend only sees it if it got through
+    bool rxd = (res==LORAWAN_RES_OK);
+    for(int off=2; (off+2)<=ulsz; off += (ul[off+1]+2)) {
+        if (rxd && ul[off]<64 && (EVENT_TAGS & (1ULL<<ul[off]))) {
+            sim_stats.nbULEvents++;
+            sim_stats.nbULEventBytes += (ul[off+1]+2);
+        }
+        if (ul[off]==APP_CORE_UL_APP_ACK_REQ && ul[off+1]==1) {
+            sim_stats.nbULAppAckReqs++;
+            if (rxd && _ctx.nbAppAcks<MAX_APP_ACKS && 
+                    (sim_world.appAckPct>=100 || sim_chance(sim_world.appAckPct))) {
+                _ctx.appAcks[_ctx.nbAppAcks++] = ul[off+2];
+            }
+        }
+        if (ul[off]==APP_CORE_UL_DELTA) {
+            // mask of the tags not resent
+            sim_stats.nbULDelta++;
+            for(int i=0;i<ul[off+1];i++) {
+                sim_stats.nbULDeltaTags += __builtin_popcount(ul[off+2+i]);
+            }
+        }
+    }
+    _ctx.txCB = callback;
+    _ctx.txCtx = userctx;
+    // DL in RX1 : v0 header (even parity), DL id 1-15 and the number of actions. The configured actions, and the app acks 
+    // if the UL is listening
+    uint8_t na = 0;
+    uint8_t dlsz = 2;
+    if (rxd && sim_world.dlActionsSz>0 && sim_chance(sim_world.dlPct)) {
+        for(int off=0; (off+2)<=sim_world.dlActionsSz; off += (sim_world.dlActions[off+1]+2)) {
+            na++;
+        }
+        memcpy(&_ctx.dl[dlsz], sim_world.dlActions, sim_world.dlActionsSz);
+        dlsz += sim_world.dlActionsSz;
+    }
+    if (rxd && willListen && _ctx.nbAppAcks>0) {
+        _ctx.dl[dlsz++] = APP_CORE_DL_APP_ACK;
+        _ctx.dl[dlsz++] = _ctx.nbAppAcks;
+        memcpy(&_ctx.dl[dlsz], _ctx.appAcks, _ctx.nbAppAcks);
+        dlsz += _ctx.nbAppAcks;
+        sim_stats.nbDLAppAcks += _ctx.nbAppAcks;
+        _ctx.nbAppAcks = 0;
+        na++;
+    }
+    if (na>0) {
+        _ctx.dlId = (_ctx.dlId % 15) + 1;
+        _ctx.dl[0] = (APP_CORE_MSGS_VERSION_DL << 4);
+        _ctx.dl[1] = (_ctx.dlId << 4) | (na & 0x0f);
+        sim_post(toa + RX1_DELAY_MS, lora_ev, &_ctx, EV_RX, (void*)(intptr_t)dlsz);
+    }
+    if (sim_world.txNoResultPct>0 && sim_chance(sim_world.txNoResultPct)) {
+        // the stack lost track of it : the app has to time out on its own
+        return LORAWAN_RES_OK;
+    }
+    // Result is known once both RX windows are done
+    sim_post(toa + RX2_DELAY_MS + RX2_WINDOW_MS, lora_ev, &_ctx, EV_TX_RESULT, (void*)(intptr_t)res);
+    return LORAWAN_RES_OK;
+}
+
+LORAWAN_RESULT_t lora_api_registerRxCB(int port, LORAAPI_RX_CB_t callback, void* userctx) {
+    _ctx.rxCB = callback;
+    _ctx.rxCtx = userctx;
+    return LORAWAN_RES_OK;
+}
+
+bool lora_api_isJoined() {
+    return _ctx.joined;
+}
+
+int lora_api_getCurrentRegion() {
+    return 0;
+}
@@ -0,0 +1,270 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : main(). Does what sysinit() + the target app main() do (init app-core then the selected
+ * modules in pkg.init order, then app_core_start()), runs the simulated days and prints the report.
+ */
+#include <getopt.h>
+
+#include "os/os.h"
+
+#include "wyres-generic/wutils.h"
+#include "wyres-generic/configmgr.h"
+#include "wyres-generic/lowpowermgr.h"
+#include "app-core/app_core.h"
+#include "app-core/app_prof.h"
+
+#include "sim.h"
+
+// pkg.init entry points
+extern void app_core_init(void);
+extern void mod_env_init(void);
+extern void mod_pti_init(void);
+extern void mod_prodtest_init(void);
+extern void mod_ble_wconsole_init(void);
+extern void mod_ble_scan_nav_init(void);
+extern void mod_ble_scan_tag_init(void);
+extern void mod_ble_scanA_tag_init(void);
+extern void mod_ble_scan_alert_init(void);
+extern void mod_ble_scan_prox_init(void);
+extern void mod_ble_ibeacon_init(void);
+extern void mod_gps_init(void);
+
+// Modules that can be put in a build, in pkg.init priority order
+static struct {
+    const char* name;
+    APP_MOD_ID_t id;
+    void (*init)(void);
+    bool selected;
+} _mods[] = {
+    { .name="env", .id=APP_MOD_ENV, .init=mod_env_init },
+    { .name="pti", .id=APP_MOD_PTI, .init=mod_pti_init },
+    { .name="prodtest", .id=APP_MOD_PRODTEST, .init=mod_prodtest_init },
+    { .name="ble-wconsole", .id=APP_MOD_BLE_CONSOLE, .init=mod_ble_wconsole_init },
+    { .name="ble-nav", .id=APP_MOD_BLE_SCAN_NAV, .init=mod_ble_scan_nav_init },
+    { .name="ble-tag", .id=APP_MOD_BLE_SCAN_TAGS, .init=mod_ble_scan_tag_init },
+    { .name="ble-scanA-tag", .id=APP_MOD_BLE_SCANA_TAGS, .init=mod_ble_scanA_tag_init },
+    { .name="ble-alert", .id=APP_MOD_BLE_SCAN_ALERT, .init=mod_ble_scan_alert_init },
+    { .name="ble-prox", .id=APP_MOD_BLE_SCAN_PROX, .init=mod_ble_scan_prox_init },
+    { .name="ble-ibeacon", .id=APP_MOD_BLE_IB, .init=mod_ble_ibeacon_init },
+    { .name="gps", .id=APP_MOD_GPS, .init=mod_gps_init },
+};
+#define NB_MODS (sizeof(_mods)/sizeof(_mods[0]))
+#define DEFAULT_MODS "env,gps,ble-nav"
+
+static void usage(const char* prog) {
+    printf("usage: %s [options]\n", prog);
+    printf("  -d <days>        simulated days to run (default 7)\n");
+    printf("  -m <mod,mod...>  modules in the build (default %s), from:\n   ", DEFAULT_MODS);
+    for(unsigned i=0;i<NB_MODS;i++) {
+        printf(" %s", _mods[i].name);
+    }
+    printf("\n");
+    printf("  -c <key>=<hex>   preset a config element (eg -c 0401=2c010000)\n");
+    printf("  -s <seed>        random seed (default 1)\n");
+    printf("  -M <pct>         %% of time moving (default %d)\n", sim_world.movingPct);
+    printf("  -j <pct>         %% of joins accepted (default %d)\n", sim_world.joinOkPct);
+    printf("  -t <pct>         %% of UL tx ok (default %d)\n", sim_world.txOkPct);
+    printf("  -x <pct>         %% of UL tx whose result the stack never gives (default %d)\n", sim_world.txNoResultPct);
+    printf("  -P <n>           other devices doing proximity ibeaconning around (default %d)\n", sim_world.nbProxDevices);
+    printf("  -a <pct>         %% of app ack requests the backend answers (default %d)\n", sim_world.appAckPct);
+    printf("  -g <pct>         %% of gps sessions with a fix (default %d)\n", sim_world.gpsFixPct);
+    printf("  -L <snr>         UL SNR at the gateway in dB (+/-3dB per packet) : packets below the demodulation floor of their SF are lost (default no link model)\n");
+    printf("  -R <reason>      reset reason of the boot (RM_REASON_t, default 0 : power on)\n");
+    printf("  -U               uart console wired (nobody types on it)\n");
+    printf("  -D <pct>:<hex>   DL with these actions after <pct>%% of the ULs (eg -D 10:02060404ffffffff sets the active modules mask)\n");
+    printf("  -p               print the callback/codec execution time profile (as AT+PROF, host ns so not reproducible)\n");
+    printf("  -v               logs : -v warnings, -vv info, -vvv debug\n");
+}
+
+static bool selectMods(char* list) {
+    for(char* m = strtok(list, ","); m!=NULL; m = strtok(NULL, ",")) {
+        bool found = false;
+        for(unsigned i=0;i<NB_MODS;i++) {
+            if (strcmp(m, _mods[i].name)==0) {
+                // Same rule as a target build : a module id can only be provided once
+                for(unsigned j=0;j<NB_MODS;j++) {
+                    if (j!=i && _mods[j].selected && _mods[j].id==_mods[i].id) {
+                        printf("module %s has same id as %s\n", _mods[i].name, _mods[j].name);
+                        return false;
+                    }
+                }
+                _mods[i].selected = true;
+                found = true;
+            }
+        }
+        if (!found) {
+            printf("unknown module %s\n", m);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool presetConfig(const char* kv) {
+    unsigned int key;
+    char hex[2*64+1];
+    uint8_t v[64];
+    if (sscanf(kv, "%4x=%128s", &key, hex)!=2) {
+        return false;
+    }
+    int l = Util_scanhex(hex, strlen(hex)/2, v);
+    if (l<=0 || l!=(int)(strlen(hex)/2)) {
+        return false;
+    }
+    return CFMgr_setElement(key, v, l);
+}
+
+static bool setDL(const char* pa) {
+    char hex[2*64+1];
+    if (sscanf(pa, "%u:%128s", &sim_world.dlPct, hex)!=2) {
+        return false;
+    }
+    int l = Util_scanhex(hex, strlen(hex)/2, sim_world.dlActions);
+    if (l<=0 || l!=(int)(strlen(hex)/2)) {
+        return false;
+    }
+    sim_world.dlActionsSz = l;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t days = 7;
+    uint32_t seed = 1;
+    int verbose = 0;
+    bool profile = false;
+    char modlist[256];
+    strcpy(modlist, DEFAULT_MODS);
+    // The device is provisioned and has been deployed (ie not in stock mode)
+    uint8_t deveui[8] = {0x38, 0xb8, 0xeb, 0xe0, 0x00, 0x00, 0x00, 0x01};
+    uint8_t appkey[16] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10};
+    uint8_t notStock = 1;
+    CFMgr_setElement(CFG_UTIL_KEY_LORA_DEVEUI, deveui, sizeof(deveui));
+    CFMgr_setElement(CFG_UTIL_KEY_LORA_APPKEY, appkey, sizeof(appkey));
+    CFMgr_setElement(CFG_UTIL_KEY_STOCK_MODE, &notStock, sizeof(notStock));
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:m:c:s:M:j:t:x:a:P:g:L:R:UD:pvh")) != -1) {
+        switch(opt) {
+            case 'd': days = strtoul(optarg, NULL, 0); break;
+            case 'm': strncpy(modlist, optarg, sizeof(modlist)-1); break;
+            case 'c': {
+                if (!presetConfig(optarg)) {
+                    printf("bad config preset [%s]\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            case 'M': sim_world.movingPct = strtoul(optarg, NULL, 0); break;
+            case 'j': sim_world.joinOkPct = strtoul(optarg, NULL, 0); break;
+            case 't': sim_world.txOkPct = strtoul(optarg, NULL, 0); break;
+            case 'x': sim_world.txNoResultPct = strtoul(optarg, NULL, 0); break;
+            case 'P': sim_world.nbProxDevices = strtoul(optarg, NULL, 0); break;
+            case 'a': sim_world.appAckPct = strtoul(optarg, NULL, 0); break;
+            case 'g': sim_world.gpsFixPct = strtoul(optarg, NULL, 0); break;
+            case 'L': {
+                sim_world.linkModel = true;
+                sim_world.linkSNR = strtol(optarg, NULL, 0);
+                break;
+            }
+            case 'R': sim_world.resetReason = strtoul(optarg, NULL, 0); break;
+            case 'U': sim_world.consoleWired = true; break;
+            case 'D': {
+                if (!setDL(optarg)) {
+                    printf("bad DL [%s]\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            case 'p': profile = true; break;
+            case 'v': verbose++; break;
+            default:
+                usage(argv[0]);
+                return (opt=='h' ? 0 : 1);
+        }
+    }
+    if (!selectMods(modlist)) {
+        return 1;
+    }
+    set_log_level(verbose>=3 ? LOGS_DEBUG : verbose==2 ? LOGS_INFO : verbose==1 ? LOGS_RUN : LOGS_OFF);
+    sim_seed(seed);
+    sim_world_init();
+
+    // sysinit
+    app_core_init();
+    for(unsigned i=0;i<NB_MODS;i++) {
+        if (_mods[i].selected) {
+            (*_mods[i].init)();
+        }
+    }
+    // main
+    app_core_start(1, 0, 0, "sim", "app-core-sim");
+
+    uint64_t endMS = (uint64_t)days*24*60*60*1000;
+    sim_run(endMS);
+
+    // Report
+    uint64_t simMS = sim_now();
+    double simDays = simMS/86400000.0;
+    printf("Simulated %.3f days (%s), seed %u, moving %u%%\n", simDays, sim_stopReason(), seed, sim_world.movingPct);
+    printf("Modules:");
+    for(unsigned i=0;i<NB_MODS;i++) {
+        if (_mods[i].selected) {
+            printf(" %s", _mods[i].name);
+        }
+    }
+    printf("\n");
+    sim_sm_report(stdout);
+    printf("LoRa: %u join reqs, %u UL tx (%.1f/day, %u bytes, mean %u), %u refused for duty cycle, airtime %" PRIu64 " ms\n",
+        sim_stats.nbJoinReqs, sim_stats.nbULTx, (simDays>0 ? sim_stats.nbULTx/simDays : 0.0), sim_stats.nbULBytes,
+        (sim_stats.nbULTx>0 ? sim_stats.nbULBytes/sim_stats.nbULTx : 0), sim_stats.nbULRefused, sim_stats.airtimeMS);
+    printf("UL tx by SF:");
+    for(int sf=7;sf<=12;sf++) {
+        printf(" SF%d %u", sf, sim_stats.nbULTxSF[sf]);
+    }
+    printf("\n");
+    printf("First UL at %.1f s\n", sim_stats.firstULMS/1000.0);
+    if (sim_stats.nbULCompact>0) {
+        printf("Compact ULs: %u, %u bytes saved\n", sim_stats.nbULCompact, sim_stats.nbULBytesSaved);
+    }
+    if (sim_stats.nbULDelta>0) {
+        printf("Delta ULs: %u, %u unchanged tags not resent\n", sim_stats.nbULDelta, sim_stats.nbULDeltaTags);
+    }
+    if (sim_stats.nbULEvents>0) {
+        printf("Event TLVs: %u received (%u bytes), %u app ack reqs, %u app acked\n", sim_stats.nbULEvents, sim_stats.nbULEventBytes,
+            sim_stats.nbULAppAckReqs, sim_stats.nbDLAppAcks);
+    }
+    if (sim_stats.nbDL>0) {
+        printf("DLs: %u\n", sim_stats.nbDL);
+    }
+    printf("Power: deepsleep %.3f%%, doze %.3f%%, run %.3f%%, %u wakeups from deepsleep\n",
+        (simMS>0 ? (100.0*sim_stats.lpModeMS[LP_DEEPSLEEP])/simMS : 0.0),
+        (simMS>0 ? (100.0*sim_stats.lpModeMS[LP_DOZE])/simMS : 0.0),
+        (simMS>0 ? (100.0*sim_stats.lpModeMS[LP_RUN])/simMS : 0.0),
+        sim_stats.nbWakeups);
+    printf("Config: %u lookups, %u writes\n", sim_stats.nbCfgReads, sim_stats.nbCfgWrites);
+    if (profile) {
+        printf("Profile (%s):\n", app_prof_unit());
+        for(int i=0;i<APP_PROF_NB_SITES;i++) {
+            APP_PROF_STATS_t st;
+            const char* what;
+            const char* fn;
+            if (app_prof_get(i, &st)) {
+                app_prof_siteName(i, &what, &fn);
+                printf("  %-16s %-22s n %8u min %6u max %8u mean %6u\n", what, fn, st.nCalls, st.min, st.max, (uint32_t)(st.total/st.nCalls));
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : wutils logging (to stdout, stamped with the simulated time) and buffer helpers
+ */
+#include "os/os.h"
+
+#include "wyres-generic/wutils.h"
+
+#include "sim.h"
+
+static LOG_LEVEL _logLevel = LOGS_OFF;
+
+static void log_out(LOG_LEVEL l, const char* pref, const char* ls, va_list vl) {
+    if (l < _logLevel) {
+        return;
+    }
+    uint64_t now = sim_now();
+    printf("[%3" PRIu64 "d %02" PRIu64 ":%02" PRIu64 ":%02" PRIu64 ".%03" PRIu64 "] %s",
+        now/86400000, (now/3600000)%24, (now/60000)%60, (now/1000)%60, now%1000, pref);
+    vprintf(ls, vl);
+    printf("\n");
+}
+
+void set_log_level(LOG_LEVEL l) {
+    _logLevel = l;
+}
+LOG_LEVEL get_log_level() {
+    return _logLevel;
+}
+const char* get_log_level_str() {
+    switch(_logLevel) {
+        case LOGS_DEBUG: return "DEBUG";
+        case LOGS_INFO: return "INFO";
+        case LOGS_RUN: return "RUN";
+        default: return "OFF";
+    }
+}
+void log_debug(const char* ls, ...) {
+    va_list vl;
+    va_start(vl, ls);
+    log_out(LOGS_DEBUG, "D:", ls, vl);
+    va_end(vl);
+}
+void log_info(const char* ls, ...) {
+    va_list vl;
+    va_start(vl, ls);
+    log_out(LOGS_INFO, "I:", ls, vl);
+    va_end(vl);
+}
+void log_warn(const char* ls, ...) {
+    va_list vl;
+    va_start(vl, ls);
+    log_out(LOGS_RUN, "W:", ls, vl);
+    va_end(vl);
+}
+void log_error(const char* ls, ...) {
+    va_list vl;
+    va_start(vl, ls);
+    log_out(LOGS_RUN, "E:", ls, vl);
+    va_end(vl);
+}
+void log_noout(const char* ls, ...) {
+}
+void log_check_uart_active() {
+}
+
+void Util_writeLE_uint16_t(uint8_t* b, uint8_t offset, uint16_t v) {
+    b[offset] = (v & 0xff);
+    b[offset+1] = ((v >> 8) & 0xff);
+}
+void Util_writeLE_int16_t(uint8_t* b, uint8_t offset, int16_t v) {
+    Util_writeLE_uint16_t(b, offset, (uint16_t)v);
+}
+void Util_writeLE_uint32_t(uint8_t* b, uint8_t offset, uint32_t v) {
+    for(int i=0;i<4;i++) {
+        b[offset+i] = ((v >> (i*8)) & 0xff);
+    }
+}
+void Util_writeLE_int32_t(uint8_t* b, uint8_t offset, int32_t v) {
+    Util_writeLE_uint32_t(b, offset, (uint32_t)v);
+}
+uint16_t Util_readLE_uint16_t(uint8_t* b, uint8_t l) {
+    return (uint16_t)Util_readLE_uint32_t(b, (l<2?l:2));
+}
+uint32_t Util_readLE_uint32_t(uint8_t* b, uint8_t l) {
+    uint32_t v = 0;
+    for(int i=0;i<l && i<4;i++) {
+        v |= ((uint32_t)b[i]) << (i*8);
+    }
+    return v;
+}
+uint32_t Util_hashstrn(const char* s, int maxlen) {
+    // djb2
+    uint32_t h = 5381;
+    for(int i=0;i<maxlen && s[i]!='\0';i++) {
+        h = ((h << 5) + h) + (uint8_t)s[i];
+    }
+    return h;
+}
+bool Util_notAll0(const uint8_t* p, uint8_t sz) {
+    for(int i=0;i<sz;i++) {
+        if (p[i]!=0) {
+            return true;
+        }
+    }
+    return false;
+}
+int Util_scanhex(const char* s, int sz, uint8_t* v) {
+    int i = 0;
+    for(;i<sz && s[i*2]!='\0' && s[i*2+1]!='\0';i++) {
+        unsigned int b;
+        if (sscanf(&s[i*2], "%2x", &b)<1) {
+            break;
+        }
+        v[i] = (uint8_t)b;
+    }
+    return i;
+}
@@ -0,0 +1,536 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Host simulation : the device's surroundings. Movement timeline, sensors, GPS sky and BLE beacons around,
+ * plus the hardware managers (leds, reboot, uarts, console...) that have nothing to simulate.
+ */
+#include "os/os.h"
+#include "bsp.h"
+
+#include "hal/hal_gpio.h"
+#include "wyres-generic/wutils.h"
+#include "wyres-generic/ledmgr.h"
+#include "wyres-generic/movementmgr.h"
+#include "wyres-generic/sensormgr.h"
+#include "wyres-generic/rebootmgr.h"
+#include "wyres-generic/gpsmgr.h"
+#include "wyres-generic/wblemgr.h"
+#include "wyres-generic/wconsole.h"
+#include "wyres-generic/uartlinemgr.h"
+#include "wyres-generic/uartselector.h"
+
+#include "sim.h"
+
+#define MAX_BEACONS (64)
+// GPS fix timing
+#define GPS_COLD_TTFF_SECS (40)
+#define GPS_WARM_TTFF_SECS (8)
+#define GPS_WARM_VALID_SECS (4*60*60)
+// BLE scan : one scan result batch per second
+#define BLE_SCAN_PERIOD_MS (1000)
+#define BLE_SEEN_PCT (70)
+#define BLE_TAG_CHANGE_PCT (5)
+// Accelerometer activity interrupt rate while moving
+#define MOVE_IRQ_PERIOD_MS (30000)
+
+SIM_WORLD_t sim_world = {
+    .movingPct = 20,
+    .moveMeanMins = 20,
+    .joinOkPct = 90,
+    .txOkPct = 95,
+    .appAckPct = 100,
+    .gpsFixPct = 80,
+    .nbNavBeacons = 4,
+    .nbTags = 6,
+};
+
+enum { EV_MOVE_CHANGE, EV_GPS_COMM, EV_GPS_FIX, EV_BLE_COMM, EV_BLE_SCAN };
+
+static struct {
+    // movement timeline
+    bool moving;
+    uint64_t nextMoveChangeMS;
+    uint32_t lastMovedSecs;
+    MM_CBFN_t moveCB;
+    // gps
+    GPS_CB_FN_t gpsCB;
+    bool gpsOn;
+    uint32_t gpsLastFixSecs;
+    gps_data_t gpsFix;
+    // ble
+    WBLE_CB_FN_t bleCB;
+    bool bleOn;
+    uint16_t scanMajStart;
+    uint16_t scanMajEnd;
+    uint32_t scanListSz;
+    ibeacon_data_t* scanList;
+    uint8_t nBeacons;
+    struct {
+        uint16_t major;
+        uint16_t minor;
+        bool present;
+    } beacons[MAX_BEACONS];
+    uint8_t hwVer;
+} _ctx;
+
+// Movement is a sequence of moving/still periods, with lengths drawn around the configured means
+static uint64_t nextPeriodMS(bool moving) {
+    uint32_t meanMins = sim_world.moveMeanMins;
+    if (!moving) {
+        meanMins = (sim_world.movingPct>0 ? (meanMins * (100-sim_world.movingPct)) / sim_world.movingPct : 365*24*60);
+    }
+    uint64_t meanMS = (uint64_t)meanMins*60*1000;
+    return meanMS/2 + (meanMS > 0 ? ((uint64_t)sim_rand(1000) * meanMS) / 1000 : 0);
+}
+static void updateMovement() {
+    while (sim_now() >= _ctx.nextMoveChangeMS) {
+        if (_ctx.moving) {
+            _ctx.lastMovedSecs = (uint32_t)(_ctx.nextMoveChangeMS/1000);
+        }
+        _ctx.moving = (sim_world.movingPct>=100 ? true : !_ctx.moving);
+        if (sim_world.movingPct==0) {
+            _ctx.moving = false;
+        }
+        _ctx.nextMoveChangeMS += nextPeriodMS(_ctx.moving);
+    }
+    if (_ctx.moving) {
+        _ctx.lastMovedSecs = (uint32_t)(sim_now()/1000);
+    }
+}
+
+// The accelerometer interrupt : the movement callback is called regularly during each moving period
+static void move_ev(void* arg, int e, void* data) {
+    updateMovement();
+    if (_ctx.moving && _ctx.moveCB!=NULL) {
+        (*_ctx.moveCB)();
+    }
+    // (periods can be longer than a post delay, just look again later)
+    uint64_t delay = _ctx.nextMoveChangeMS - sim_now();
+    if (_ctx.moving && delay > MOVE_IRQ_PERIOD_MS) {
+        delay = MOVE_IRQ_PERIOD_MS;
+    }
+    sim_post((delay > 86400000 ? 86400000 : (uint32_t)delay), move_ev, &_ctx, EV_MOVE_CHANGE, NULL);
+}
+
+void sim_world_init() {
+    _ctx.moving = false;
+    _ctx.nextMoveChangeMS = nextPeriodMS(false);
+    sim_post(0, move_ev, &_ctx, EV_MOVE_CHANGE, NULL);
+    // Beacons around : fixed navigation ones, then enter/exit tags
+    for(uint32_t i=0;i<sim_world.nbNavBeacons && _ctx.nBeacons<MAX_BEACONS;i++) {
+        _ctx.beacons[_ctx.nBeacons].major = 0x0001;
+        _ctx.beacons[_ctx.nBeacons].minor = 100+i;
+        _ctx.beacons[_ctx.nBeacons].present = true;
+        _ctx.nBeacons++;
+    }
+    for(uint32_t i=0;i<sim_world.nbTags && _ctx.nBeacons<MAX_BEACONS;i++) {
+        _ctx.beacons[_ctx.nBeacons].major = 0x8001;
+        _ctx.beacons[_ctx.nBeacons].minor = 1+i;
+        _ctx.beacons[_ctx.nBeacons].present = sim_chance(50);
+        _ctx.nBeacons++;
+    }
+    for(uint32_t i=0;i<sim_world.nbProxDevices && _ctx.nBeacons<MAX_BEACONS;i++) {
+        _ctx.beacons[_ctx.nBeacons].major = 0x8201;
+        _ctx.beacons[_ctx.nBeacons].minor = 1+i;
+        _ctx.beacons[_ctx.nBeacons].present = sim_chance(50);
+        _ctx.nBeacons++;
+    }
+}
+
+uint32_t sim_world_lastMovedSecs() {
+    updateMovement();
+    return _ctx.lastMovedSecs;
+}
+
+// movementmgr
+bool MMMgr_start() {
+    return true;
+}
+bool MMMgr_registerMovementCB(MM_CBFN_t cb) {
+    _ctx.moveCB = cb;
+    return true;
+}
+void MMMgr_stop() {
+}
+bool MMMgr_check() {
+    updateMovement();
+    return true;
+}
+bool MMMgr_hasMovedSince(uint32_t t) {
+    return (sim_world_lastMovedSecs() > t);
+}
+uint32_t MMMgr_getLastMovedTime() {
+    return sim_world_lastMovedSecs();
+}
+uint32_t MMMgr_getLastFallTime() {
+    return 0;
+}
+uint32_t MMMgr_getLastShockTime() {
+    return 0;
+}
+uint32_t MMMgr_getLastOrientTime() {
+    return 0;
+}
+uint8_t MMMgr_getOrientation() {
+    return 0;
+}
+void MMMgr_getXYZ(int8_t* x, int8_t* y, int8_t* z) {
+    *x = 0;
+    *y = 0;
+    *z = 64;
+}
+
+// sensormgr : stable environment, temperature drifts now and again
+bool SRMgr_start() {
+    return true;
+}
+void SRMgr_stop() {
+}
+bool SRMgr_registerButtonCB(int8_t io, SR_BUTTON_CB_FN_t cb, void* ctx) {
+    return true;
+}
+uint32_t SRMgr_getLastButtonPressTS(int8_t io) {
+    return 0;
+}
+uint32_t SRMgr_getLastButtonReleaseTS(int8_t io) {
+    return 0;
+}
+SR_BUTTON_STATE_t SRMgr_getButton(int8_t io) {
+    return SR_BUTTON_RELEASED;
+}
+SR_BUTTON_PRESS_TYPE_t SRMgr_getLastButtonPressType(int8_t io) {
+    return SR_BUTTON_SHORT;
+}
+void SRMgr_updateButton(int8_t io) {
+}
+uint8_t SRMgr_getLight() {
+    return 10;
+}
+bool SRMgr_hasLightChanged() {
+    return false;
+}
+void SRMgr_updateLight() {
+}
+uint16_t SRMgr_getBatterymV() {
+    return 3600;
+}
+bool SRMgr_hasBattChanged() {
+    return false;
+}
+void SRMgr_updateBatt() {
+}
+int16_t SRMgr_getTempcC() {
+    return 2150;
+}
+bool SRMgr_hasTempChanged() {
+    return sim_chance(10);
+}
+void SRMgr_updateTemp() {
+}
+int32_t SRMgr_getPressurePa() {
+    return 101325;
+}
+bool SRMgr_hasPressureChanged() {
+    return false;
+}
+void SRMgr_updatePressure() {
+}
+uint8_t SRMgr_getRelHumidity() {
+    return 45;
+}
+bool SRMgr_hasRelHumidityChanged() {
+    return false;
+}
+void SRMgr_updateRelHumidity() {
+}
+uint16_t SRMgr_getADC1mV() {
+    return 0;
+}
+bool SRMgr_hasADC1Changed() {
+    return false;
+}
+void SRMgr_updateADC1() {
+}
+uint16_t SRMgr_getADC2mV() {
+    return 0;
+}
+bool SRMgr_hasADC2Changed() {
+    return false;
+}
+void SRMgr_updateADC2() {
+}
+uint32_t SRMgr_getLastNoiseTimeSecs() {
+    return 0;
+}
+uint8_t SRMgr_getNoiseFreqkHz() {
+    return 0;
+}
+uint8_t SRMgr_getNoiseLeveldB() {
+    return 0;
+}
+
+// gpsmgr : comm ok after 1s, then if the sky is visible a fix every second after the time to first fix
+static void gps_ev(void* arg, int e, void* data) {
+    if (!_ctx.gpsOn || _ctx.gpsCB==NULL) {
+        return;
+    }
+    switch(e) {
+        case EV_GPS_COMM: {
+            (*_ctx.gpsCB)(GPS_COMM_OK);
+            if (sim_chance(sim_world.gpsFixPct)) {
+                bool warm = (_ctx.gpsLastFixSecs>0 && (sim_now()/1000 - _ctx.gpsLastFixSecs) < GPS_WARM_VALID_SECS);
+                _ctx.gpsFix.prec = 500;
+                sim_post((warm ? GPS_WARM_TTFF_SECS : GPS_COLD_TTFF_SECS)*1000, gps_ev, &_ctx, EV_GPS_FIX, NULL);
+            }
+            break;
+        }
+        case EV_GPS_FIX: {
+            _ctx.gpsFix.lat = 45190000 + sim_rand(1000);
+            _ctx.gpsFix.lon = 5720000 + sim_rand(1000);
+            _ctx.gpsFix.alt = 212;
+            _ctx.gpsFix.prec = (_ctx.gpsFix.prec > 100 ? _ctx.gpsFix.prec - 100 : 50);
+            _ctx.gpsFix.nSats = 7;
+            _ctx.gpsFix.rxAt = (uint32_t)(sim_now()/1000);
+            _ctx.gpsLastFixSecs = _ctx.gpsFix.rxAt;
+            (*_ctx.gpsCB)(GPS_NEWFIX);
+            sim_post(1000, gps_ev, &_ctx, EV_GPS_FIX, NULL);
+            break;
+        }
+        default:
+            break;
+    }
+}
+void gps_mgr_init(const char* dname, uint32_t baudrate, int8_t pwrPin, int8_t uartSelect) {
+}
+bool gps_start(GPS_CB_FN_t cb, uint32_t tsecs) {
+    _ctx.gpsCB = cb;
+    _ctx.gpsOn = true;
+    sim_post(1000, gps_ev, &_ctx, EV_GPS_COMM, NULL);
+    return true;
+}
+void gps_stop() {
+    _ctx.gpsOn = false;
+    sim_cancel(gps_ev, &_ctx);
+}
+bool gps_getData(gps_data_t* d) {
+    if (_ctx.gpsFix.rxAt==0) {
+        return false;
+    }
+    *d = _ctx.gpsFix;
+    return true;
+}
+int32_t gps_lastGPSFixAgeMins() {
+    return (_ctx.gpsLastFixSecs>0 ? (int32_t)((sim_now()/1000 - _ctx.gpsLastFixSecs)/60) : -1);
+}
+uint32_t gps_lastGPSFixTimeSecs() {
+    return _ctx.gpsLastFixSecs;
+}
+void gps_setPowerMode(uint8_t m) {
+}
+
+// wblemgr : single shared BLE module. Scan results are written into the caller's list as on target.
+static void ble_scan_rx() {
+    uint32_t now = (uint32_t)(sim_now()/1000);
+    for(int b=0;b<_ctx.nBeacons;b++) {
+        if (!_ctx.beacons[b].present || _ctx.beacons[b].major < _ctx.scanMajStart || _ctx.beacons[b].major > _ctx.scanMajEnd
+                || !sim_chance(BLE_SEEN_PCT)) {
+            continue;
+        }
+        int idx = -1;
+        for(uint32_t i=0;i<_ctx.scanListSz;i++) {
+            if (_ctx.scanList[i].lastSeenAt!=0 && _ctx.scanList[i].major==_ctx.beacons[b].major && _ctx.scanList[i].minor==_ctx.beacons[b].minor) {
+                idx = i;
+                break;
+            }
+        }
+        if (idx<0) {
+            for(uint32_t i=0;i<_ctx.scanListSz;i++) {
+                if (_ctx.scanList[i].lastSeenAt==0) {
+                    idx = i;
+                    memset(&_ctx.scanList[i], 0, sizeof(ibeacon_data_t));
+                    _ctx.scanList[i].major = _ctx.beacons[b].major;
+                    _ctx.scanList[i].minor = _ctx.beacons[b].minor;
+                    _ctx.scanList[i].firstSeenAt = now;
+                    _ctx.scanList[i].new = true;
+                    break;
+                }
+            }
+        }
+        if (idx>=0) {
+            _ctx.scanList[idx].rssi = -50 - (int8_t)sim_rand(45);
+            _ctx.scanList[idx].lastSeenAt = now;
+            if (_ctx.bleCB!=NULL) {
+                (*_ctx.bleCB)(WBLE_SCAN_RX_IB, &_ctx.scanList[idx]);
+            }
+        }
+    }
+}
+static void ble_ev(void* arg, int e, void* data) {
+    if (!_ctx.bleOn || _ctx.bleCB==NULL) {
+        return;
+    }
+    switch(e) {
+        case EV_BLE_COMM: {
+            (*_ctx.bleCB)(WBLE_COMM_OK, NULL);
+            break;
+        }
+        case EV_BLE_SCAN: {
+            ble_scan_rx();
+            sim_post(BLE_SCAN_PERIOD_MS, ble_ev, &_ctx, EV_BLE_SCAN, NULL);
+            break;
+        }
+        default:
+            break;
+    }
+}
+void* wble_mgr_init(const char* dname, uint32_t baudrate, int8_t pwrPin, int8_t uartPin, int8_t uartSelect) {
+    return &_ctx;
+}
+void wble_start(void* ctx, WBLE_CB_FN_t cb) {
+    _ctx.bleCB = cb;
+    _ctx.bleOn = true;
+    // Tags come and go between scan sessions
+    for(int b=0;b<_ctx.nBeacons;b++) {
+        if (_ctx.beacons[b].major!=0x0001 && sim_chance(BLE_TAG_CHANGE_PCT)) {
+            _ctx.beacons[b].present = !_ctx.beacons[b].present;
+        }
+    }
+    sim_post(500, ble_ev, &_ctx, EV_BLE_COMM, NULL);
+}
+void wble_stop(void* ctx) {
+    _ctx.bleOn = false;
+    sim_cancel(ble_ev, &_ctx);
+}
+void wble_scan_start(void* ctx, const uint8_t* uuid, uint16_t majorStart, uint16_t majorEnd, uint32_t sz, ibeacon_data_t* list) {
+    _ctx.scanMajStart = majorStart;
+    _ctx.scanMajEnd = majorEnd;
+    _ctx.scanListSz = sz;
+    _ctx.scanList = list;
+    sim_post(BLE_SCAN_PERIOD_MS, ble_ev, &_ctx, EV_BLE_SCAN, NULL);
+}
+void wble_scan_stop(void* ctx) {
+    sim_cancel(ble_ev, &_ctx);
+}
+void wble_ibeacon_start(void* ctx, uint8_t* uuid, uint16_t maj, uint16_t min, uint8_t extra, uint32_t interMS, int8_t txpower) {
+}
+int wble_getNbIBActive(void* ctx, uint32_t activeInLastX) {
+    int n = 0;
+    uint32_t now = (uint32_t)(sim_now()/1000);
+    for(uint32_t i=0;i<_ctx.scanListSz && _ctx.scanList!=NULL;i++) {
+        if (_ctx.scanList[i].lastSeenAt!=0 && (activeInLastX==0 || (now - _ctx.scanList[i].lastSeenAt) < activeInLastX)) {
+            n++;
+        }
+    }
+    return n;
+}
+int wble_getSortedIBList(void* ctx, int sz, ibeacon_data_t* list) {
+    // Best rssi first, simple selection as lists are small
+    int n = 0;
+    for(uint32_t i=0;i<_ctx.scanListSz && _ctx.scanList!=NULL;i++) {
+        if (_ctx.scanList[i].lastSeenAt==0) {
+            continue;
+        }
+        int pos = n;
+        while (pos>0 && list[pos-1].rssi < _ctx.scanList[i].rssi) {
+            if (pos<sz) {
+                list[pos] = list[pos-1];
+            }
+            pos--;
+        }
+        if (pos<sz) {
+            list[pos] = _ctx.scanList[i];
+            if (n<sz) {
+                n++;
+            }
+        }
+    }
+    return n;
+}
+void wble_resetList(void* ctx, uint32_t timeoutsecs) {
+    uint32_t now = (uint32_t)(sim_now()/1000);
+    for(uint32_t i=0;i<_ctx.scanListSz && _ctx.scanList!=NULL;i++) {
+        if (_ctx.scanList[i].lastSeenAt!=0 && (now - _ctx.scanList[i].lastSeenAt) > timeoutsecs) {
+            _ctx.scanList[i].lastSeenAt = 0;
+        }
+    }
+}
+void wble_line_open(void* ctx) {
+}
+void wble_line_close(void* ctx) {
+}
+int wble_line_write(void* ctx, uint8_t* data, uint32_t sz) {
+    return sz;
+}
+
+// ledmgr, rebootmgr, bsp, uarts and console : nothing to simulate
+bool ledStart(int8_t gpio, const char* pattern, int32_t dur) {
+    return true;
+}
+bool ledRequest(int8_t gpio, const char* pattern, int32_t dur, LED_REQ_t type) {
+    return true;
+}
+void ledCancel(int8_t gpio) {
+}
+void RMMgr_reboot(RM_REASON_t reason) {
+    log_warn("SIM:reboot requested reason %d", reason);
+    sim_stop(reason==RM_ENTER_STOCK_MODE ? "reboot into stock mode" : "reboot");
+}
+uint16_t RMMgr_getResetReasonCode() {
+    return sim_world.resetReason;
+}
+void RMMgr_getResetReasonBuffer(uint8_t* buf, uint8_t len) {
+    // most recent first : only this boot's is known
+    memset(buf, 0, len);
+    if (len>0) {
+        buf[0] = (uint8_t)sim_world.resetReason;
+    }
+}
+void* RMMgr_getLastAssertCallerFn() {
+    return NULL;
+}
+void* RMMgr_getLogFn(uint8_t idx) {
+    return NULL;
+}
+uint8_t BSP_getHwVer() {
+    return _ctx.hwVer;
+}
+void BSP_setHwVer(uint8_t v) {
+    _ctx.hwVer = v;
+}
+int hal_gpio_init_out(int pin, int val) {
+    return 0;
+}
+void hal_gpio_write(int pin, int val) {
+}
+int hal_gpio_read(int pin) {
+    return 0;
+}
+bool uart_line_comm_create(const char* dname, uint32_t baudrate) {
+    return true;
+}
+void uart_select(int8_t id) {
+}
+bool wconsole_mgr_init(const char* dname, uint32_t baudrate, int8_t uartSelect) {
+    return (dname!=NULL);
+}
+bool wconsole_start(uint8_t nCmds, ATCMD_DEF_t* cmds, uint32_t idleTimeoutS) {
+    return sim_world.consoleWired;
+}
+void wconsole_stop() {
+}
+bool wconsole_isInit() {
+    return sim_world.consoleWired;
+}
+bool wconsole_isActive() {
+    return false;
+}
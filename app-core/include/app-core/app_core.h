@@ -28,8 +28,10 @@ typedef uint32_t (*APP_MOD_START_FN_t)();       // returns time required for its
 typedef void (*APP_MOD_STOP_FN_t)();
 typedef void (*APP_MOD_OFF_FN_t)();
 typedef void (*APP_MOD_DEEPSLEEP_FN_t)();
-typedef bool (*APP_MOD_GETULDATA_FN_t)(APP_CORE_UL_t* ul);      // returns true if UL is 'critical',  false if not
-typedef void (*APP_MOD_TIC_FN_t)();            // Callback for the tic registration 
+typedef bool (*APP_MOD_GETULDATA_FN_t)(APP_CORE_UL_t* ul);      // returns true if UL is 'critical',  false if not (it may then give its data a value, see app_core_msg_ul_addValue())
+typedef uint32_t (*APP_MOD_TIC_FN_t)();        // Called during idle : returns secs until it wants its next tic (0=no more tics this idle period)
+typedef uint16_t (*APP_MOD_GETULNEED_FN_t)(uint8_t* prio);     // returns bytes (TLVs with their TL) it would like in the UL, and sets its priority
+typedef void (*APP_MOD_ULSENT_FN_t)();         // all the ULs of the round it gave its data to were txd ok
 typedef struct {
     APP_MOD_START_FN_t startCB;
     APP_MOD_STOP_FN_t stopCB;
@@ -37,7 +39,16 @@ typedef struct {
     APP_MOD_DEEPSLEEP_FN_t deepsleepCB;     // may be null if has no sleeping actions to do
     APP_MOD_GETULDATA_FN_t getULDataCB;
     APP_MOD_TIC_FN_t ticCB;                 // may be NULL if no ops to do
+    APP_MOD_GETULNEED_FN_t getULNeedCB;     // may be NULL : it then wants what it can get, at normal priority.
+                                            // It is asked at the start of the data collection, and again just before its data is got
+                                            // (serial : when it is done, before its stop, parallel : at the end of the data collection),
+                                            // within the space allotted to it from what all the modules asked for
+    APP_MOD_ULSENT_FN_t ulSentCB;           // may be NULL : for modules that value their data against what the backend last got
 } APP_CORE_API_t;
+// UL space priorities for getULNeedCB : higher ones get their space first, the same ones share it evenly
+#define APP_MOD_UL_PRIO_LOW (0)
+#define APP_MOD_UL_PRIO_NORMAL (1)
+#define APP_MOD_UL_PRIO_HIGH (2)
 // Info about this build
 #define MAXFWNAME 39
 #define MAXFWDATE 23
@@ -50,16 +61,32 @@ typedef struct {
     uint32_t loraregion;         // as this is a build option
 } APP_CORE_FW_t;
 
-// Add module ids here (before the APP_MOD_LAST enum). Note that changing APP_MOD_LAST to indcrease number of module ids is ok,
+// Add module ids here (before the APP_MOD_NB enum). Note that changing APP_MOD_LAST to indcrease number of module ids is ok,
 // but will impact upgrade on a device that had previous lower value (as changes the mod mask size in config)
+// App-core's module table has a slot per id (up to APP_MOD_NB), so any combination of modules can be built in (one module per id).
 typedef enum { APP_MOD_ENV=0, APP_MOD_GPS=1, 
             APP_MOD_BLE_SCAN_NAV=2, APP_MOD_BLE_SCAN_TAGS=3, APP_MOD_BLE_IB=4, 
             APP_MOD_IO=5, APP_MOD_PTI=6, APP_MOD_BLE_CONSOLE=7, APP_MOD_BLE_SCANA_TAGS=8, APP_MOD_BLE_SCAN_ALERT=9,
+            APP_MOD_BLE_SCAN_PROX=10, APP_MOD_PRODTEST=11,
+            APP_MOD_NB,
             APP_MOD_LAST=31 } APP_MOD_ID_t;
 // Should module be run in parallel with others, or must it be alone (eg coz using a shared resource like a bus)?
 typedef enum { EXEC_PARALLEL, EXEC_SERIAL } APP_MOD_EXEC_t;
+// Hardware resources a serial module uses between its start() and stop(). Serial modules whose resources do not conflict
+// (same uart device, same i2c bus or same power rail) are run at the same time. A serial module that does not declare
+// its resources is always run alone.
+typedef struct {
+    const char* uartDev;        // uart device name or NULL if none (the uart selector only switches 1 uart so any 2 users of a uart conflict)
+    int8_t uartSelect;          // uart selector value used on uartDev, -1 if none
+    int8_t i2cBus;              // i2c bus number, -1 if none
+    int8_t pwrIO;               // gpio of the power rail the module switches, -1 if none
+} APP_MOD_RESOURCES_t;
 // core api for modules
 void AppCore_registerModule(const char * name, APP_MOD_ID_t id, APP_CORE_API_t* mcbs, APP_MOD_EXEC_t execType);
+// Declare the resources a registered serial module uses. res must point to a static structure
+void AppCore_registerModuleResources(APP_MOD_ID_t id, APP_MOD_RESOURCES_t* res);
+// Get a module's declared resources or NULL if none
+APP_MOD_RESOURCES_t* AppCore_getModuleResources(APP_MOD_ID_t mid);
 // Get a module's name
 const char* AppCore_getModuleName(APP_MOD_ID_t mid);
 // is module active?
@@ -68,6 +95,8 @@ bool AppCore_getModuleState(APP_MOD_ID_t mid);
 void AppCore_setModuleState(APP_MOD_ID_t mid, bool active);
 // Timestamp (relative to boot) of last UL (attempted)
 uint32_t AppCore_lastULTime();
+// Time in ms from boot to the first UL that went out ok (0 if none yet)
+uint32_t AppCore_getBootToFirstULMS();
 // Time in ms to next UL in theory
 uint32_t AppCore_getTimeToNextUL();
 // Get UL message to add TLVs to it (outside of getData() callbacks)
@@ -80,6 +109,9 @@ void AppCore_module_done(APP_MOD_ID_t id);
 void AppCore_setDeviceState(bool active);
 // get the current state
 bool AppCore_isDeviceActive();
+// Are the event TLVs (button, enter/exit, contacts) app acked by the backend, and resent by app-core until they are?
+// If so a module need not repeat them itself.
+bool AppCore_isAppAckOn();
 // Enable or not use of led feedback about the active/inactive state of the device
 void AppCore_setStateLeds(bool enabled);
 // Register a DL action handler
@@ -88,6 +120,31 @@ void AppCore_registerAction(uint8_t id, ACTIONFN_t cb);
 ACTIONFN_t AppCore_findAction(uint8_t id);
 // Get info about this build
 APP_CORE_FW_t* AppCore_getFwInfo();
+// Set a config value via the write-back cache : not written if unchanged, else written with any others at the next commit (done 
+// before each sleep and reboot). Use for values that may be set often or several at a time.
+bool AppCore_setConfig(uint16_t key, void* data, uint8_t len);
+// Get a config value, taking into account any not yet committed write. Returns its length or -1 if no such key
+int AppCore_getConfig(uint16_t key, void* data, uint8_t maxlen);
+// Write any pending config values now
+void AppCore_commitConfig();
+// Config change subscription : cb is called only for changes to the keys firstKey to lastKey (inclusive). Modules should read their 
+// config once at init and update their copy of a value in their cb, rather than re-reading it all in each start().
+typedef void (*APP_CORE_CFG_CBFN_t)(void* ctx, uint16_t key);
+void AppCore_subscribeConfig(uint16_t firstKey, uint16_t lastKey, APP_CORE_CFG_CBFN_t cb, void* ctx);
+// Residency of the core state machine states since boot (or last reset)
+typedef struct {
+    uint64_t totalMS;       // total time spent in state
+    uint32_t nEntries;      // number of times state was entered
+    uint32_t maxDwellMS;    // longest single stay in state
+} APP_CORE_STATE_STATS_t;
+// Number of states in the core state machine
+uint8_t AppCore_getNbStates();
+// Get a state's name
+const char* AppCore_getStateName(uint8_t sid);
+// Get residency stats of a state (including the current stay if it is the active state). Returns false if bad state id
+bool AppCore_getStateStats(uint8_t sid, APP_CORE_STATE_STATS_t* st);
+// Reset all state residency stats
+void AppCore_resetStateStats();
 
 // app core TLV tags for UL : 1 byte sized, explicit values assigned, never change already allocated values!
 typedef enum { APP_CORE_UL_VERSION=0, APP_CORE_UL_UPTIME=1, APP_CORE_UL_CONFIG=2,
@@ -101,17 +158,21 @@ typedef enum { APP_CORE_UL_VERSION=0, APP_CORE_UL_UPTIME=1, APP_CORE_UL_CONFIG=2
     APP_CORE_UL_BLE_ERRORMASK=23, APP_CORE_UL_ENV_LASTLOGCALLER=24, APP_CORE_UL_BLE_PRESENCE=25,
     APP_CORE_UL_APP_ACK_REQ=26, 
     APP_CORE_UL_BLE_PROX_ENTER=27, APP_CORE_UL_BLE_PROX_EXIT=28,
-    // Add new generic tags in here...
+    APP_CORE_UL_SM_STATS=29, APP_CORE_UL_BACKLOG_AGE=30, APP_CORE_UL_DELTA=31,
+    APP_CORE_UL_BLE_CURR_LIST=32, APP_CORE_UL_BLE_ENTER_LIST=33, APP_CORE_UL_BLE_EXIT_LIST=34,
+    APP_CORE_UL_BOOT_TO_UL=35,
+    // Add new generic tags in here... (up to 223)
+    APP_CORE_UL_COMPACT_START=224,      // 224-239 : codes of the compact UL encoding (see app_msg.c), do not allocate as tags
     APP_CORE_UL_APP_SPECIFIC_START=240,  // from this point on, not interpreted by generic backends
 } APP_CORE_UL_TAGS;
 // app core TLV tags for DL : 1 byte sized, never change already allocated values! Note some are historic values see WyresDeviceActions.java
-// App core has handlers for up to GET_MODS
-// ensure that the following define is > number of actions or you will get assert() at bootup if all the actions get claimed
-#define MAX_DL_ACTIONS  (12)
+// Action handlers are held in a table indexed by tag (so found directly) : generic tags must be < APP_CORE_DL_GENERIC_MAX, and app
+// specific ones are from APP_CORE_DL_APP_SPECIFIC_START
+#define APP_CORE_DL_GENERIC_MAX (32)
 typedef enum { APP_CORE_DL_REBOOT=1, APP_CORE_DL_SET_CONFIG=2, APP_CORE_DL_GET_CONFIG=3, 
     APP_CORE_DL_FLASH_LED1=5, APP_CORE_DL_FLASH_LED2=6,        
     APP_CORE_DL_SET_UTCTIME=24, APP_CORE_DL_FOTA=25, APP_CORE_DL_GET_MODS=26, APP_CORE_DL_FIX_GPS=11,
-    APP_CORE_DL_GET_DEBUG=27, APP_CORE_DL_APP_ACK=28,
+    APP_CORE_DL_GET_DEBUG=27, APP_CORE_DL_APP_ACK=28, APP_CORE_DL_UL_RESYNC=29,
     // Add new generic tags in here...
     APP_CORE_DL_APP_SPECIFIC_START=240,
 } APP_CORE_DL_TAGS;
@@ -131,10 +192,20 @@ typedef enum { APP_CORE_DL_REBOOT=1, APP_CORE_DL_SET_CONFIG=2, APP_CORE_DL_GET_C
 #define CFG_UTIL_KEY_FIRMWARE_INFO              CFGKEY(CFG_MODULE_APP_CORE, 11)
 #define CFG_UTIL_KEY_HW_BASE_REV                CFGKEY(CFG_MODULE_APP_CORE, 12)
 #define CFG_UTIL_KEY_RETRY_JOIN_TIME_SECS       CFGKEY(CFG_MODULE_APP_CORE, 13)
-#define CFG_UTIL_KEY_MAX_RAPID_JOIN_ATTEMPTS    CFGKEY(CFG_MODULE_APP_CORE, 14)
+#define CFG_UTIL_KEY_JOIN_TRIES_PER_SF          CFGKEY(CFG_MODULE_APP_CORE, 14)
 #define CFG_UTIL_KEY_DEVICE_ACTIVE              CFGKEY(CFG_MODULE_APP_CORE, 15)
 #define CFG_UTIL_KEY_IDLE_TIME_INACTIVE_MINS    CFGKEY(CFG_MODULE_APP_CORE, 16)
 #define CFG_UTIL_KEY_ENABLE_DEVICE_STATE_LEDS    CFGKEY(CFG_MODULE_APP_CORE, 17)
+#define CFG_UTIL_KEY_SM_STATS_UL_HOURS          CFGKEY(CFG_MODULE_APP_CORE, 18)
+// UL backlog slots : 1 key per slot, keys 19 to 26 are reserved for them (APP_CORE_UL_BACKLOG_MAX)
+#define CFG_UTIL_KEY_UL_BACKLOG_SLOT0           CFGKEY(CFG_MODULE_APP_CORE, 19)
+#define CFG_UTIL_KEY_UL_MAX_ROUND_BYTES         CFGKEY(CFG_MODULE_APP_CORE, 27)
+#define CFG_UTIL_KEY_UL_COMPACT                 CFGKEY(CFG_MODULE_APP_CORE, 28)
+#define CFG_UTIL_KEY_UL_DELTA_RESYNC            CFGKEY(CFG_MODULE_APP_CORE, 29)
+#define CFG_UTIL_KEY_UL_APP_ACK                 CFGKEY(CFG_MODULE_APP_CORE, 30)
+#define CFG_UTIL_KEY_JOIN_DAY_AIRTIME_MS        CFGKEY(CFG_MODULE_APP_CORE, 31)
+#define CFG_UTIL_KEY_LINK_MARGIN_DB             CFGKEY(CFG_MODULE_APP_CORE, 32)
+#define CFG_UTIL_KEY_UL_VALUE_MIN               CFGKEY(CFG_MODULE_APP_CORE, 33)
 
 // LOra config is in app level for app-core
 #define CFG_UTIL_KEY_LORA_DEVEUI CFGKEY(CFG_MODULE_LORA, 1)
@@ -178,6 +249,7 @@ typedef enum { APP_CORE_DL_REBOOT=1, APP_CORE_DL_SET_CONFIG=2, APP_CORE_DL_GET_C
 #define CFG_UTIL_KEY_BLE_PROX_STIME_MINS        CFGKEY(CFG_MODULE_APP_MOD, 40)
 #define CFG_UTIL_KEY_BLE_PROX_SRSSI             CFGKEY(CFG_MODULE_APP_MOD, 41)
 #define CFG_UTIL_KEY_BLE_PROX_UL_REPS           CFGKEY(CFG_MODULE_APP_MOD, 42)
+#define CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS       CFGKEY(CFG_MODULE_APP_MOD, 43)
 
 #ifdef __cplusplus
 }
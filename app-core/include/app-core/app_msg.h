@@ -20,25 +20,38 @@ extern "C" {
 #endif
 
 // message definitions for uplink and downlink
-#define APP_CORE_UL_MAX_SZ (50)     // so always fits
-#define APP_CORE_UL_MAX_NB (4)     // up to 4 UL messages per round to get 200 bytes
+#define APP_CORE_UL_MAX_SZ (50)     // size of a block, so always fits
+#define APP_CORE_UL_MAX_NB (8)     // up to 8 blocks per round (the total is also limited by the configured max bytes per round)
+#define APP_CORE_UL_MAX_TX_SZ (222)     // biggest UL (EU868 SF7/SF8) : consecutive blocks are merged into 1 UL up to the max payload of the data rate
 #define APP_CORE_DL_MAX_SZ (250)    // as we don't control it
 #define LORAWAN_UL_PORT 3
 #define LORAWAN_DL_PORT 3
+// LoRaWAN MAC overhead on an UL data frame : MHDR(1) + FHDR(7) + FPort(1) + MIC(4)
+#define LORAWAN_UL_OVERHEAD (13)
 #define APP_CORE_MSGS_VERSION_UL (1)        // our first usable version is v1
+#define APP_CORE_MSGS_VERSION_UL_COMPACT (2)        // v1 TLVs, some of which may be in their compact encoding (see app_msg.c)
 #define APP_CORE_MSGS_VERSION_DL (0)
+#define APP_CORE_UL_BACKLOG_MAX (8)     // max slots in the UL backlog (as config keys are reserved for this many)
+#define APP_CORE_UL_NO_QUOTA (0xFFFF)     // no limit on the space a module can use (see app_core_msg_ul_setQuota())
 
 // UL Message : 1st 2 bytes are header, then TLV blocks (1 byte T, 1byte L, n bytes V)
 // 2 byte fixed header: 
 //	0 : b0-3: UL respid, b4-5: protocol version, b6: 1=listening for DL, 0=not listening, b7: force even parity for this byte
 //	1 : length of following TLV block
+// Data is added in blocks of APP_CORE_UL_MAX_SZ, and each UL txd is made of 1 or more consecutive blocks (TLVs concatenated after 1 header)
 typedef struct {
     struct {
         uint8_t payload[APP_CORE_UL_MAX_SZ];
         uint8_t sz;
+        bool newTx;         // this block starts a new UL (set by pack), else it can be merged with the previous one
     } msgs[APP_CORE_UL_MAX_NB];
     uint8_t msgNbFilling;
-    int8_t msbNbTxing;      // Starts at -1 to indicate not yet in tx phase
+    int8_t msbNbTxing;      // Starts at -1 to indicate not yet in tx phase. Last block of the UL being txd
+    int8_t txFirst;         // first block of the UL being txd
+    uint16_t maxRoundSz;    // max bytes of TLV data in all the blocks
+    uint16_t quotaEnd;      // no data added beyond this many bytes in all the blocks (APP_CORE_UL_NO_QUOTA if no quota)
+    uint16_t value;         // sum of the values the modules gave their data this round (see app_core_msg_ul_addValue())
+    uint8_t txbuf[APP_CORE_UL_MAX_TX_SZ];
 } APP_CORE_UL_t;
 
 // First 2 bytes are header, then 'actions'
@@ -49,16 +62,30 @@ typedef struct {
     uint8_t dlId;
     uint8_t nbActions;
     uint8_t sz;     // in bytes of message
+    int16_t rssi;   // reception of the DL (dBm, dB)
+    int8_t snr;
 } APP_CORE_DL_t;
 
 typedef void (*ACTIONFN_t)(uint8_t* v, uint8_t l);
-typedef struct {
-    uint8_t id;
-    ACTIONFN_t fn;
-} ACTION_t;
 
 void app_core_msg_ul_init(APP_CORE_UL_t* msg);
+/*
+ * Limit the total bytes of data this UL can hold (default is all the blocks)
+ */
+void app_core_msg_ul_setMaxRoundSz(APP_CORE_UL_t* ul, uint16_t maxSz);
+/*
+ * Limit the data that can be added from now on to quota bytes (APP_CORE_UL_NO_QUOTA to remove the limit)
+ */
+void app_core_msg_ul_setQuota(APP_CORE_UL_t* ul, uint16_t quota);
 bool app_core_msg_ul_addTLV(APP_CORE_UL_t* msg, uint8_t t, uint8_t l, void* v);
+/*
+ * Add to the value of the UL (0 to APP_CORE_UL_VALUE_CRIT) : called by a module's getULDataCB to say how much the data
+ * it added is worth sending. The UL is sent if the total reaches the threshold for the SF it would go at (see
+ * CFG_UTIL_KEY_UL_VALUE_MIN), or if a getULDataCB returned true (ie critical).
+ */
+#define APP_CORE_UL_VALUE_CRIT (100)      // worth an UL on its own, whatever the SF
+void app_core_msg_ul_addValue(APP_CORE_UL_t* ul, uint8_t v);
+uint16_t app_core_msg_ul_getValue(APP_CORE_UL_t* ul);
 uint8_t* app_core_msg_ul_addTLgetVP(APP_CORE_UL_t* ul, uint8_t t, uint8_t l) ;
 /*
  * get the max continugous data block we know how to send in UL
@@ -83,15 +110,108 @@ uint8_t app_core_msg_ul_getTotalSpaceAvailable(APP_CORE_UL_t* ul);
  * Step back 1 in current tx set to allow next finalise call to resend it 
  */
 void app_core_msg_ul_retry(APP_CORE_UL_t* ul);
+/*
+ * Is there another message in this UL to tx?
+ */
+bool app_core_msg_ul_hasNextTx(APP_CORE_UL_t* ul);
+/*
+ * Use the compact encoding of the TLVs that have one, in the ULs finalised from now on
+ */
+void app_core_msg_ul_setCompact(bool on);
+/*
+ * Delta mode : a TLV whose value is the same as when it was last sent (in a round whose ULs all went) is not sent again, 
+ * its tag is set in the APP_CORE_UL_DELTA TLV instead. Every resyncRounds rounds all the TLVs are sent in full. 0=delta mode off
+ */
+void app_core_msg_ul_setDelta(uint8_t resyncRounds);
+/*
+ * Send all the TLVs in full in the next round (eg the backend asked for it)
+ */
+void app_core_msg_ul_delta_resync();
+/*
+ * Once all the data is added (before pack), remove the TLVs that are unchanged and add the APP_CORE_UL_DELTA TLV
+ * <returns>Returns true if TLVs were removed</returns>
+ */
+bool app_core_msg_ul_delta(APP_CORE_UL_t* ul);
+/*
+ * Time on air of a LoRa frame of phySz bytes at this SF, in 1/4 symbols (as the preamble is 12.25 symbols)
+ */
+uint32_t app_core_msg_loraQSymbols(uint8_t sf, uint8_t phySz);
+/*
+ * Once all the data is added, repack the TLVs into the ULs to tx so as to minimise their number and total time on air
+ * at this SF, for ULs of up to maxTxSz bytes. The layout is only changed if it is better.
+ * <returns>Returns true if the TLVs were repacked</returns>
+ */
+bool app_core_msg_ul_pack(APP_CORE_UL_t* ul, uint8_t maxTxSz, uint8_t sf);
 /* 
- * finalise next UL tx message (header etc) ready for tx
+ * finalise next UL tx message (header etc) ready for tx, merging as many blocks as fit in maxTxSz (the max payload of the current data rate)
+ * <returns>Returns size of the UL, 0 if nothing left to tx</returns>
  */
-uint8_t app_core_msg_ul_prepareNextTx(APP_CORE_UL_t* msg, uint8_t lastDLId, bool willListen);
+uint8_t app_core_msg_ul_prepareNextTx(APP_CORE_UL_t* msg, uint8_t lastDLId, bool willListen, uint8_t maxTxSz);
 /*
  * Get pointer to payload for current 'to tx' message
  */
 uint8_t* app_core_msg_ul_getTxPayload(APP_CORE_UL_t* ul);
 
+/*
+ * UL backlog : messages that could not be sent are kept in PROM so they survive failed txs, loss of the join and reboots.
+ * They are sent oldest first when there is a tx opportunity.
+ * Init loads the backlog saved before the reboot.
+ */
+void app_core_msg_ul_backlog_init();
+/*
+ * Keep the current 'to tx' message of this UL in the backlog, 1 slot per block (the oldest one is dropped if the backlog is full).
+ * A block with the delta mask is kept without it, followed by the TLVs the mask stood for
+ */
+bool app_core_msg_ul_backlog_push(APP_CORE_UL_t* ul);
+/*
+ * Number of messages in the backlog
+ */
+uint8_t app_core_msg_ul_backlog_count();
+/*
+ * finalise the oldest backlog message for tx (header and its age if space) and return its size, 0 if backlog is empty
+ */
+uint8_t app_core_msg_ul_backlog_prepareTx(uint8_t lastDLId, bool willListen);
+/*
+ * Get pointer to payload of the backlog message being txd
+ */
+uint8_t* app_core_msg_ul_backlog_getTxPayload();
+/*
+ * Remove the message being txd from the backlog as it was sent ok
+ */
+void app_core_msg_ul_backlog_pop();
+/*
+ * Empty the backlog
+ */
+void app_core_msg_ul_backlog_clear();
+
+/*
+ * App level ack : the event TLVs (button, enter/exit, contacts) of an UL get an APP_CORE_UL_APP_ACK_REQ with a sequence number,
+ * and are kept until the backend acks it (APP_CORE_DL_APP_ACK), being resent alone if it doesn't. Off by default.
+ * An event TLV is only kept if it is at most APP_CORE_UL_APP_ACK_TLV_MAX_SZ (with its TL) : it must fit in a resend with its request.
+ */
+#define APP_CORE_UL_APP_ACK_TLV_MAX_SZ (APP_CORE_UL_MAX_SZ - 2 - 3)
+void app_core_msg_ul_setAppAck(bool on);
+/*
+ * The UL of the round just finalised (not a backlog one) was txd ok. Returns true if it was the last one of the round
+ */
+bool app_core_msg_ul_txOK(APP_CORE_UL_t* ul);
+/*
+ * The UL just finalised (round or backlog one) was txd ok : keep its event TLVs till they're acked
+ */
+void app_core_msg_ul_appAck_txOK();
+/*
+ * The backend acked this sequence number
+ */
+void app_core_msg_ul_appAck_rx(uint8_t seq);
+/*
+ * At each UL round, before deciding if it is sent : the kept TLVs whose ack is overdue are pushed to the backlog to be resent
+ */
+void app_core_msg_ul_appAck_round();
+/*
+ * Number of kept TLV sets waiting for their ack
+ */
+uint8_t app_core_msg_ul_appAck_count();
+
 void app_core_msg_dl_init(APP_CORE_DL_t* msg);
 bool app_core_msg_dl_decode(APP_CORE_DL_t* msg);
 bool app_core_msg_dl_execute(APP_CORE_DL_t* msg);
@@ -0,0 +1,63 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+#ifndef H_APP_PROF_H
+#define H_APP_PROF_H
+
+#include <inttypes.h>
+#include "app-core/app_core.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Execution time profiling of the module callbacks and of the UL/DL codec (syscfg APP_CORE_PROFILE).
+// Counts are cpu cycles on target (DWT cycle counter), ns on a host build.
+// Module callback sites : 1 per module id and callback
+typedef enum { APP_PROF_START, APP_PROF_STOP, APP_PROF_GETULDATA, APP_PROF_TIC, APP_PROF_NB_MODCB } APP_PROF_MODCB_t;
+// Codec sites
+typedef enum { APP_PROF_UL_ADDTLV, APP_PROF_UL_DELTA, APP_PROF_UL_PACK, APP_PROF_UL_PREPARE, APP_PROF_UL_BACKLOG_PREPARE,
+    APP_PROF_DL_DECODE, APP_PROF_DL_EXECUTE, APP_PROF_NB_CODEC } APP_PROF_CODEC_t;
+#define APP_PROF_MOD_SITE(_mid, _cb) ((uint16_t)((_mid) * APP_PROF_NB_MODCB + (_cb)))
+#define APP_PROF_CODEC_SITE(_c) ((uint16_t)(APP_MOD_NB * APP_PROF_NB_MODCB + (_c)))
+#define APP_PROF_NB_SITES (APP_MOD_NB * APP_PROF_NB_MODCB + APP_PROF_NB_CODEC)
+
+typedef struct {
+    uint32_t nCalls;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+} APP_PROF_STATS_t;
+
+#if MYNEWT_VAL(APP_CORE_PROFILE)
+void app_prof_init();
+uint32_t app_prof_now();
+void app_prof_add(uint16_t site, uint32_t start);
+// Wrap a call (or assignment from a call) to count its execution time against the site
+#define APP_PROF(_site, _call) do { uint32_t _pst = app_prof_now(); _call; app_prof_add((_site), _pst); } while(0)
+#else
+#define APP_PROF(_site, _call) do { _call; } while(0)
+#endif
+
+// Get the stats of a site. Returns false if never called (or bad site / profiling not in the build)
+bool app_prof_get(uint16_t site, APP_PROF_STATS_t* st);
+// Name of a site : module name (or "codec") and the callback/function
+void app_prof_siteName(uint16_t site, const char** what, const char** fn);
+// Unit of the counts ("cycles" or "ns")
+const char* app_prof_unit();
+void app_prof_reset();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* H_APP_PROF_H */
@@ -26,6 +26,7 @@
 
 #include "app-core/app_core.h"
 #include "app-core/app_console.h"
+#include "app-core/app_prof.h"
 
 /**
  *  AT Commands for appcore in idle mode
@@ -189,7 +190,8 @@ static ATRESULT atcmd_setcfg(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
                         return ATCMD_BADARG;
                     }
                 }
-                CFMgr_setElement(k, &v, l);
+                AppCore_setConfig(k, &v, l);
+                AppCore_commitConfig();
                 printKey(pfn, k);        // Show the value now in the config 
                 break;
             }
@@ -222,7 +224,8 @@ static ATRESULT atcmd_setcfg(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
                     val[i] = b;
                     vp+=2;
                 }
-                CFMgr_setElement(k, &val[0], l);
+                AppCore_setConfig(k, &val[0], l);
+                AppCore_commitConfig();
                 printKey(pfn, k);
                 break;
             }
@@ -230,6 +233,15 @@ static ATRESULT atcmd_setcfg(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
     }
     return ATCMD_PROCESSED;
 }
+static void printMod(PRINTLN_t pfn, int mid) {
+    APP_MOD_RESOURCES_t* res = AppCore_getModuleResources(mid);
+    if (res!=NULL) {
+        (*pfn)("Module[%d][%s]: %s uart[%s/%d] i2c[%d] pwr[%d]", mid, AppCore_getModuleName(mid), AppCore_getModuleState(mid)?"ON":"OFF",
+            (res->uartDev!=NULL?res->uartDev:"-"), res->uartSelect, res->i2cBus, res->pwrIO);
+    } else {
+        (*pfn)("Module[%d][%s]: %s", mid, AppCore_getModuleName(mid), AppCore_getModuleState(mid)?"ON":"OFF");
+    }
+}
 static ATRESULT atcmd_getmods(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
     // Check args - if an arg present then show just that module else show all
     if (nargs>2) {
@@ -237,7 +249,7 @@ static ATRESULT atcmd_getmods(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
     }
     if (nargs==1) {
         for(int i=0;i<APP_MOD_LAST;i++) {
-            (*pfn)("Module[%d][%s]: %s", i, AppCore_getModuleName(i), AppCore_getModuleState(i)?"ON":"OFF");
+            printMod(pfn, i);
         }
     } else if (nargs==2) {
         int mid = atoi(argv[1]);
@@ -245,7 +257,7 @@ static ATRESULT atcmd_getmods(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
             (*pfn)("Module id [%s] out of range",argv[1]);
             return ATCMD_BADARG;
         } else {
-            (*pfn)("Module[%d][%s]: %s", mid, AppCore_getModuleName(mid), AppCore_getModuleState(mid)?"ON":"OFF");
+            printMod(pfn, mid);
         }
     }
 
@@ -283,6 +295,68 @@ static ATRESULT atcmd_runcycle(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
     return ATCMD_OK;
 }
 
+static ATRESULT atcmd_smstats(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
+    // optional arg RESET to zero the stats
+    if (nargs>1) {
+        if (strcmp(argv[1], "RESET")==0) {
+            AppCore_resetStateStats();
+        } else {
+            (*pfn)("Unknown arg [%s] (only RESET)", argv[1]);
+            return ATCMD_BADARG;
+        }
+    }
+    APP_CORE_STATE_STATS_t st;
+    uint64_t allMS = 0;
+    for(int i=0;i<AppCore_getNbStates();i++) {
+        if (AppCore_getStateStats(i, &st)) {
+            allMS += st.totalMS;
+        }
+    }
+    for(int i=0;i<AppCore_getNbStates();i++) {
+        if (AppCore_getStateStats(i, &st)) {
+            // residency in 1/10 of %
+            uint32_t pm = (allMS>0 ? (uint32_t)((st.totalMS*1000)/allMS) : 0);
+            (*pfn)("State[%d][%s]: %lus (%lu.%lu%%) entries %lu max %lums", i, AppCore_getStateName(i), 
+                (uint32_t)(st.totalMS/1000), pm/10, pm%10, st.nEntries, st.maxDwellMS);
+        }
+    }
+    return ATCMD_PROCESSED;
+}
+static ATRESULT atcmd_prof(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
+    // optional arg RESET to zero the counts
+    if (nargs>1) {
+        if (strcmp(argv[1], "RESET")==0) {
+            app_prof_reset();
+        } else {
+            (*pfn)("Unknown arg [%s] (only RESET)", argv[1]);
+            return ATCMD_BADARG;
+        }
+    }
+    APP_PROF_STATS_t st;
+    const char* what;
+    const char* fn;
+    (*pfn)("Profile in %s:", app_prof_unit());
+    for(int i=0;i<APP_PROF_NB_SITES;i++) {
+        if (app_prof_get(i, &st)) {
+            app_prof_siteName(i, &what, &fn);
+            (*pfn)("[%s][%s]: n %lu min %lu max %lu mean %lu", what, fn, st.nCalls, st.min, st.max, (uint32_t)(st.total/st.nCalls));
+        }
+    }
+    return ATCMD_PROCESSED;
+}
+static ATRESULT atcmd_ulbacklog(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
+    // optional arg CLEAR to throw away the kept ULs
+    if (nargs>1) {
+        if (strcmp(argv[1], "CLEAR")==0) {
+            app_core_msg_ul_backlog_clear();
+        } else {
+            (*pfn)("Unknown arg [%s] (only CLEAR)", argv[1]);
+            return ATCMD_BADARG;
+        }
+    }
+    (*pfn)("UL backlog has %d messages", app_core_msg_ul_backlog_count());
+    return ATCMD_PROCESSED;
+}
 static ATRESULT atcmd_setlogs(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
     if (nargs>1) {
         if (strcmp(argv[1], "DEBUG")==0) {
@@ -325,6 +399,7 @@ static ATRESULT atcmd_info(PRINTLN_t pfn, uint8_t nargs, char* argv[]) {
     (*pfn)("Light:%d", SRMgr_getLight());
     (*pfn)("Logs: %s", get_log_level_str());
     (*pfn)("LastReset: %04x", RMMgr_getResetReasonCode());
+    (*pfn)("BootToUL: %d ms", AppCore_getBootToFirstULMS());
     (*pfn)("LastAssert:[0x%08x]", RMMgr_getLastAssertCallerFn());
     (*pfn)("LastWELog:[0x%08x]", RMMgr_getLogFn(0));
     (*pfn)("TimeNow:[%d]", TMMgr_getTimeSecs());
@@ -559,6 +634,9 @@ static ATCMD_DEF_t ATCMDS[] = {
     { .cmd="AT+SETMODS", .desc="Set module state", atcmd_setmod},
     { .cmd="AT+RUN", .desc="Go for active cycle immediately", atcmd_runcycle},
     { .cmd="AT+LOG", .desc="Set logging level", atcmd_setlogs},
+    { .cmd="AT+SMSTATS", .desc="Show state residency stats", atcmd_smstats},
+    { .cmd="AT+PROF", .desc="Show callback/codec execution times", atcmd_prof},
+    { .cmd="AT+ULBACKLOG", .desc="Show number of ULs kept to send later", atcmd_ulbacklog},
     { .cmd="AT+H", .desc="FOTA hex download", atcmd_hexline},
     { .cmd="AT+JOIN", .desc="LoRa JOIN", atcmd_join},
     { .cmd="AT+TX", .desc="LoRa TX", atcmd_tx},
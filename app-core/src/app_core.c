@@ -29,15 +29,36 @@
 #include "app-core/app_console.h"
 #include "app-core/app_core.h"
 #include "app-core/app_msg.h"
+#include "app-core/app_prof.h"
 
-//MYNEWT_VAL(APP_CORE_MAX_MODS) - fix max number of modules that may be defined in a specific target 
-#define MAX_MODS (8)        
+// Module table : a slot per module id, so its never full
+#define MAX_MODS (APP_MOD_NB)
+// DL action table : a slot per generic tag then per app specific tag
+#define NB_DL_ACTIONS (APP_CORE_DL_GENERIC_MAX + (256 - APP_CORE_DL_APP_SPECIFIC_START))
+// Config change subscriptions (app-core and the modules)
+#define MAX_CFG_SUBS (12)
 // Size of bit mask in bytes to contain all known modules
 #define MOD_MASK_SZ ((APP_MOD_LAST / 8) + 1)
-// The timeout before leaving UL sending state. Should be big enough to allow any DL to have arrived
+// The timeout before leaving UL sending state for an acked UL (the stack may retry it). Should be big enough to allow any DL to have arrived
 #define UL_WAIT_DL_TIMEOUTMS (20000)
+// Margin on the computed end of the RX windows of an unacked UL (stack/radio wakeup latencies)
+#define UL_RX_WINDOWS_MARGIN_MS (500)
 // Delay between deciding on stock mode and actually entering the deep sleep, during which leds are on to signal to user
 #define STOCK_MODE_DELAY_SECS (5)
+// Regulatory duty cycle : after a tx the band is busy for its time on air x this (0 if no limit in the region)
+#define DUTYCYCLE_DIV MYNEWT_VAL(LORA_DUTYCYCLE_DIV)
+// Min time before retrying a tx refused by the stack for duty cycle
+#define DUTYCYCLE_MIN_RETRY_MS (1000)
+// Join request PHY payload size
+#define LORAWAN_JOINREQ_SZ (23)
+// Max UL payload for the lowest data rates (SF10-12) : what we can always send
+#define LORAWAN_MIN_MAX_PAYLOAD (51)
+// Link tracking : demodulation floor SNR at SF7 (0.1dB), 2.5dB lower for each SF up
+#define LINK_SNR_FLOOR_SF7 (-75)
+#define LINK_SNR_FLOOR_STEP (25)
+// DLs needed in the estimate before the SF is lowered, and its max age
+#define LINK_MIN_SAMPLES (2)
+#define LINK_MAX_AGE_SECS (24 * 60 * 60)
 
 // State machine for core app
 // COntext data
@@ -55,11 +76,29 @@ static struct appctx
         APP_MOD_ID_t id;
         APP_MOD_EXEC_t exec;
         APP_CORE_API_t *api;
-    } mods[MAX_MODS];              // registered modules api fns
+        APP_MOD_RESOURCES_t *res;   // NULL if not declared
+        uint8_t runState;           // during serial data collection
+        uint64_t runUntilMS;        // timeout of its run in serial data collection (ms since boot)
+        uint32_t ticDueTS;          // when its next tic is due during idle (secs since boot), 0=none
+        bool ulDataPending;         // selected this round, its data is still to be got
+        uint16_t ulNeed;            // UL space it asked for (see modAskULNeed())
+        uint8_t ulPrio;
+        bool ulDataGot;             // its data was got for this round's UL (told when it is sent)
+    } mods[MAX_MODS];              // registered modules api fns (in registration order)
+    uint8_t modIdx[MAX_MODS];      // index in mods[] + 1 for each module id (0=not registered)
     uint8_t modsMask[MOD_MASK_SZ]; // bit mask to indicate if module is active or not currently
-    int currentSerialModIdx;
     int requestedModule; // If forced UL then it may request only one module is run
     bool ulIsCrit;       // during data collection, module can signal critical data change ie must send UL
+    bool txIsBacklog;    // is the message being txd from the UL backlog (or from txmsg)?
+    uint8_t txSz;        // size of the message being txd
+    uint8_t txSF;        // SF of the ULs of this round (see linkSelectSF())
+    uint8_t nbTxInRound; // ULs txd in this UL round
+    bool dlInRound;      // a DL was received during this UL round
+    uint8_t listensNoDL; // listening ULs txd ok in a row that got no DL
+    bool txWaitBand;     // waiting for the duty cycle to allow the next tx
+    bool backlogTxFailed;     // a backlog message failed this round, leave them for the next one
+    uint64_t bandFreeAtMS;    // duty cycle budget : when the next tx is allowed (ms since boot)
+    uint64_t ulRoundEndMS;    // no tx scheduled after this in the UL round (ms since boot)
     APP_CORE_UL_t txmsg; // for building UL messages
     APP_CORE_DL_t rxmsg; // for decoding DL messages
     uint32_t lastULTime; // timestamp of last uplink in seconds since boot
@@ -69,16 +108,36 @@ static struct appctx
     uint32_t idleTimeCheckSecs;
     uint32_t modSetupTimeSecs;
     uint32_t idleStartTS; // In seconds since epoch
+    bool wakeOnMove;      // idle sleep should be cut short by a movement (ie we are in the 'not moving' idle time)
     uint32_t joinStartTS; // in seconds since epoch
     uint32_t maxTimeBetweenULMins;
+    uint32_t smStatsULHours;
+    uint32_t ulMaxRoundBytes;   // max bytes of data collected for the ULs of a round
+    uint8_t ulCompact;          // use the compact TLV encodings (backend must support UL protocol v2)
+    uint8_t ulDeltaResync;      // delta mode : rounds between full resyncs (0=off, backend must support APP_CORE_UL_DELTA)
+    uint8_t ulAppAck;           // ask the backend to ack the event TLVs, and resend them if it doesn't (backend must support APP_CORE_DL_APP_ACK)
+    uint8_t linkMarginDB;       // SNR margin to keep when lowering the SF (0=always the configured SF)
+    uint8_t ulValueMin;         // value of the round's data needed for an UL at the configured SF (0=any value)
+    int16_t linkSNR10;          // rolling SNR of the DLs (0.1dB)
+    uint8_t linkNbSamples;      // DLs in it (0=no estimate)
+    uint32_t linkSampleTS;      // time of the last one (secs since boot)
+    uint32_t lastSMStatsULTime; // timestamp of last UL with the state machine stats in seconds since boot
+    uint8_t resetReason;        // of this boot (RM_REASON_t)
+    uint32_t bootToULMS;        // time from boot to the first UL tx ok (0=not yet)
+    bool bootToULSent;          // and it has been sent to the backend
     bool doReboot;
     uint8_t notStockMode;
     uint32_t joinTimeCheckSecs;
     uint32_t rejoinWaitMins;
     uint32_t rejoinWaitSecs;
-    uint8_t nbJoinAttempts;
-    uint8_t nActions;
-    ACTION_t actions[MAX_DL_ACTIONS];
+    uint8_t nbJoinAttempts;       // failed join attempts since the last join
+    uint8_t joinTriesPerSF;       // failed join attempts at each SF before the join SF goes up
+    uint32_t joinDayAirtimeMS;    // join airtime budget per day past the first 11 hours of joining (0=no limit)
+    uint32_t joinFirstTS;         // first join attempt since the last join ok (secs since boot) : the budget periods start from it
+    uint32_t joinPeriodStartTS;   // start of the current join budget period (secs since boot)
+    uint32_t joinPeriodUsedMS;    // join airtime used in it
+    uint32_t joinRandState;       // for the join retry jitter (0=not seeded)
+    ACTIONFN_t actions[NB_DL_ACTIONS];     // DL action handlers by tag, see actionIdx()
     // ul response id : holds the last DL id we received. Sent in each UL to inform backend we got its DLs. 0=not listening
     uint8_t lastDLId;
     struct loraapp_config
@@ -99,7 +158,6 @@ static struct appctx
     .deviceActive = 1,
     .enableStateLeds = MYNEWT_VAL(ENABLE_ACTIVE_LEDS),     //0,
     .nMods = 0,
-    .nActions = 0,
     .requestedModule = -1,
     .idleTimeMovingSecs = MYNEWT_VAL(IDLETIME_MOVING_SECS),     //5 * 60, // 5mins
     .idleTimeNotMovingMins = MYNEWT_VAL(IDLETIME_NOTMOVING_MINS),     //120, // 2 hours
@@ -109,9 +167,18 @@ static struct appctx
     .rejoinWaitMins = MYNEWT_VAL(JOIN_RETRY_LONG_MINS),     //120,   // 2 hours for rejoin tries between the try blocks
     .rejoinWaitSecs = MYNEWT_VAL(JOIN_RETRY_SHORT_SECS),     //60,    // 60s default for rejoin tries in the 'try X times' (ok for SF10 duty cycle?)
     .nbJoinAttempts = 0,
+    .joinTriesPerSF = 3,
+    .joinDayAirtimeMS = MYNEWT_VAL(JOIN_DAY_AIRTIME_MS),
     .notStockMode = 0, // in stock mode by default until a rejoin works
     .modSetupTimeSecs = 3,
     .maxTimeBetweenULMins = 120, // 2 hours
+    .smStatsULHours = MYNEWT_VAL(SM_STATS_UL_HOURS),     // 24, once a day
+    .ulMaxRoundBytes = MYNEWT_VAL(UL_MAX_ROUND_BYTES),     // 192, ie 4 full blocks
+    .ulCompact = MYNEWT_VAL(UL_COMPACT_TLVS),     // 0 until the backend decodes them
+    .ulDeltaResync = MYNEWT_VAL(UL_DELTA_RESYNC_ROUNDS),     // 0 until the backend supports it
+    .ulAppAck = MYNEWT_VAL(UL_APP_ACK),     // 0 until the backend supports it
+    .linkMarginDB = MYNEWT_VAL(LORA_LINK_MARGIN_DB),     // 10
+    .ulValueMin = MYNEWT_VAL(UL_VALUE_MIN),     // 30
     .lastULTime = 0,
     .lastDLId = 0, // default when new, will be read from the config mgr
     .loraCfg = {
@@ -136,6 +203,7 @@ typedef enum
     LORA_TX_ERR_RETRY,
     LORA_TX_ERR_FATAL,
     LORA_TX_ERR_NOTJOIN,
+    LORA_TX_ERR_DUTYCYCLE,
     LORA_TX_NO_TX
 } LORA_TX_RESULT_t;
 
@@ -143,20 +211,30 @@ typedef enum
 static void registerActions();
 static void executeDL(struct appctx *ctx, APP_CORE_DL_t *data);
 
-// Module id is NOT the index in the table, so gotta find it
+// Module id is NOT the index in the table (which is in registration order), modIdx[] maps it
 static int findModuleById(APP_MOD_ID_t mid) {
-    for(int i=0;i<_ctx.nMods;i++) {
-        if (_ctx.mods[i].id == mid) {
-            return i;
-        }
+    if (mid < 0 || mid >= MAX_MODS) {
+        return -1;
+    }
+    // -1 if not found
+    return (int)_ctx.modIdx[mid] - 1;
+}
+// Index of a DL action tag in the table, or -1 if its not a tag we can have a handler for
+static int actionIdx(uint8_t id) {
+    if (id < APP_CORE_DL_GENERIC_MAX) {
+        return id;
+    }
+    if (id >= APP_CORE_DL_APP_SPECIFIC_START) {
+        return APP_CORE_DL_GENERIC_MAX + (id - APP_CORE_DL_APP_SPECIFIC_START);
     }
-    // not found
     return -1;
 }
 
 // Check if reboot flag is set ie request for a reboot.
 static void checkReboot(struct appctx *ctx) {
     if (ctx->doReboot) {
+        // Don't lose any pending config writes
+        AppCore_commitConfig();
         // Ok. Check if the reboot is 'normal' or into stock mode
         if (ctx->notStockMode==0) {
             log_debug("AC: reboot pending for stock mode... bye bye....");
@@ -187,18 +265,125 @@ static void deviceStateIndicate() {
         }
     }
 }
-// Callback from config mgr when the actived modules mask changes
-static void configChangedCB(void* ctx, uint16_t key)
+// Config change subscriptions : the single config mgr callback passes each change only to the subscribers of its key
+static struct {
+    uint8_t nSubs;
+    struct {
+        uint16_t firstKey;
+        uint16_t lastKey;
+        APP_CORE_CFG_CBFN_t cb;
+        void* ctx;
+    } subs[MAX_CFG_SUBS];
+} _cfgSubs;
+// Callback from config mgr for any config change : pass it on to whoever subscribed to this key
+static void configDispatchCB(void* ctx, uint16_t key)
+{
+    for (int i = 0; i < _cfgSubs.nSubs; i++)
+    {
+        if (key >= _cfgSubs.subs[i].firstKey && key <= _cfgSubs.subs[i].lastKey)
+        {
+            (*_cfgSubs.subs[i].cb)(_cfgSubs.subs[i].ctx, key);
+        }
+    }
+}
+// Read our config : all of it at init (key=CFG_KEY_ILLEGAL), or just the element that changed (subscription callback), ensuring values are 'reasonable'
+static void readConfig(void* ctx, uint16_t key)
 {
-    // just re-get all my config in case it changed
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_MODS_ACTIVE_MASK, &_ctx.modsMask[0], MOD_MASK_SZ);
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_IDLE_TIME_MOVING_SECS, &_ctx.idleTimeMovingSecs, sizeof(uint32_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_IDLE_TIME_NOTMOVING_MINS, &_ctx.idleTimeNotMovingMins, sizeof(uint32_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_MODSETUP_TIME_SECS, &_ctx.modSetupTimeSecs, sizeof(uint32_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_MAXTIME_UL_MINS, &_ctx.maxTimeBetweenULMins, sizeof(uint32_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_JOIN_TIMEOUT_SECS, &_ctx.joinTimeCheckSecs, sizeof(uint32_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_RETRY_JOIN_TIME_MINS, &_ctx.rejoinWaitMins, sizeof(uint32_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_RETRY_JOIN_TIME_SECS, &_ctx.rejoinWaitSecs, sizeof(uint32_t));
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_IDLE_TIME_MOVING_SECS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_IDLE_TIME_MOVING_SECS, &_ctx.idleTimeMovingSecs, 0, 24 * 60 * 60);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_IDLE_TIME_NOTMOVING_MINS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_IDLE_TIME_NOTMOVING_MINS, &_ctx.idleTimeNotMovingMins, 0, 24 * 60);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_IDLE_TIME_INACTIVE_MINS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_IDLE_TIME_INACTIVE_MINS, &_ctx.idleTimeInactiveMins, 5, 24*60);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_IDLE_TIME_CHECK_SECS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_IDLE_TIME_CHECK_SECS, &_ctx.idleTimeCheckSecs, 15, 5 * 60);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_MODSETUP_TIME_SECS)
+    {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_MODSETUP_TIME_SECS, &_ctx.modSetupTimeSecs, sizeof(uint32_t));
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_JOIN_TIMEOUT_SECS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_JOIN_TIMEOUT_SECS, &_ctx.joinTimeCheckSecs, 18, 30);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_RETRY_JOIN_TIME_MINS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_RETRY_JOIN_TIME_MINS, &_ctx.rejoinWaitMins, 1, 24 * 60);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_RETRY_JOIN_TIME_SECS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_RETRY_JOIN_TIME_SECS, &_ctx.rejoinWaitSecs, 15, 120);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_JOIN_TRIES_PER_SF)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_JOIN_TRIES_PER_SF, &_ctx.joinTriesPerSF, 1, 10);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_JOIN_DAY_AIRTIME_MS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_JOIN_DAY_AIRTIME_MS, &_ctx.joinDayAirtimeMS, 0, 3600 * 1000);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_MODS_ACTIVE_MASK)
+    {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_MODS_ACTIVE_MASK, &_ctx.modsMask[0], MOD_MASK_SZ);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_MAXTIME_UL_MINS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_MAXTIME_UL_MINS, &_ctx.maxTimeBetweenULMins, 1, 24 * 60);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_SM_STATS_UL_HOURS)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_SM_STATS_UL_HOURS, &_ctx.smStatsULHours, 0, 7 * 24);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_UL_MAX_ROUND_BYTES)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_UL_MAX_ROUND_BYTES, &_ctx.ulMaxRoundBytes, APP_CORE_UL_MAX_SZ - 2, APP_CORE_UL_MAX_NB * (APP_CORE_UL_MAX_SZ - 2));
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_UL_COMPACT)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_UL_COMPACT, &_ctx.ulCompact, 0, 1);
+        app_core_msg_ul_setCompact(_ctx.ulCompact != 0);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_UL_DELTA_RESYNC)
+    {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_UL_DELTA_RESYNC, &_ctx.ulDeltaResync, sizeof(uint8_t));
+        app_core_msg_ul_setDelta(_ctx.ulDeltaResync);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_UL_APP_ACK)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_UL_APP_ACK, &_ctx.ulAppAck, 0, 1);
+        app_core_msg_ul_setAppAck(_ctx.ulAppAck != 0);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_LINK_MARGIN_DB)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_LINK_MARGIN_DB, &_ctx.linkMarginDB, 0, 30);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_UL_VALUE_MIN)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_UL_VALUE_MIN, &_ctx.ulValueMin, 0, APP_CORE_UL_VALUE_CRIT);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_DL_ID)
+    {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_DL_ID, &_ctx.lastDLId, 0, 15);
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_STOCK_MODE)
+    {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_STOCK_MODE, &_ctx.notStockMode, sizeof(uint8_t));
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_DEVICE_ACTIVE)
+    {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_DEVICE_ACTIVE, &_ctx.deviceActive, sizeof(uint8_t));
+    }
+    if (key == CFG_KEY_ILLEGAL || key == CFG_UTIL_KEY_ENABLE_DEVICE_STATE_LEDS)
+    {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_ENABLE_DEVICE_STATE_LEDS, &_ctx.enableStateLeds, sizeof(uint8_t));
+    }
 }
 static bool isModActive(uint8_t *mask, APP_MOD_ID_t id)
 {
@@ -208,6 +393,55 @@ static bool isModActive(uint8_t *mask, APP_MOD_ID_t id)
     }
     return ((mask[id / 8] & (1 << (id % 8))) != 0);
 }
+// Module callbacks all go through these, to be profiled (see app_prof.h)
+static uint32_t modStart(struct appctx *ctx, int i)
+{
+    uint32_t ret;
+    APP_PROF(APP_PROF_MOD_SITE(ctx->mods[i].id, APP_PROF_START), ret = (*(ctx->mods[i].api->startCB))());
+    return ret;
+}
+static void modStop(struct appctx *ctx, int i)
+{
+    APP_PROF(APP_PROF_MOD_SITE(ctx->mods[i].id, APP_PROF_STOP), (*(ctx->mods[i].api->stopCB))());
+}
+static bool modGetULData(struct appctx *ctx, int i)
+{
+    bool ret;
+    APP_PROF(APP_PROF_MOD_SITE(ctx->mods[i].id, APP_PROF_GETULDATA), ret = (*(ctx->mods[i].api->getULDataCB))(&ctx->txmsg));
+    return ret;
+}
+static uint32_t modTic(struct appctx *ctx, int i)
+{
+    uint32_t ret;
+    APP_PROF(APP_PROF_MOD_SITE(ctx->mods[i].id, APP_PROF_TIC), ret = (*(ctx->mods[i].api->ticCB))());
+    return ret;
+}
+// Module run states during serial data collection
+enum { MOD_RUN_NO, MOD_RUN_PENDING, MOD_RUN_RUNNING };
+// Can these 2 modules run at the same time?
+static bool modsConflict(struct appctx *ctx, int a, int b)
+{
+    APP_MOD_RESOURCES_t *ra = ctx->mods[a].res;
+    APP_MOD_RESOURCES_t *rb = ctx->mods[b].res;
+    // A module that didn't say what it uses must run alone
+    if (ra == NULL || rb == NULL)
+    {
+        return true;
+    }
+    if (ra->uartDev != NULL && rb->uartDev != NULL && strcmp(ra->uartDev, rb->uartDev) == 0)
+    {
+        return true;
+    }
+    if (ra->i2cBus >= 0 && ra->i2cBus == rb->i2cBus)
+    {
+        return true;
+    }
+    if (ra->pwrIO >= 0 && ra->pwrIO == rb->pwrIO)
+    {
+        return true;
+    }
+    return false;
+}
 // application core state machine
 // Define my state ids
 enum MyStates
@@ -231,10 +465,417 @@ enum MyEvents
     ME_LORA_JOIN_FAIL,
     ME_LORA_RESULT,
     ME_LORA_RX,
-    ME_CONSOLE_TIMEOUT
+    ME_CONSOLE_TIMEOUT,
+    ME_MOVED
 };
+// Residency accounting per state : each state's SM_ENTER calls smStatsEnter() which closes the stay in the previous state
+static struct {
+    int8_t current;         // state we are in, -1 until SM started
+    uint64_t enteredAtMS;   // when we entered it (ms since boot)
+    APP_CORE_STATE_STATS_t st[MS_LAST];
+} _smStats = {
+    .current = -1,
+};
+// UL TLV record per state : 1 byte state id, 2 bytes nb entries, 3 bytes total secs, 2 bytes max dwell secs (all LE, saturated)
+#define SM_STATS_UL_REC_SZ (8)
+// Config write-back : writes of an unchanged value are dropped, the others are held here and written to PROM together when we next
+// go to sleep (idle, join retry wait, stock) or reboot. Keys too long to hold, or when all slots are in use, are written immediately.
+#define CFG_WB_SLOTS (8)
+#define CFG_WB_MAX_LEN (16)
+// Longest value compared to the stored one before a write (firmware info is 80 bytes)
+#define CFG_WB_CMP_MAX_LEN (96)
+static struct {
+    uint8_t nDirty;
+    struct {
+        uint16_t key;
+        uint8_t len;
+        uint8_t data[CFG_WB_MAX_LEN];
+    } slots[CFG_WB_SLOTS];
+    uint8_t cmp[CFG_WB_CMP_MAX_LEN];
+} _cfgWB;
+
 // related fns
 
+static uint64_t nowMS() {
+    return (uint64_t)(os_get_uptime_usec() / 1000);
+}
+static void smStatsEnter(uint8_t sid)
+{
+    uint64_t now = nowMS();
+    if (_smStats.current >= 0)
+    {
+        uint32_t dwell = (uint32_t)(now - _smStats.enteredAtMS);
+        _smStats.st[_smStats.current].totalMS += dwell;
+        if (dwell > _smStats.st[_smStats.current].maxDwellMS)
+        {
+            _smStats.st[_smStats.current].maxDwellMS = dwell;
+        }
+    }
+    _smStats.current = sid;
+    _smStats.enteredAtMS = now;
+    _smStats.st[sid].nEntries++;
+}
+// Add the state residency stats to the UL. Idle is not sent as its the rest of the uptime, nor startup/stock which are one-offs.
+static void addSMStatsToUL(struct appctx *ctx)
+{
+    uint8_t v[(MS_LAST - 3) * SM_STATS_UL_REC_SZ];
+    uint8_t sz = 0;
+    for (int i = 0; i < MS_LAST; i++)
+    {
+        APP_CORE_STATE_STATS_t st;
+        if (i == MS_IDLE || i == MS_STARTUP || i == MS_STOCK || !AppCore_getStateStats(i, &st) || st.nEntries == 0)
+        {
+            continue;
+        }
+        uint32_t totalSecs = (uint32_t)(st.totalMS / 1000);
+        if (totalSecs > 0xFFFFFF)
+        {
+            totalSecs = 0xFFFFFF;
+        }
+        v[sz] = i;
+        Util_writeLE_uint16_t(v, sz + 1, (st.nEntries > UINT16_MAX ? UINT16_MAX : st.nEntries));
+        v[sz + 3] = (totalSecs & 0xFF);
+        v[sz + 4] = ((totalSecs >> 8) & 0xFF);
+        v[sz + 5] = ((totalSecs >> 16) & 0xFF);
+        Util_writeLE_uint16_t(v, sz + 6, ((st.maxDwellMS / 1000) > UINT16_MAX ? UINT16_MAX : (st.maxDwellMS / 1000)));
+        sz += SM_STATS_UL_REC_SZ;
+    }
+    if (sz > 0)
+    {
+        if (app_core_msg_ul_addTLV(&ctx->txmsg, APP_CORE_UL_SM_STATS, sz, v))
+        {
+            ctx->lastSMStatsULTime = TMMgr_getRelTimeSecs();
+        }
+        else
+        {
+            log_debug("AC:no space for SM stats in UL");
+        }
+    }
+}
+// First UL tx ok since boot : note the boot to UL time
+static void bootToULDone(struct appctx *ctx)
+{
+    if (ctx->bootToULMS == 0)
+    {
+        uint64_t ms = nowMS();
+        ctx->bootToULMS = (ms > UINT32_MAX ? UINT32_MAX : (ms == 0 ? 1 : (uint32_t)ms));
+        log_info("AC:first UL %d ms after boot (reset %d)", ctx->bootToULMS, ctx->resetReason);
+    }
+}
+// Tell the backend the boot to first UL time, once per boot (with the reset reason as it depends on it)
+static void addBootToULToUL(struct appctx *ctx)
+{
+    if (ctx->bootToULMS == 0 || ctx->bootToULSent)
+    {
+        return;
+    }
+    uint8_t v[5];
+    v[0] = ctx->resetReason;
+    Util_writeLE_uint32_t(v, 1, ctx->bootToULMS);
+    ctx->bootToULSent = app_core_msg_ul_addTLV(&ctx->txmsg, APP_CORE_UL_BOOT_TO_UL, sizeof(v), v);
+}
+
+// Work out how long we can sleep in idle before something has to be done : the end of the idle time for the current
+// moving/not moving/inactive mode, or the next tic a module asked for. 0 means time to go collect data and UL.
+static uint32_t idleSleepSecs(struct appctx *ctx)
+{
+    // if device not active, use specific timeout as default
+    uint32_t idletimeS = ctx->idleTimeInactiveMins * 60;
+    ctx->wakeOnMove = false;
+    if (AppCore_isDeviceActive()) {
+        // device is active -> check did we move? deal with difference between moving and not moving times
+        MMMgr_check(); // check hardware
+        idletimeS = ctx->idleTimeNotMovingMins * 60;
+        // check if has moved recently and use different timeout
+        if (MMMgr_hasMovedSince(ctx->lastULTime)) {
+            idletimeS = ctx->idleTimeMovingSecs;
+            log_debug("AC:move (%d ago) since UL , it %d", (TMMgr_getRelTimeSecs() - MMMgr_getLastMovedTime()), idletimeS);
+        } else {
+            // A movement will change the idle time, so it must wake us
+            ctx->wakeOnMove = true;
+            log_debug("AC:no move (%d ago) since UL , it %d", (TMMgr_getRelTimeSecs() - MMMgr_getLastMovedTime()), idletimeS);
+        }
+    }
+    uint32_t now = TMMgr_getRelTimeSecs();
+    uint32_t dt = now - ctx->idleStartTS;
+    if (dt >= idletimeS)
+    {
+        return 0;
+    }
+    uint32_t sleepS = idletimeS - dt;
+    for (int i = 0; i < ctx->nMods; i++)
+    {
+        if (ctx->mods[i].ticDueTS != 0)
+        {
+            uint32_t ticS = (ctx->mods[i].ticDueTS > now ? ctx->mods[i].ticDueTS - now : 1);
+            if (ticS < sleepS)
+            {
+                sleepS = ticS;
+            }
+        }
+    }
+    return sleepS;
+}
+// Call the tic cbs of the active modules whose tic is due, and note when they want the next one
+static void callDueTics(struct appctx *ctx)
+{
+    uint32_t now = TMMgr_getRelTimeSecs();
+    for (int i = 0; i < ctx->nMods; i++)
+    {
+        if (ctx->mods[i].ticDueTS != 0 && ctx->mods[i].ticDueTS <= now)
+        {
+            ctx->mods[i].ticDueTS = 0;
+            if (isModActive(ctx->modsMask, ctx->mods[i].id))
+            {
+                uint32_t nextS = modTic(ctx, i);
+                if (nextS > 0)
+                {
+                    ctx->mods[i].ticDueTS = now + nextS;
+                }
+            }
+        }
+    }
+}
+// Go back to deep sleep in idle until the next deadline
+static void idleSleep(struct appctx *ctx, uint32_t sleepS)
+{
+    sm_timer_start(ctx->mySMId, sleepS * 1000);
+    log_debug("AC:idle %d secs", sleepS);
+    log_check_uart_active();        // so closes it if no logs being sent 
+    LPMgr_setLPMode(ctx->lpUserId, LP_DEEPSLEEP);
+}
+// Movement manager tells us the device moved. Only of interest when its sleeping in idle with the 'not moving' time.
+static void movedCB()
+{
+    if (_ctx.wakeOnMove)
+    {
+        _ctx.wakeOnMove = false;
+        sm_sendEvent(_ctx.mySMId, ME_MOVED, NULL);
+    }
+}
+
+// Time on air of a LoRa frame of sz bytes PHY payload
+static uint32_t loraTimeOnAirMS(uint8_t sf, uint8_t sz)
+{
+    uint32_t qsymUS = (1u << sf) * 2; // 1/4 of 2^SF / 125kHz in us
+    return (app_core_msg_loraQSymbols(sf, sz) * qsymUS + 999) / 1000;
+}
+// Time from a tx request till both RX windows are closed, including the reception of a max size DL in RX2. With ADR
+// the stack picks the data rate, so assume the lowest one.
+static uint32_t loraRxWindowsEndMS(struct appctx *ctx, uint8_t phySz)
+{
+    uint8_t sf = (ctx->loraCfg.useAdr ? LORAWAN_SF12 : ctx->txSF);
+    return loraTimeOnAirMS(sf, phySz) + MYNEWT_VAL(LORA_RX2_DELAY_MS) +
+           loraTimeOnAirMS(MYNEWT_VAL(LORA_RX2_SF), LORAWAN_MIN_MAX_PAYLOAD + LORAWAN_UL_OVERHEAD) + UL_RX_WINDOWS_MARGIN_MS;
+}
+// Max UL payload at the current data rate (EU868 table). With ADR the stack picks the data rate, so assume the lowest one.
+static uint8_t loraMaxPayload(struct appctx *ctx)
+{
+    if (ctx->loraCfg.useAdr)
+    {
+        return LORAWAN_MIN_MAX_PAYLOAD;
+    }
+    switch (ctx->txSF)
+    {
+    case LORAWAN_SF7:
+    case LORAWAN_SF8:
+        return 222;
+    case LORAWAN_SF9:
+        return 115;
+    default:
+        return LORAWAN_MIN_MAX_PAYLOAD;
+    }
+}
+// Link tracking (ADR off) : the rolling SNR of the DLs says how far above the demodulation floor the link is, so the SF of
+// each UL round can be the lowest that keeps linkMarginDB of margin (never above the configured SF). It goes down 1 SF per round,
+// and up at once when the estimate drops or a tx fails. The estimate is dropped if it is old, if the device moved since, or if
+// LORA_LINK_NODL_ULS listening ULs in a row got no DL (the link may be gone, and there is nothing to say so otherwise).
+// The DL is stronger than our UL by the gateway's extra tx power, less its better receiver : the estimate is of the UL.
+// Note the loraapi has no per tx power, so only the SF is adapted.
+static int16_t linkSNRFloor(uint8_t sf)
+{
+    return LINK_SNR_FLOOR_SF7 - (LINK_SNR_FLOOR_STEP * (sf - LORAWAN_SF7));
+}
+static void linkOnDL(struct appctx *ctx, APP_CORE_DL_t *dl)
+{
+    // never assume the UL is better than the DL
+    int16_t asym = MYNEWT_VAL(LORA_LINK_GW_TX_DBM) - ctx->loraCfg.txPower - MYNEWT_VAL(LORA_LINK_GW_RX_ADV_DB);
+    int16_t ulSNR10 = (dl->snr - (asym > 0 ? asym : 0)) * 10;
+    if (ctx->linkNbSamples == 0)
+    {
+        ctx->linkSNR10 = ulSNR10;
+    }
+    else
+    {
+        ctx->linkSNR10 = ((3 * ctx->linkSNR10) + ulSNR10) / 4;
+    }
+    if (ctx->linkNbSamples < 255)
+    {
+        ctx->linkNbSamples++;
+    }
+    ctx->linkSampleTS = TMMgr_getRelTimeSecs();
+    log_debug("AC:link DL rssi %d snr %d, UL snr est %d/10dB", dl->rssi, dl->snr, ctx->linkSNR10);
+}
+static void linkOnTxFail(struct appctx *ctx)
+{
+    if (ctx->txSF < ctx->loraCfg.loraSF)
+    {
+        ctx->txSF++;
+        // and the estimate goes down a step so the next round doesn't go straight back
+        ctx->linkSNR10 -= LINK_SNR_FLOOR_STEP;
+        log_info("AC:link tx fail, UL SF%d", ctx->txSF);
+    }
+}
+static void linkSelectSF(struct appctx *ctx)
+{
+    uint8_t prev = ctx->txSF;
+    uint32_t now = TMMgr_getRelTimeSecs();
+    if (ctx->linkNbSamples > 0 && ((now - ctx->linkSampleTS) > LINK_MAX_AGE_SECS || MMMgr_hasMovedSince(ctx->linkSampleTS)))
+    {
+        // not the link where we are now
+        ctx->linkNbSamples = 0;
+    }
+    if (ctx->linkNbSamples > 0 && ctx->listensNoDL >= MYNEWT_VAL(LORA_LINK_NODL_ULS))
+    {
+        log_info("AC:link no DL in %d ULs, estimate dropped", ctx->listensNoDL);
+        ctx->linkNbSamples = 0;
+    }
+    if (ctx->loraCfg.useAdr || ctx->linkMarginDB == 0 || ctx->linkNbSamples < LINK_MIN_SAMPLES)
+    {
+        ctx->txSF = ctx->loraCfg.loraSF;
+    }
+    else
+    {
+        uint8_t sf = LORAWAN_SF7;
+        while (sf < ctx->loraCfg.loraSF && (ctx->linkSNR10 - linkSNRFloor(sf)) < (ctx->linkMarginDB * 10))
+        {
+            sf++;
+        }
+        ctx->txSF = (sf < ctx->txSF ? ctx->txSF - 1 : sf);
+    }
+    if (ctx->txSF != prev)
+    {
+        log_info("AC:link UL SF%d -> SF%d (snr est %d/10dB)", prev, ctx->txSF, ctx->linkSNR10);
+    }
+}
+// Start a new round of UL data collection
+static void initUL(struct appctx *ctx)
+{
+    app_core_msg_ul_init(&ctx->txmsg);
+    app_core_msg_ul_setMaxRoundSz(&ctx->txmsg, ctx->ulMaxRoundBytes);
+    ctx->ulIsCrit = false;         // assume we're not gonna send it (its not critical)
+    for (int i = 0; i < ctx->nMods; i++)
+    {
+        ctx->mods[i].ulDataGot = false;
+    }
+}
+// Account a tx in the duty cycle budget. The default channels all share 1 sub-band so its a single budget. 
+static void useDutyCycle(struct appctx *ctx, uint8_t sf, uint8_t phySz)
+{
+    ctx->bandFreeAtMS = nowMS() + (uint64_t)loraTimeOnAirMS(sf, phySz) * DUTYCYCLE_DIV;
+}
+
+// Join scheduling : the join SF goes up by 1 every joinTriesPerSF failed attempts (up to SF12) to reach a further gateway, and
+// the retries back off exponentially with a random part so that devices that lost the network together (gateway outage) don't
+// retry together. The join airtime is limited as the LoRaWAN join backoff : 36s in the first hour of joining, 36s per 10 hours up to 11 hours,
+// then joinDayAirtimeMS (8.7s) per day (0=no limit at all).
+static uint8_t joinSF(struct appctx *ctx)
+{
+    uint32_t sf = ctx->loraCfg.loraSF + (ctx->nbJoinAttempts / ctx->joinTriesPerSF);
+    return (sf > LORAWAN_SF12 ? LORAWAN_SF12 : sf);
+}
+static uint32_t joinRand(struct appctx *ctx, uint32_t range)
+{
+    if (ctx->joinRandState == 0)
+    {
+        // different for each device (devEUI), and each boot (uptime when the first retry is needed)
+        uint32_t s = (uint32_t)os_get_uptime_usec();
+        for (int i = 0; i < 8; i++)
+        {
+            s = (s * 31) + ctx->loraCfg.deveui[i];
+        }
+        ctx->joinRandState = (s != 0 ? s : 1);
+    }
+    // xorshift32
+    uint32_t x = ctx->joinRandState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    ctx->joinRandState = x;
+    return (range > 0 ? (x % range) : 0);
+}
+#define JOIN_BUDGET_EARLY_MS (36 * 1000)
+// The join budget period that t (secs since boot) is in : its start and length, and returns its budget (0=no limit)
+static uint32_t joinBudgetPeriod(struct appctx *ctx, uint32_t t, uint32_t *start, uint32_t *len)
+{
+    uint32_t elapsed = t - ctx->joinFirstTS;
+    if (elapsed < 60 * 60)
+    {
+        *start = ctx->joinFirstTS;
+        *len = 60 * 60;
+        return JOIN_BUDGET_EARLY_MS;
+    }
+    if (elapsed < 11 * 60 * 60)
+    {
+        *start = ctx->joinFirstTS + (60 * 60);
+        *len = 10 * 60 * 60;
+        return JOIN_BUDGET_EARLY_MS;
+    }
+    *len = 24 * 60 * 60;
+    *start = ctx->joinFirstTS + (11 * 60 * 60) + (((elapsed - (11 * 60 * 60)) / *len) * *len);
+    return ctx->joinDayAirtimeMS;
+}
+// Charge a join request to the budget of its period
+static void joinUseAirtime(struct appctx *ctx, uint32_t toaMS)
+{
+    uint32_t now = TMMgr_getRelTimeSecs();
+    uint32_t start, len;
+    if (ctx->nbJoinAttempts == 0)
+    {
+        ctx->joinFirstTS = now;
+    }
+    joinBudgetPeriod(ctx, now, &start, &len);
+    if (start != ctx->joinPeriodStartTS)
+    {
+        ctx->joinPeriodStartTS = start;
+        ctx->joinPeriodUsedMS = 0;
+    }
+    ctx->joinPeriodUsedMS += toaMS;
+}
+// Time to wait before the next join attempt
+static uint32_t joinRetryWaitSecs(struct appctx *ctx)
+{
+    // rejoinWaitSecs doubled at each failed attempt, up to rejoinWaitMins, then 50-100% of it
+    uint32_t maxSecs = ctx->rejoinWaitMins * 60;
+    uint32_t waitSecs = ctx->rejoinWaitSecs;
+    for (int i = 1; i < ctx->nbJoinAttempts && waitSecs < maxSecs; i++)
+    {
+        waitSecs *= 2;
+    }
+    if (waitSecs > maxSecs)
+    {
+        waitSecs = maxSecs;
+    }
+    waitSecs = (waitSecs / 2) + joinRand(ctx, (waitSecs / 2) + 1);
+    // Not before the duty cycle lets us tx (else the join is refused and counts as a failed attempt)
+    uint64_t now = nowMS();
+    if (ctx->bandFreeAtMS > now && ((ctx->bandFreeAtMS - now + 999) / 1000) > waitSecs)
+    {
+        waitSecs = (ctx->bandFreeAtMS - now + 999) / 1000;
+    }
+    // and if the join budget of the period it would be in is used up, not before the next period
+    uint32_t nowSecs = TMMgr_getRelTimeSecs();
+    uint32_t start, len;
+    uint32_t budget = joinBudgetPeriod(ctx, nowSecs + waitSecs, &start, &len);
+    if (ctx->joinDayAirtimeMS > 0 && budget > 0 && start == ctx->joinPeriodStartTS &&
+        (ctx->joinPeriodUsedMS + loraTimeOnAirMS(joinSF(ctx), LORAWAN_JOINREQ_SZ)) > budget)
+    {
+        log_info("AC:join airtime budget used (%d ms), wait %d secs for next period", ctx->joinPeriodUsedMS, (start + len) - nowSecs);
+        waitSecs = (start + len) - nowSecs;
+    }
+    return waitSecs;
+}
+
 static void lora_join_cb(void *userctx, LORAWAN_RESULT_t res)
 {
     //    log_debug("lora tx cb : result:%d", res);
@@ -261,8 +902,10 @@ static void lora_tx_cb(void *userctx, LORAWAN_RESULT_t res)
         ourres = LORA_TX_ERR_NOTJOIN;
         break;
     case LORAWAN_RES_DUTYCYCLE:
-    case LORAWAN_RES_OCC:
     case LORAWAN_RES_NO_BW:
+        ourres = LORA_TX_ERR_DUTYCYCLE;
+        break;
+    case LORAWAN_RES_OCC:
     case LORAWAN_RES_TIMEOUT: // what does this imply?
         ourres = LORA_TX_ERR_RETRY;
         break;
@@ -286,8 +929,12 @@ static void lora_rx_cb(void *userctx, LORAWAN_RESULT_t res, uint8_t port, int rs
     }
     memcpy(&_ctx.rxmsg.payload[0], msg, sz);
     _ctx.rxmsg.sz = sz;
+    _ctx.rxmsg.rssi = rssi;
+    _ctx.rxmsg.snr = snr;
     // Decode it
-    if (app_core_msg_dl_decode(&_ctx.rxmsg))
+    bool decoded;
+    APP_PROF(APP_PROF_CODEC_SITE(APP_PROF_DL_DECODE), decoded = app_core_msg_dl_decode(&_ctx.rxmsg));
+    if (decoded)
     {
         log_debug("AC:lora rx dlid %d, na %d", _ctx.rxmsg.dlId, _ctx.rxmsg.nbActions);
         sm_sendEvent(_ctx.mySMId, ME_LORA_RX, (void *)(&_ctx.rxmsg));
@@ -308,19 +955,32 @@ static SM_STATE_ID_t State_Startup(void *arg, int e, void *data)
     {
     case SM_ENTER:
     {
-        log_debug("AC:START");
-        // Stop all leds, and flash slow to show we're in console... this is for debug only
-        ledStart(MYNEWT_VAL(MODS_ACTIVE_LED), FLASH_MIN, -1);
-        ledStart(MYNEWT_VAL(NET_ACTIVE_LED), FLASH_MIN, -1);
-        // exit by timer if no at commands received
-        sm_timer_start(ctx->mySMId, 30 * 1000);
-
+        smStatsEnter(MS_STARTUP);
+        // The reboot manager keeps the reasons of the last reboots, most recent first (RM_REASON_t) : the first is this boot's.
+        // (RMMgr_getResetReasonCode() is the MCU's reset cause, not an RM_REASON_t)
+        uint8_t reasons[8];
+        RMMgr_getResetReasonBuffer(reasons, sizeof(reasons));
+        ctx->resetReason = reasons[0];
+        log_debug("AC:START (reset %d)", ctx->resetReason);
+        // Only a power on (ie someone at the bench plugging in) waits for the console. A watchdog/assert/DL reboot
+        // in the field has nobody to talk to, and every second here is a second longer without tracking.
+        if (ctx->resetReason != RM_HARD_RESET)
+        {
+            sm_sendEvent(ctx->mySMId, ME_FORCE_UL, NULL);
+            return SM_STATE_CURRENT;
+        }
         // activate console on the uart (if configured).
         if (startConsole() == false)
         {
             // start directly
             sm_sendEvent(ctx->mySMId, ME_FORCE_UL, NULL);
+            return SM_STATE_CURRENT;
         }
+        // Stop all leds, and flash slow to show we're in console... this is for debug only
+        ledStart(MYNEWT_VAL(MODS_ACTIVE_LED), FLASH_MIN, -1);
+        ledStart(MYNEWT_VAL(NET_ACTIVE_LED), FLASH_MIN, -1);
+        // exit by timer if no uart input in the sensing window
+        sm_timer_start(ctx->mySMId, MYNEWT_VAL(STARTUP_CONSOLE_SENSE_SECS) * 1000);
         return SM_STATE_CURRENT;
     }
     case SM_EXIT:
@@ -378,6 +1038,7 @@ static SM_STATE_ID_t State_TryJoin(void *arg, int e, void *data)
     {
     case SM_ENTER:
     {
+        smStatsEnter(MS_TRY_JOIN);
         checkReboot(ctx);
         // Stop all leds, and flash fast both to show we're trying join
         ledStart(MYNEWT_VAL(MODS_ACTIVE_LED), FLASH_5HZ, -1);
@@ -385,7 +1046,8 @@ static SM_STATE_ID_t State_TryJoin(void *arg, int e, void *data)
         // Set desired low power mode to be just light doze as console is active for first period
         LPMgr_setLPMode(ctx->lpUserId, LP_DOZE);
         // start join process
-        LORAWAN_RESULT_t status = lora_api_join(lora_join_cb, ctx->loraCfg.loraSF, NULL);
+        uint8_t sf = joinSF(ctx);
+        LORAWAN_RESULT_t status = lora_api_join(lora_join_cb, sf, NULL);
         if (status == LORAWAN_RES_JOIN_OK)
         {
             // already joined (?) seems unlikely so warn about it
@@ -400,9 +1062,11 @@ static SM_STATE_ID_t State_TryJoin(void *arg, int e, void *data)
         }
         else
         {
+            useDutyCycle(ctx, sf, LORAWAN_JOINREQ_SZ);
+            joinUseAirtime(ctx, loraTimeOnAirMS(sf, LORAWAN_JOINREQ_SZ));
             // Start the join timeout (shouldnt need it...)
             sm_timer_start(ctx->mySMId, ctx->joinTimeCheckSecs * 1000);
-            log_debug("AC:try join : timeout in %d secs", ctx->joinTimeCheckSecs);
+            log_debug("AC:try join : SF%d, timeout in %d secs", sf, ctx->joinTimeCheckSecs);
             // Record time
             ctx->joinStartTS = TMMgr_getRelTimeSecs();
         }
@@ -428,11 +1092,12 @@ static SM_STATE_ID_t State_TryJoin(void *arg, int e, void *data)
     case ME_LORA_JOIN_OK:
     {
         log_info("AC:join ok");
+        ctx->nbJoinAttempts = 0;
+        ctx->listensNoDL = 0;
         // Update to say we are not in stock mode
         ctx->notStockMode = 1;
-        CFMgr_setElement(CFG_UTIL_KEY_STOCK_MODE, &ctx->notStockMode, 1);
-        app_core_msg_ul_init(&ctx->txmsg);
-        ctx->ulIsCrit = false;         // assume we're not gonna send it (its not critical)
+        AppCore_setConfig(CFG_UTIL_KEY_STOCK_MODE, &ctx->notStockMode, 1);
+        initUL(ctx);
         return MS_GETTING_SERIAL_MODS; // go directly get data and send it
     }
     case ME_LORA_JOIN_FAIL:
@@ -462,7 +1127,9 @@ static SM_STATE_ID_t State_Stock(void *arg, int e, void *data)
     {
     case SM_ENTER:
     {
+        smStatsEnter(MS_STOCK);
         log_warn("AC:stock mode");
+        AppCore_commitConfig();
         // Before entering stock mode, we leave a small window in which it is possible to connect to the device
         // JTAG port to update firmware/config (as in the stock mode MCU low power this may not be possible)
         // During this time we will put leds on permantently to signal this to user 
@@ -504,24 +1171,18 @@ static SM_STATE_ID_t State_WaitJoinRetry(void *arg, int e, void *data)
     {
     case SM_ENTER:
     {
+        smStatsEnter(MS_WAIT_JOIN_RETRY);
+        // Write any config changes before sleeping
+        AppCore_commitConfig();
         checkReboot(ctx);
         // Start the retry join timeout
-        ctx->nbJoinAttempts++;
-        // We are allowing up to X tries with just Y second intervals, after which we go to a longer timeout of Z mins
-        uint8_t maxrapid = 3; // Default of 3 goes before sleeping a long time
-        CFMgr_getOrAddElement(CFG_UTIL_KEY_MAX_RAPID_JOIN_ATTEMPTS, &maxrapid, 1);
-        if (ctx->nbJoinAttempts < maxrapid)
-        {
-            // try again in short time
-            sm_timer_start(ctx->mySMId, ctx->rejoinWaitSecs * 1000);
-            log_debug("AC:wjr : retry %d secs", ctx->rejoinWaitSecs);
-        }
-        else
+        if (ctx->nbJoinAttempts < 255)
         {
-            sm_timer_start(ctx->mySMId, ctx->rejoinWaitMins * 60000);
-            log_debug("AC:wjr : retry %d mins", ctx->rejoinWaitMins);
-            ctx->nbJoinAttempts = 0; // as we're in the long timeout, reset count for next time
+            ctx->nbJoinAttempts++;
         }
+        uint32_t waitSecs = joinRetryWaitSecs(ctx);
+        sm_timer_start(ctx->mySMId, waitSecs * 1000);
+        log_debug("AC:wjr : retry %d at SF%d in %d secs", ctx->nbJoinAttempts, joinSF(ctx), waitSecs);
         // all modules deepsleep
         for (int i = 0; i < ctx->nMods; i++)
         {
@@ -567,10 +1228,12 @@ static SM_STATE_ID_t State_Idle(void *arg, int e, void *data)
     {
     case SM_ENTER:
     {
+        smStatsEnter(MS_IDLE);
+        // Write any config changes (eg from DL actions) before sleeping : this also lets the config change callbacks update everyone
+        AppCore_commitConfig();
         checkReboot(ctx);
         //Initialise the DM we're sending next time -> this means executed actions can start to fill it during idle time
-        app_core_msg_ul_init(&ctx->txmsg);
-        ctx->ulIsCrit = false; // assume we're not gonna send it (its not critical)
+        initUL(ctx);
         if (ctx->idleTimeMovingSecs == 0)
         {
             // no idleness, this device runs continuously... (eg if its powered)
@@ -578,11 +1241,13 @@ static SM_STATE_ID_t State_Idle(void *arg, int e, void *data)
             sm_sendEvent(ctx->mySMId, ME_FORCE_UL, NULL);
             return SM_STATE_CURRENT;
         }
-        // Start the wakeup timeout (every 60s we wake to check for movement)
-        sm_timer_start(ctx->mySMId, ctx->idleTimeCheckSecs * 1000);
-        log_debug("AC:idle %d secs", ctx->idleTimeCheckSecs);
         // Record time
         ctx->idleStartTS = TMMgr_getRelTimeSecs();
+        // modules with a tic get their first one after the check period, then say when they want the next
+        for (int i = 0; i < ctx->nMods; i++)
+        {
+            ctx->mods[i].ticDueTS = (ctx->mods[i].api->ticCB != NULL ? ctx->idleStartTS + ctx->idleTimeCheckSecs : 0);
+        }
         // all modules deepsleep
         for (int i = 0; i < ctx->nMods; i++)
         {
@@ -591,9 +1256,16 @@ static SM_STATE_ID_t State_Idle(void *arg, int e, void *data)
                 (*(ctx->mods[i].api->deepsleepCB))();
             }
         }
-        log_check_uart_active();        // so closes it if no logs being sent 
+        // Sleep until the next thing to do (end of idle time or a tic) : only a movement can wake us before that
+        uint32_t sleepS = idleSleepSecs(ctx);
+        if (sleepS == 0)
+        {
+            // idle time is 0 for this mode
+            sm_sendEvent(ctx->mySMId, ME_FORCE_UL, NULL);
+            return SM_STATE_CURRENT;
+        }
         // and stay idle in deep sleep if possible (other code may also have an option)
-        LPMgr_setLPMode(ctx->lpUserId, LP_DEEPSLEEP);
+        idleSleep(ctx, sleepS);
         // if enabled signal the device state (active or inactive) via LED flash pattern (enqueued) 
         // Note we don't cancel leds; to allow any modules to have set a time limited leds sequence without it getting cancelled immediatly...
         deviceStateIndicate();
@@ -602,6 +1274,7 @@ static SM_STATE_ID_t State_Idle(void *arg, int e, void *data)
     }
     case SM_EXIT:
     {
+        ctx->wakeOnMove = false;
         // LEDs off
         ledCancel(MYNEWT_VAL(MODS_ACTIVE_LED));
         ledCancel(MYNEWT_VAL(NET_ACTIVE_LED));
@@ -612,50 +1285,30 @@ static SM_STATE_ID_t State_Idle(void *arg, int e, void *data)
     }
     case SM_TIMEOUT:
     {
-        // Call any module's tic cbs that are registered (before checking run cycle)
-        for (int i = 0; i < ctx->nMods; i++)
-        {
-            if (isModActive(ctx->modsMask, ctx->mods[i].id))
-            {
-                // Call if defined
-                if (ctx->mods[i].api->ticCB != NULL)
-                {
-                    (*(ctx->mods[i].api->ticCB))();
-                }
-            }
-        }
-
-        // calculate timeout 
-        // if device not active, use specific timeout as default
-        uint32_t idletimeS = ctx->idleTimeInactiveMins * 60;
-        if (AppCore_isDeviceActive()) {
-            // device is active -> check did we move? deal with difference between moving and not moving times
-            MMMgr_check(); // check hardware
-            idletimeS = ctx->idleTimeNotMovingMins * 60;
-            // check if has moved recently and use different timeout
-            if (MMMgr_hasMovedSince(ctx->lastULTime)) {
-                idletimeS = ctx->idleTimeMovingSecs;
-                log_debug("AC:move (%d ago) since UL , it %d", (TMMgr_getRelTimeSecs() - MMMgr_getLastMovedTime()), idletimeS);
-            } else {
-                log_debug("AC:no move (%d ago) since UL , it %d", (TMMgr_getRelTimeSecs() - MMMgr_getLastMovedTime()), idletimeS);
-            }
-        }
-        idletimeS -= 1; // adjust by 1s to get run if 'close' to timeout
-        uint32_t dt = TMMgr_getRelTimeSecs() - ctx->idleStartTS;
-        if (dt >= idletimeS)
+        // Call any module's tic cbs that are due (before checking run cycle)
+        callDueTics(ctx);
+        uint32_t sleepS = idleSleepSecs(ctx);
+        if (sleepS == 0)
         {
             return MS_GETTING_SERIAL_MODS;
         }
-        // else stay here. reset timeout for next check
-        sm_timer_start(ctx->mySMId, ctx->idleTimeCheckSecs * 1000);
-        log_debug("AC:reidle %ds as %d < %d", ctx->idleTimeCheckSecs, dt, idletimeS);
-        
-        log_check_uart_active();        // so closes it if no logs being sent 
-        LPMgr_setLPMode(ctx->lpUserId, LP_DEEPSLEEP);
+        // else stay here till the next deadline
+        idleSleep(ctx, sleepS);
         // if enabled signal the device state (active or inactive)
         deviceStateIndicate();
         return SM_STATE_CURRENT;
     }
+    case ME_MOVED:
+    {
+        // Moving changes the idle time : maybe its already over
+        uint32_t sleepS = idleSleepSecs(ctx);
+        if (sleepS == 0)
+        {
+            return MS_GETTING_SERIAL_MODS;
+        }
+        idleSleep(ctx, sleepS);
+        return SM_STATE_CURRENT;
+    }
 
     case ME_FORCE_UL:
     {
@@ -689,9 +1342,147 @@ static SM_STATE_ID_t State_Idle(void *arg, int e, void *data)
         return SM_STATE_CURRENT;
     }
     }
-    assert(0); // shouldn't get here
+    assert(0); // shouldn't get here
+}
+// Share of space for a module among the n that want need[] bytes : those wanting less than an even share get it all,
+// the others share what is left evenly
+static uint16_t fairULShare(uint16_t space, uint16_t *need, int n, uint16_t mine)
+{
+    bool served[MAX_MODS] = {false};
+    int left = n;
+    bool changed = true;
+    while (changed && left > 0)
+    {
+        changed = false;
+        for (int i = 0; i < n; i++)
+        {
+            if (!served[i] && need[i] <= (space / left))
+            {
+                served[i] = true;
+                space -= need[i];
+                left--;
+                changed = true;
+            }
+        }
+    }
+    if (left == 0)
+    {
+        return mine;        // space for everyone
+    }
+    uint16_t level = space / left;
+    return (mine < level ? mine : level);
+}
+// UL space the module would like and its priority (those without a getULNeedCB want what they can get, at normal priority)
+static void modAskULNeed(struct appctx *ctx, int i)
+{
+    ctx->mods[i].ulPrio = APP_MOD_UL_PRIO_NORMAL;
+    ctx->mods[i].ulNeed = UINT16_MAX;
+    if (ctx->mods[i].api->getULNeedCB != NULL)
+    {
+        ctx->mods[i].ulNeed = (*(ctx->mods[i].api->getULNeedCB))(&ctx->mods[i].ulPrio);
+    }
+}
+// Get the module's data within its share of the space left : what the modules still to give theirs at a higher priority asked for
+// is kept for them, and the rest is shared with those of its priority
+static void modGetAllottedULData(struct appctx *ctx, int i)
+{
+    uint16_t space = app_core_msg_ul_getTotalSpaceAvailable(&ctx->txmsg);
+    uint16_t peers[MAX_MODS];
+    int np = 0;
+    for (int j = 0; j < ctx->nMods; j++)
+    {
+        if (j != i && !ctx->mods[j].ulDataPending)
+        {
+            continue;
+        }
+        if (ctx->mods[j].ulPrio > ctx->mods[i].ulPrio)
+        {
+            space -= (ctx->mods[j].ulNeed < space ? ctx->mods[j].ulNeed : space);
+        }
+        else if (ctx->mods[j].ulPrio == ctx->mods[i].ulPrio)
+        {
+            peers[np++] = ctx->mods[j].ulNeed;
+        }
+    }
+    uint16_t quota = fairULShare(space, peers, np, ctx->mods[i].ulNeed);
+    log_debug("AC:mod [%s] UL wants %d prio %d got %d of %d", ctx->mods[i].name, ctx->mods[i].ulNeed, ctx->mods[i].ulPrio, quota, space);
+    app_core_msg_ul_setQuota(&ctx->txmsg, quota);
+    ctx->ulIsCrit |= modGetULData(ctx, i);
+    app_core_msg_ul_setQuota(&ctx->txmsg, APP_CORE_UL_NO_QUOTA);
+    ctx->mods[i].ulDataPending = false;
+    ctx->mods[i].ulDataGot = true;
+}
+// Start every pending serial module that does not conflict with a running one, and set the state timer
+// for the first running module's timeout. Returns the number of modules running.
+static int scheduleSerialMods(struct appctx *ctx)
+{
+    int nRunning = 0;
+    for (int i = 0; i < ctx->nMods; i++)
+    {
+        if (ctx->mods[i].runState == MOD_RUN_RUNNING)
+        {
+            nRunning++;
+        }
+    }
+    for (int i = 0; i < ctx->nMods; i++)
+    {
+        if (ctx->mods[i].runState != MOD_RUN_PENDING)
+        {
+            continue;
+        }
+        bool canRun = true;
+        for (int j = 0; j < ctx->nMods && canRun; j++)
+        {
+            if (j != i && ctx->mods[j].runState == MOD_RUN_RUNNING && modsConflict(ctx, i, j))
+            {
+                canRun = false;
+            }
+        }
+        if (canRun)
+        {
+            uint32_t timeReqd = modStart(ctx, i);
+            // May return 0, which means no need for this module to run this time (no UL data)
+            if (timeReqd != 0)
+            {
+                ctx->mods[i].runState = MOD_RUN_RUNNING;
+                ctx->mods[i].runUntilMS = nowMS() + timeReqd;
+                nRunning++;
+                log_debug("AC:Smod [%s] for %d ms", ctx->mods[i].name, timeReqd);
+            }
+            else
+            {
+                ctx->mods[i].runState = MOD_RUN_NO;
+                ctx->mods[i].ulDataPending = false;
+                log_debug("AC:Smod [%s] says not this cycle", ctx->mods[i].name);
+            }
+        }
+    }
+    if (nRunning > 0)
+    {
+        uint64_t first = UINT64_MAX;
+        for (int i = 0; i < ctx->nMods; i++)
+        {
+            if (ctx->mods[i].runState == MOD_RUN_RUNNING && ctx->mods[i].runUntilMS < first)
+            {
+                first = ctx->mods[i].runUntilMS;
+            }
+        }
+        uint64_t now = nowMS();
+        sm_timer_start(ctx->mySMId, (first > now ? (uint32_t)(first - now) : 1));
+    }
+    return nRunning;
+}
+// Running serial module is done (or timed out) : get its data and stop it (before another module can use the resources it
+// shares, eg the BLE scanners' list)
+static void finishSerialMod(struct appctx *ctx, int i)
+{
+    modAskULNeed(ctx, i);
+    modGetAllottedULData(ctx, i);
+    modStop(ctx, i);
+    ctx->mods[i].runState = MOD_RUN_NO;
 }
-// Get all the modules that require to be executed in series
+// Get all the modules that must not be executed at the same time as a module using the same resources
+// Modules that don't conflict are run together, each until it says its done or its own timeout.
 static SM_STATE_ID_t State_GettingSerialMods(void *arg, int e, void *data)
 {
     struct appctx *ctx = (struct appctx *)arg;
@@ -700,9 +1491,27 @@ static SM_STATE_ID_t State_GettingSerialMods(void *arg, int e, void *data)
     {
     case SM_ENTER:
     {
+        smStatsEnter(MS_GETTING_SERIAL_MODS);
         ledStart(MYNEWT_VAL(MODS_ACTIVE_LED), FLASH_2HZ, -1);
-        // find first serial guy by sending ourselves the done event with idx=-1
-        ctx->currentSerialModIdx = -1;
+        for (int i = 0; i < ctx->nMods; i++)
+        {
+            ctx->mods[i].runState = MOD_RUN_NO;
+            ctx->mods[i].ulDataPending = false;
+            // Module is selected iff we are NOT explicitly requesting 1 module and its active, OR it is the one requested
+            if ((ctx->requestedModule < 0 && isModActive(ctx->modsMask, ctx->mods[i].id)) ||
+                (ctx->mods[i].id == ctx->requestedModule))
+            {
+                // all the selected ones say up front what UL space they would like, so the serial ones can get their data
+                // as they finish while leaving a share for those still to run
+                ctx->mods[i].ulDataPending = true;
+                modAskULNeed(ctx, i);
+                if (ctx->mods[i].exec == EXEC_SERIAL)
+                {
+                    ctx->mods[i].runState = MOD_RUN_PENDING;
+                }
+            }
+        }
+        // start first ones by sending ourselves the done event with no module
         sm_sendEvent(ctx->mySMId, ME_MODULE_DONE, NULL);
         // NOTE : the UL message is initialise when entering idle -> this lets any code that
         // executes during idle (eg on a tic) put their data in directly.
@@ -711,70 +1520,49 @@ static SM_STATE_ID_t State_GettingSerialMods(void *arg, int e, void *data)
     case SM_EXIT:
     {
         ledCancel(MYNEWT_VAL(MODS_ACTIVE_LED));
-        // Get data from active modules to build UL message
         return SM_STATE_CURRENT;
     }
     case SM_TIMEOUT:
     {
-        // Timeout is same as saying its done
-        if (ctx->currentSerialModIdx < 0)
+        // Timeout is same as saying its done, for every module whose time is up
+        uint64_t now = nowMS();
+        for (int i = 0; i < ctx->nMods; i++)
+        {
+            if (ctx->mods[i].runState == MOD_RUN_RUNNING && ctx->mods[i].runUntilMS <= now)
+            {
+                log_debug("AC:Smod [%s] timeout", ctx->mods[i].name);
+                finishSerialMod(ctx, i);
+            }
+        }
+        if (scheduleSerialMods(ctx) == 0)
         {
-            // no mod running, move on
+            // No more serial guys, go to parallels
             return MS_GETTING_PARALLEL_MODS;
         }
-        // drop thru with data set to id of running guy
-        data = (void *)(ctx->mods[ctx->currentSerialModIdx].id);
-        // !! DROP THRU INTENTIONAL !!
+        return SM_STATE_CURRENT;
     }
     case ME_MODULE_DONE:
     {
-        // get the id of the module what is done (the ID is the 'data' param's value)
-        // check its the one we're waiting for (if not first time)
-        if (ctx->currentSerialModIdx > 0)
+        // get the id of the module what is done (the ID is the 'data' param's value, NULL at start)
+        if (data != NULL)
         {
-            if ((int)data == ctx->mods[ctx->currentSerialModIdx].id)
+            int midx = findModuleById((int)data);
+            if (midx >= 0 && ctx->mods[midx].runState == MOD_RUN_RUNNING)
             {
-                //                log_debug("done Smod %d, id %d ", ctx->currentSerialModIdx, (int)data);
-                // Get the data
-                ctx->ulIsCrit |= (*(ctx->mods[ctx->currentSerialModIdx].api->getULDataCB))(&ctx->txmsg);
-                // stop any activity
-                (*(ctx->mods[ctx->currentSerialModIdx].api->stopCB))();
+                finishSerialMod(ctx, midx);
             }
             else
             {
-                log_warn("AC:Smod %d done but not active [%d]", (int)data, ctx->mods[ctx->currentSerialModIdx].id);
                 // this should not happen!
-                return MS_GETTING_PARALLEL_MODS;
+                log_warn("AC:Smod %d done but not active", (int)data);
             }
         }
-        // Find next serial one to run or goto parallels if all done
-        for (int i = (ctx->currentSerialModIdx + 1); i < ctx->nMods; i++)
+        if (scheduleSerialMods(ctx) == 0)
         {
-            // Module is selected iff we are NOT explicitly requesting 1 module and its active, OR it is the one requested
-            if ((ctx->requestedModule < 0 && isModActive(ctx->modsMask, ctx->mods[i].id)) ||
-                (ctx->mods[i].id == ctx->requestedModule))
-            {
-                if (ctx->mods[i].exec == EXEC_SERIAL)
-                {
-                    ctx->currentSerialModIdx = i;
-                    uint32_t timeReqd = (*(ctx->mods[i].api->startCB))();
-                    // May return 0, which means no need for this module to run this time (no UL data)
-                    if (timeReqd != 0)
-                    {
-                        // start timeout for current mod to get their data
-                        sm_timer_start(ctx->mySMId, timeReqd);
-                        log_debug("AC:Smod [%s] for %d ms", ctx->mods[i].name, timeReqd);
-                        return SM_STATE_CURRENT;
-                    }
-                    else
-                    {
-                        log_debug("AC:Smod [%s] says not this cycle", ctx->mods[i].name);
-                    }
-                }
-            }
+            // No more serial guys, go to parallels
+            return MS_GETTING_PARALLEL_MODS;
         }
-        // No more serial guys, go to parallels
-        return MS_GETTING_PARALLEL_MODS;
+        return SM_STATE_CURRENT;
     }
     default:
     {
@@ -784,7 +1572,112 @@ static SM_STATE_ID_t State_GettingSerialMods(void *arg, int e, void *data)
     }
     assert(0); // shouldn't get here
 }
+// The parallel modules get their data at the end of the data collection : they say what they would like now, then each one
+// in priority order gets its data within its share of the space left. In a priority the smallest needs are served first, so
+// what they leave of their share goes to the others.
+static void getAllottedULData(struct appctx *ctx)
+{
+    for (int i = 0; i < ctx->nMods; i++)
+    {
+        if (ctx->mods[i].ulDataPending)
+        {
+            modAskULNeed(ctx, i);
+        }
+    }
+    while (true)
+    {
+        // next is the pending one of the highest priority with the smallest need
+        int next = -1;
+        for (int i = 0; i < ctx->nMods; i++)
+        {
+            if (ctx->mods[i].ulDataPending &&
+                (next < 0 || ctx->mods[i].ulPrio > ctx->mods[next].ulPrio ||
+                 (ctx->mods[i].ulPrio == ctx->mods[next].ulPrio && ctx->mods[i].ulNeed < ctx->mods[next].ulNeed)))
+            {
+                next = i;
+            }
+        }
+        if (next < 0)
+        {
+            break;
+        }
+        modGetAllottedULData(ctx, next);
+        if (ctx->mods[next].exec == EXEC_PARALLEL)
+        {
+            modStop(ctx, next);
+        }
+    }
+}
+// Value the round's data must reach to be worth an UL : the configured one at the configured SF, scaled by the airtime
+// of a full block at the SF the UL would go at (cheaper when the link lets us go lower, dearer higher). Never more than
+// a single critical value.
+static uint16_t ulValueThreshold(struct appctx *ctx)
+{
+    if (ctx->ulValueMin == 0)
+    {
+        return 1;
+    }
+    uint8_t sz = APP_CORE_UL_MAX_SZ + LORAWAN_UL_OVERHEAD;
+    uint32_t thr = ((uint32_t)ctx->ulValueMin * loraTimeOnAirMS(ctx->txSF, sz)) / loraTimeOnAirMS(ctx->loraCfg.loraSF, sz);
+    return (thr < 1 ? 1 : (thr > APP_CORE_UL_VALUE_CRIT ? APP_CORE_UL_VALUE_CRIT : thr));
+}
+// End of parallel data collection : get data from active modules to build UL message, and decide if UL is to be sent
+static SM_STATE_ID_t endParallelMods(struct appctx *ctx)
+{
+    // Note that to mediate between modules that use same IOs eg I2C or UART (with UART selector)
+    // they should be "serial" type not parallel
+    for (int i = 0; i < ctx->nMods; i++)
+    {
+        // Module is selected iff we are NOT explicitly requesting 1 module and its active, OR it is the one requested
+        if ((ctx->requestedModule < 0 && isModActive(ctx->modsMask, ctx->mods[i].id)) ||
+            (ctx->mods[i].id == ctx->requestedModule))
+        {
+            if (ctx->mods[i].exec == EXEC_PARALLEL)
+            {
+                // its data is got (and it is stopped) below
+                ctx->mods[i].runState = MOD_RUN_NO;
+                ctx->mods[i].ulDataPending = true;
+            }
+        }
+    }
+    getAllottedULData(ctx);
+    // the SF the UL would go at sets what it costs
+    linkSelectSF(ctx);
+    // worth sending if the data the modules gave a value pays for the airtime
+    if (!ctx->ulIsCrit)
+    {
+        uint16_t value = app_core_msg_ul_getValue(&ctx->txmsg);
+        uint16_t thr = ulValueThreshold(ctx);
+        ctx->ulIsCrit = (value >= thr);
+        log_debug("AC:UL value %d for %d at SF%d : %s", value, thr, ctx->txSF, (ctx->ulIsCrit ? "send" : "not worth it"));
+    }
+    // critical to send it if been a while since last one
+    ctx->ulIsCrit |= ((TMMgr_getRelTimeSecs() - ctx->lastULTime) > (ctx->maxTimeBetweenULMins * 60));
+    // events the backend hasn't acked go to the backlog to be resent
+    app_core_msg_ul_appAck_round();
+    if (ctx->ulIsCrit)
+    {
+        // piggyback the state residency stats if its time (never worth an UL on its own)
+        if (ctx->smStatsULHours > 0 && (TMMgr_getRelTimeSecs() - ctx->lastSMStatsULTime) >= (ctx->smStatsULHours * 3600))
+        {
+            addSMStatsToUL(ctx);
+        }
+        addBootToULToUL(ctx);
+        return MS_SENDING_UL;
+    }
+    else if (app_core_msg_ul_backlog_count() > 0)
+    {
+        // Nothing new worth sending, but use the tx opportunity for the kept ones
+        log_debug("AC:no crit UL but %d in backlog", app_core_msg_ul_backlog_count());
+        return MS_SENDING_UL;
+    }
+    else
+    {
+        return MS_IDLE;
+    }
+}
 // Get all the modules that allow to be executed in parallel
+// Phase ends when every module that asked for time has said its done, or at the longest time asked for.
 static SM_STATE_ID_t State_GettingParallelMods(void *arg, int e, void *data)
 {
     struct appctx *ctx = (struct appctx *)arg;
@@ -793,19 +1686,26 @@ static SM_STATE_ID_t State_GettingParallelMods(void *arg, int e, void *data)
     {
     case SM_ENTER:
     {
+        smStatsEnter(MS_GETTING_PARALLEL_MODS);
         ledStart(MYNEWT_VAL(MODS_ACTIVE_LED), FLASH_2HZ, -1);
         uint32_t modtime = 0;
         // and tell mods to go for max timeout they require
         for (int i = 0; i < ctx->nMods; i++)
         {
             //                log_debug("Pmod %d for mask %x", ctx->mods[i].id,  ctx->modsMask[0]);
+            ctx->mods[i].runState = MOD_RUN_NO;
             // Module is selected iff we are NOT explicitly requesting 1 module and its active, OR it is the one requested
             if ((ctx->requestedModule < 0 && isModActive(ctx->modsMask, ctx->mods[i].id)) ||
                 (ctx->mods[i].id == ctx->requestedModule))
             {
                 if (ctx->mods[i].exec == EXEC_PARALLEL)
                 {
-                    uint32_t timeReqd = (*(ctx->mods[i].api->startCB))();
+                    uint32_t timeReqd = modStart(ctx, i);
+                    if (timeReqd > 0)
+                    {
+                        // running till it says its done (or timeout)
+                        ctx->mods[i].runState = MOD_RUN_RUNNING;
+                    }
                     if (timeReqd > modtime)
                     {
                         modtime = timeReqd;
@@ -834,34 +1734,27 @@ static SM_STATE_ID_t State_GettingParallelMods(void *arg, int e, void *data)
     }
     case SM_TIMEOUT:
     {
-        // Get data from active modules to build UL message
-        // Note that to mediate between modules that use same IOs eg I2C or UART (with UART selector)
-        // they should be "serial" type not parallel
-        for (int i = 0; i < ctx->nMods; i++)
+        return endParallelMods(ctx);
+    }
+    case ME_MODULE_DONE:
+    {
+        int midx = findModuleById((int)data);
+        if (midx >= 0 && ctx->mods[midx].runState == MOD_RUN_RUNNING)
         {
-            // Module is selected iff we are NOT explicitly requesting 1 module and its active, OR it is the one requested
-            if ((ctx->requestedModule < 0 && isModActive(ctx->modsMask, ctx->mods[i].id)) ||
-                (ctx->mods[i].id == ctx->requestedModule))
+            ctx->mods[midx].runState = MOD_RUN_NO;
+            for (int i = 0; i < ctx->nMods; i++)
             {
-                if (ctx->mods[i].exec == EXEC_PARALLEL)
+                if (ctx->mods[i].runState == MOD_RUN_RUNNING)
                 {
-                    // Get the data, and set the flag if module says the ul MUST be sent
-                    ctx->ulIsCrit |= (*(ctx->mods[i].api->getULDataCB))(&ctx->txmsg);
-                    // stop any activity
-                    (*(ctx->mods[i].api->stopCB))();
+                    // still waiting on someone
+                    return SM_STATE_CURRENT;
                 }
             }
+            log_debug("AC:all Pmods done early");
+            return endParallelMods(ctx);
         }
-        // critical to send it if been a while since last one
-        ctx->ulIsCrit |= ((TMMgr_getRelTimeSecs() - ctx->lastULTime) > (ctx->maxTimeBetweenULMins * 60));
-        if (ctx->ulIsCrit)
-        {
-            return MS_SENDING_UL;
-        }
-        else
-        {
-            return MS_IDLE;
-        }
+        log_debug("AC:Pmod %d done but not active", (int)data);
+        return SM_STATE_CURRENT;
     }
 
     default:
@@ -872,18 +1765,45 @@ static SM_STATE_ID_t State_GettingParallelMods(void *arg, int e, void *data)
     }
     assert(0); // shouldn't get here
 }
+// Tx the next UL : this round's messages (if it was worth sending) then the backlog ones, oldest first
 static LORA_TX_RESULT_t tryTX(struct appctx *ctx, bool willListen)
 {
-    uint8_t txsz = app_core_msg_ul_prepareNextTx(&ctx->txmsg, ctx->lastDLId, willListen);
+    uint8_t txsz = 0;
+    uint8_t* txp = NULL;
+    ctx->txIsBacklog = false;
+    if (ctx->ulIsCrit && app_core_msg_ul_hasNextTx(&ctx->txmsg))
+    {
+        APP_PROF(APP_PROF_CODEC_SITE(APP_PROF_UL_PREPARE),
+            txsz = app_core_msg_ul_prepareNextTx(&ctx->txmsg, ctx->lastDLId, willListen, loraMaxPayload(ctx)));
+        txp = app_core_msg_ul_getTxPayload(&ctx->txmsg);
+    }
+    if (txsz == 0 && !ctx->backlogTxFailed)
+    {
+        APP_PROF(APP_PROF_CODEC_SITE(APP_PROF_UL_BACKLOG_PREPARE), txsz = app_core_msg_ul_backlog_prepareTx(ctx->lastDLId, willListen));
+        txp = app_core_msg_ul_backlog_getTxPayload();
+        ctx->txIsBacklog = (txsz > 0);
+    }
+    ctx->txSz = txsz;
     LORA_TX_RESULT_t res = LORA_TX_ERR_RETRY;
     if (txsz > 0)
     {
-        LORAWAN_RESULT_t txres = lora_api_send(ctx->loraCfg.loraSF, ctx->loraCfg.txPort, ctx->loraCfg.useAck, willListen,
-                                               app_core_msg_ul_getTxPayload(&ctx->txmsg), txsz, lora_tx_cb, ctx);
+        LORAWAN_RESULT_t txres = lora_api_send(ctx->txSF, ctx->loraCfg.txPort, ctx->loraCfg.useAck, willListen,
+                                               txp, txsz, lora_tx_cb, ctx);
         if (txres == LORAWAN_RES_OK)
         {
             res = LORA_TX_OK;
-            log_info("AC:UL tx req SF %d, ack %d, listen %d, sz %d", ctx->loraCfg.loraSF, ctx->loraCfg.useAck, willListen, txsz);
+            useDutyCycle(ctx, ctx->txSF, txsz + LORAWAN_UL_OVERHEAD);
+            log_info("AC:UL tx req SF %d, ack %d, listen %d, sz %d%s", ctx->txSF, ctx->loraCfg.useAck, willListen, txsz, (ctx->txIsBacklog ? " (backlog)" : ""));
+        }
+        else if (txres == LORAWAN_RES_DUTYCYCLE || txres == LORAWAN_RES_NO_BW)
+        {
+            res = LORA_TX_ERR_DUTYCYCLE;
+            log_info("AC:UL tx refused for duty cycle");
+        }
+        else if (txres == LORAWAN_RES_NOT_JOIN)
+        {
+            res = LORA_TX_ERR_NOTJOIN;
+            log_warn("AC:no UL tx as not joined");
         }
         else
         {
@@ -898,6 +1818,145 @@ static LORA_TX_RESULT_t tryTX(struct appctx *ctx, bool willListen)
     }
     return res;
 }
+// Anything left to tx in this round?
+static bool haveULToSend(struct appctx *ctx)
+{
+    return ((ctx->ulIsCrit && app_core_msg_ul_hasNextTx(&ctx->txmsg)) ||
+            (!ctx->backlogTxFailed && app_core_msg_ul_backlog_count() > 0));
+}
+// The message we tried to tx didn't go : keep it in the backlog (a backlog one just stays there)
+static void keepFailedUL(struct appctx *ctx)
+{
+    if (ctx->txIsBacklog)
+    {
+        // don't keep trying the backlog this round
+        ctx->backlogTxFailed = true;
+    }
+    else
+    {
+        app_core_msg_ul_backlog_push(&ctx->txmsg);
+    }
+}
+// Leaving the UL state : keep the messages of this round that were not txd
+static void keepUnsentULs(struct appctx *ctx)
+{
+    if (ctx->ulIsCrit)
+    {
+        while (app_core_msg_ul_prepareNextTx(&ctx->txmsg, ctx->lastDLId, false, loraMaxPayload(ctx)) > 0)
+        {
+            app_core_msg_ul_backlog_push(&ctx->txmsg);
+        }
+    }
+}
+// The stack refused the tx for duty cycle although our budget said ok (eg it did a tx of its own) : go back to retry
+// the same message, assuming the band is busy for as long as this tx would have used it
+static void retryULLater(struct appctx *ctx)
+{
+    if (!ctx->txIsBacklog)
+    {
+        app_core_msg_ul_retry(&ctx->txmsg);
+    }
+    uint64_t retryAt = nowMS() + DUTYCYCLE_MIN_RETRY_MS;
+    uint64_t bandFree = nowMS() + (uint64_t)loraTimeOnAirMS(ctx->txSF, ctx->txSz + LORAWAN_UL_OVERHEAD) * DUTYCYCLE_DIV;
+    if (bandFree > retryAt)
+    {
+        retryAt = bandFree;
+    }
+    if (retryAt > ctx->bandFreeAtMS)
+    {
+        ctx->bandFreeAtMS = retryAt;
+    }
+}
+// All the ULs of the round went : tell the modules that gave data to it (once)
+static void ulSent(struct appctx *ctx)
+{
+    for (int i = 0; i < ctx->nMods; i++)
+    {
+        if (ctx->mods[i].ulDataGot && ctx->mods[i].api->ulSentCB != NULL)
+        {
+            (*(ctx->mods[i].api->ulSentCB))();
+        }
+        ctx->mods[i].ulDataGot = false;
+    }
+}
+// The listening UL of the round (its first) is txd ok : count the ones in a row that got no DL (it came in their RX windows,
+// so before the result). Nothing to do for the other ULs.
+static void listenDone(struct appctx *ctx)
+{
+    if (ctx->nbTxInRound != 1)
+    {
+        return;
+    }
+    if (ctx->dlInRound)
+    {
+        ctx->listensNoDL = 0;
+    }
+    else if (ctx->listensNoDL < 255)
+    {
+        ctx->listensNoDL++;
+    }
+}
+// Start the next tx of the round : now if the duty cycle budget allows it, else sleep till it does (unless that would
+// be after the end of the round). Returns the next state.
+static SM_STATE_ID_t nextTX(struct appctx *ctx)
+{
+    if (!haveULToSend(ctx))
+    {
+        log_debug("AC:all ULs done");
+        return MS_IDLE;
+    }
+    uint64_t now = nowMS();
+    if (ctx->bandFreeAtMS > now)
+    {
+        if (ctx->bandFreeAtMS > ctx->ulRoundEndMS)
+        {
+            log_info("AC:duty cycle wait %d ms too long, rest of ULs kept", (uint32_t)(ctx->bandFreeAtMS - now));
+            keepUnsentULs(ctx);
+            return MS_IDLE;
+        }
+        // Sleep (radio is idle after the RX windows) till the band is free
+        log_debug("AC:duty cycle wait %d ms", (uint32_t)(ctx->bandFreeAtMS - now));
+        ctx->txWaitBand = true;
+        sm_timer_start(ctx->mySMId, (uint32_t)(ctx->bandFreeAtMS - now));
+        ledCancel(MYNEWT_VAL(NET_ACTIVE_LED));
+        LPMgr_setLPMode(ctx->lpUserId, LP_DEEPSLEEP);
+        return SM_STATE_CURRENT;
+    }
+    LPMgr_setLPMode(ctx->lpUserId, LP_DOZE);
+    ledStart(MYNEWT_VAL(NET_ACTIVE_LED), FLASH_5HZ, -1);
+    // Only the 1st UL of the round says its listening : for the next ones, we haven't processed any RX yet, 
+    // so our 'lastDLId' is not up to date and we'll get a repeated action DL!
+    LORA_TX_RESULT_t res = tryTX(ctx, (ctx->nbTxInRound == 0));
+    switch (res)
+    {
+    case LORA_TX_OK:
+    {
+        ctx->nbTxInRound++;
+        // The stack gives the result once the RX windows are done. If it hasn't by the time they must have closed, no
+        // DL can arrive any more so don't hang around for it (unless acked, as the stack may be retrying)
+        sm_timer_start(ctx->mySMId, (ctx->loraCfg.useAck ? UL_WAIT_DL_TIMEOUTMS : loraRxWindowsEndMS(ctx, ctx->txSz + LORAWAN_UL_OVERHEAD)));
+        // ok wait for result
+        return SM_STATE_CURRENT;
+    }
+    case LORA_TX_ERR_DUTYCYCLE:
+    {
+        retryULLater(ctx);
+        return nextTX(ctx);
+    }
+    case LORA_TX_NO_TX:
+    {
+        return MS_IDLE;
+    }
+    default:
+    {
+        log_debug("AC:lora tx UL res %d, going idle", res);
+        keepFailedUL(ctx);
+        keepUnsentULs(ctx);
+        // And we're done
+        return MS_IDLE;
+    }
+    }
+}
 static SM_STATE_ID_t State_SendingUL(void *arg, int e, void *data)
 {
     struct appctx *ctx = (struct appctx *)arg;
@@ -906,22 +1965,24 @@ static SM_STATE_ID_t State_SendingUL(void *arg, int e, void *data)
     {
     case SM_ENTER:
     {
+        smStatsEnter(MS_SENDING_UL);
         log_debug("AC:trying to send UL");
-        // start leds for UL
-        ledStart(MYNEWT_VAL(NET_ACTIVE_LED), FLASH_5HZ, -1);
-        log_debug("UL has %d elements, sz %d %d %d %d", ctx->txmsg.msgNbFilling, ctx->txmsg.msgs[0].sz, ctx->txmsg.msgs[1].sz, ctx->txmsg.msgs[2].sz, ctx->txmsg.msgs[3].sz);
-        LORA_TX_RESULT_t res = tryTX(ctx, true);
-        if (res == LORA_TX_OK)
+        if (ctx->ulIsCrit)
         {
-            // this timer should be big enough to have received any DL triggered by the ULs
-            sm_timer_start(ctx->mySMId, UL_WAIT_DL_TIMEOUTMS);
-            // ok wait for result
+            // all the data is in : drop what the backend already has (if delta mode), then repack it into the fewest and shortest ULs for the SF
+            APP_PROF(APP_PROF_CODEC_SITE(APP_PROF_UL_DELTA), app_core_msg_ul_delta(&ctx->txmsg));
+            APP_PROF(APP_PROF_CODEC_SITE(APP_PROF_UL_PACK), app_core_msg_ul_pack(&ctx->txmsg, loraMaxPayload(ctx), ctx->txSF));
         }
-        else
+        log_debug("UL has %d blocks, sz %d %d %d %d...", ctx->txmsg.msgNbFilling+1, ctx->txmsg.msgs[0].sz, ctx->txmsg.msgs[1].sz, ctx->txmsg.msgs[2].sz, ctx->txmsg.msgs[3].sz);
+        ctx->nbTxInRound = 0;
+        ctx->dlInRound = false;
+        ctx->txWaitBand = false;
+        ctx->backlogTxFailed = false;
+        ctx->ulRoundEndMS = nowMS() + (MYNEWT_VAL(UL_ROUND_MAX_SECS) * 1000);
+        if (nextTX(ctx) != SM_STATE_CURRENT)
         {
             // want to abort immediately... send myself a result event
-            log_warn("AC:send UL tx failed %d", res);
-            sm_sendEvent(ctx->mySMId, ME_LORA_RESULT, (void *)res); // pass the code as the value not as a pointer
+            sm_sendEvent(ctx->mySMId, ME_LORA_RESULT, (void *)LORA_TX_NO_TX); // pass the code as the value not as a pointer
         }
         return SM_STATE_CURRENT;
     }
@@ -932,14 +1993,23 @@ static SM_STATE_ID_t State_SendingUL(void *arg, int e, void *data)
     }
     case SM_TIMEOUT:
     {
-        // Done , go idle
-        log_info("AC:stop UL send SM timeout");
+        if (ctx->txWaitBand)
+        {
+            // band is free for the next one
+            ctx->txWaitBand = false;
+            return nextTX(ctx);
+        }
+        // No tx result and the RX windows are closed : done , go idle
+        log_info("AC:stop UL send SM timeout, no tx result");
+        keepUnsentULs(ctx);
         return MS_IDLE;
     }
     case ME_LORA_RX:
     {
         if (data != NULL)
         {
+            ctx->dlInRound = true;
+            linkOnDL(ctx, (APP_CORE_DL_t *)data);
             executeDL(ctx, (APP_CORE_DL_t *)data);
         }
         return SM_STATE_CURRENT;
@@ -954,26 +2024,58 @@ static SM_STATE_ID_t State_SendingUL(void *arg, int e, void *data)
         case LORA_TX_OK_ACKD:
         {
             log_info("AC:tx : ACKD");
+            bootToULDone(ctx);
             ctx->lastULTime = TMMgr_getRelTimeSecs();
+            app_core_msg_ul_appAck_txOK();
+            if (ctx->txIsBacklog)
+            {
+                app_core_msg_ul_backlog_pop();
+            }
+            else if (app_core_msg_ul_txOK(&ctx->txmsg))
+            {
+                ulSent(ctx);
+            }
+            listenDone(ctx);
             break;
         }
         case LORA_TX_OK:
         {
             log_info("AC:tx : OK");
+            bootToULDone(ctx);
             ctx->lastULTime = TMMgr_getRelTimeSecs();
+            app_core_msg_ul_appAck_txOK();
+            if (ctx->txIsBacklog)
+            {
+                app_core_msg_ul_backlog_pop();
+            }
+            else if (app_core_msg_ul_txOK(&ctx->txmsg))
+            {
+                ulSent(ctx);
+            }
+            listenDone(ctx);
             break;
         }
         case LORA_TX_ERR_RETRY:
         {
             log_warn("AC:tx : fail:retry");
-            // Step back one in ULs so that next tryTx gets same one to retry
-            // TODO                    app_core_msg_ul_retry(&ctx->txmsg);
+            // Keep it for a later round
+            keepFailedUL(ctx);
+            linkOnTxFail(ctx);
+            break;
+        }
+        case LORA_TX_ERR_DUTYCYCLE:
+        {
+            log_info("AC:tx : refused for duty cycle, retry when band free");
+            retryULLater(ctx);
             break;
         }
         case LORA_TX_ERR_NOTJOIN:
         {
             // Retry join here? change the SF? TODO
             log_warn("AC:tx : fail : notJOIN?");
+            keepFailedUL(ctx);
+            linkOnTxFail(ctx);
+            keepUnsentULs(ctx);
             return MS_IDLE;
         }
         case LORA_TX_ERR_FATAL:
@@ -984,7 +2086,7 @@ static SM_STATE_ID_t State_SendingUL(void *arg, int e, void *data)
         }
         case LORA_TX_NO_TX:
         {
-            log_info("AC:tx initial no UL, going idle");
+            log_info("AC:tx no more UL, going idle");
             return MS_IDLE;
         }
         default:
@@ -993,23 +2095,8 @@ static SM_STATE_ID_t State_SendingUL(void *arg, int e, void *data)
             break; // fall out
         }
         }
-        // See if we have another msg to go. Note we say 'not listening' ie don't send me DL as we haven't
-        // processing any RX yet, so our 'lastDLId' is not up to date and we'll get a repeated action DL!
-        res = tryTX(ctx, false);
-        if (res == LORA_TX_OK)
-        {
-            // this timer should be big enough to have received any DL triggered by the ULs
-            sm_timer_start(ctx->mySMId, UL_WAIT_DL_TIMEOUTMS);
-            // ok wait for result
-            return SM_STATE_CURRENT;
-        }
-        else
-        {
-            log_debug("AC:lora tx UL res %d, going idle", res);
-            // TODO - if a ERR_RETRY, then get any unsent ULs and keep for next time to retry???? or have explicit state?
-            // And we're done
-            return MS_IDLE;
-        }
+        // See if we have another msg to go
+        return nextTX(ctx);
     }
     default:
     {
@@ -1047,22 +2134,17 @@ void app_core_start(int fwmaj, int fwmin, int fwbuild, const char *fwdate, const
     CFMgr_getOrAddElement(CFG_UTIL_KEY_HW_BASE_REV, &hwrev, sizeof(uint8_t));
     BSP_setHwVer(hwrev);
 
-    // Get the app core config, ensuring values are 'reasonable'
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_IDLE_TIME_MOVING_SECS, &_ctx.idleTimeMovingSecs, 0, 24 * 60 * 60);
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_IDLE_TIME_NOTMOVING_MINS, &_ctx.idleTimeNotMovingMins, 0, 24 * 60);
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_IDLE_TIME_INACTIVE_MINS, &_ctx.idleTimeInactiveMins, 5, 24*60);
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_IDLE_TIME_CHECK_SECS, &_ctx.idleTimeCheckSecs, 15, 5 * 60);
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_JOIN_TIMEOUT_SECS, &_ctx.joinTimeCheckSecs, 18, 30);
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_RETRY_JOIN_TIME_MINS, &_ctx.rejoinWaitMins, 1, 24 * 60);
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_RETRY_JOIN_TIME_SECS, &_ctx.rejoinWaitSecs, 15, 120);
+    // Get the app core config
     memset(&_ctx.modsMask[0], 0xff, MOD_MASK_SZ); // Default every module is active
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_MODS_ACTIVE_MASK, &_ctx.modsMask[0], MOD_MASK_SZ);
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_MAXTIME_UL_MINS, &_ctx.maxTimeBetweenULMins, 1, 24 * 60);
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_DL_ID, &_ctx.lastDLId, 0, 15);
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_STOCK_MODE, &_ctx.notStockMode, sizeof(uint8_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_DEVICE_ACTIVE, &_ctx.deviceActive, sizeof(uint8_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_ENABLE_DEVICE_STATE_LEDS, &_ctx.enableStateLeds, sizeof(uint8_t));
-    CFMgr_registerCB(configChangedCB); // For changes to our config
+    readConfig(NULL, CFG_KEY_ILLEGAL);
+    CFMgr_registerCB(configDispatchCB); // For all config changes, passed on to the subscribers
+    AppCore_subscribeConfig(CFGKEY(CFG_MODULE_APP_CORE, 0), CFGKEY(CFG_MODULE_APP_CORE, 0xFF), readConfig, NULL); // For changes to our config
+    // ready for anything added to the UL before the first round
+    initUL(&_ctx);
+    // ULs not sent before the reboot
+    app_core_msg_ul_backlog_init();
+    // Movement wakes us from idle (see State_Idle)
+    MMMgr_registerMovementCB(movedCB);
 
     registerActions();
     // register to be able to change LowPower mode (no callback as we don't care about lp changes...)
@@ -1087,6 +2169,7 @@ void app_core_start(int fwmaj, int fwmin, int fwbuild, const char *fwdate, const
     CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_LORA_SF, &_ctx.loraCfg.loraSF, LORAWAN_SF7, LORAWAN_SF_DEFAULT);
     CFMgr_getOrAddElementCheckRangeINT8(CFG_UTIL_KEY_LORA_TXPOWER, &_ctx.loraCfg.txPower, 0, 22);
     CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_LORA_TXPORT, &_ctx.loraCfg.txPort, 1, 255);
+    _ctx.txSF = _ctx.loraCfg.loraSF;
     if (_ctx.deviceConfigOk) {
         // Note the api wants the ids in init -> this means if user changes in AT then they need to reboot...
         lora_api_init(&_ctx.loraCfg.deveui[0], &_ctx.loraCfg.appeui[0], &_ctx.loraCfg.appkey[0], _ctx.loraCfg.useAdr, _ctx.loraCfg.loraSF, _ctx.loraCfg.txPower);
@@ -1103,7 +2186,7 @@ void app_core_start(int fwmaj, int fwmin, int fwbuild, const char *fwdate, const
     }
     // write fw config into PROM as config key so that it is accessible via AT command or DL action?
     // auto creates if 1st run
-    CFMgr_setElement(CFG_UTIL_KEY_FIRMWARE_INFO, &_ctx.fw, sizeof(_ctx.fw));
+    AppCore_setConfig(CFG_UTIL_KEY_FIRMWARE_INFO, &_ctx.fw, sizeof(_ctx.fw));
 
     // initialise console for use during idle periods if enabled
     if (MYNEWT_VAL(WCONSOLE_ENABLED) != 0)
@@ -1127,11 +2210,57 @@ APP_CORE_FW_t *AppCore_getFwInfo()
     return &_ctx.fw;
 }
 
+// State machine residency stats
+uint8_t AppCore_getNbStates()
+{
+    return MS_LAST;
+}
+const char* AppCore_getStateName(uint8_t sid)
+{
+    for (int i = 0; i < MS_LAST; i++)
+    {
+        if (_mySM[i].id == sid)
+        {
+            return _mySM[i].name;
+        }
+    }
+    return "NA";
+}
+bool AppCore_getStateStats(uint8_t sid, APP_CORE_STATE_STATS_t* st)
+{
+    if (sid >= MS_LAST || st == NULL)
+    {
+        return false;
+    }
+    *st = _smStats.st[sid];
+    // Include the ongoing stay in the current state
+    if (_smStats.current == sid)
+    {
+        uint32_t dwell = (uint32_t)(nowMS() - _smStats.enteredAtMS);
+        st->totalMS += dwell;
+        if (dwell > st->maxDwellMS)
+        {
+            st->maxDwellMS = dwell;
+        }
+    }
+    return true;
+}
+void AppCore_resetStateStats()
+{
+    memset(&_smStats.st[0], 0, sizeof(_smStats.st));
+    // restart the count from now in the current state
+    if (_smStats.current >= 0)
+    {
+        _smStats.enteredAtMS = nowMS();
+        _smStats.st[_smStats.current].nEntries = 1;
+    }
+}
+
 // core api for modules
 // Allow other code (modules) to change the active state of the device (eg via user input using buttons or shaking)
 void AppCore_setDeviceState(bool active) {
     _ctx.deviceActive = (active?1:0);
-    CFMgr_setElement(CFG_UTIL_KEY_DEVICE_ACTIVE, &_ctx.deviceActive, sizeof(uint8_t));
+    AppCore_setConfig(CFG_UTIL_KEY_DEVICE_ACTIVE, &_ctx.deviceActive, sizeof(uint8_t));
     if (_ctx.enableStateLeds) {
         if (active) {
             // Signal briefly we are active now
@@ -1146,16 +2275,21 @@ void AppCore_setDeviceState(bool active) {
 bool AppCore_isDeviceActive() {
     return (_ctx.deviceActive==1);
 }
+// Are the event TLVs app acked (and so resent by app-core until they are)?
+bool AppCore_isAppAckOn() {
+    return (_ctx.ulAppAck!=0);
+}
 // Enable or disable leds feedback about active/inactive state
 void AppCore_setStateLeds(bool enabled) {
     _ctx.enableStateLeds = (enabled?1:0);
-    CFMgr_setElement(CFG_UTIL_KEY_ENABLE_DEVICE_STATE_LEDS, &_ctx.enableStateLeds, sizeof(uint8_t));
+    AppCore_setConfig(CFG_UTIL_KEY_ENABLE_DEVICE_STATE_LEDS, &_ctx.enableStateLeds, sizeof(uint8_t));
 }
 // mcbs pointer must be to a static structure
 void AppCore_registerModule(const char * name, APP_MOD_ID_t id, APP_CORE_API_t *mcbs, APP_MOD_EXEC_t execType)
 {
-    assert(id < APP_MOD_LAST);
-    assert(_ctx.nMods < MAX_MODS);
+    // id must be < APP_MOD_NB, and only one module may register each id
+    assert(id >= 0 && id < MAX_MODS);
+    assert(_ctx.modIdx[id] == 0);
     assert(mcbs != NULL);
     assert(mcbs->startCB != NULL);
     assert(mcbs->stopCB != NULL);
@@ -1165,9 +2299,28 @@ void AppCore_registerModule(const char * name, APP_MOD_ID_t id, APP_CORE_API_t *
     _ctx.mods[_ctx.nMods].name = name;
     _ctx.mods[_ctx.nMods].id = id;
     _ctx.mods[_ctx.nMods].exec = execType;
+    _ctx.mods[_ctx.nMods].res = NULL;
     _ctx.nMods++;
+    _ctx.modIdx[id] = _ctx.nMods;
 //    log_debug("AC: add [%d=%s] exec[%d]", id, name, execType);
 }
+// res pointer must be to a static structure
+void AppCore_registerModuleResources(APP_MOD_ID_t id, APP_MOD_RESOURCES_t *res)
+{
+    int midx = findModuleById(id);
+    assert(midx >= 0);
+    assert(res != NULL);
+    _ctx.mods[midx].res = res;
+}
+APP_MOD_RESOURCES_t* AppCore_getModuleResources(APP_MOD_ID_t mid)
+{
+    int midx = findModuleById(mid);
+    if (midx >= 0)
+    {
+        return _ctx.mods[midx].res;
+    }
+    return NULL;
+}
 
 const char* AppCore_getModuleName(APP_MOD_ID_t mid) {
     int midx = findModuleById(mid);
@@ -1199,40 +2352,102 @@ void AppCore_setModuleState(APP_MOD_ID_t mid, bool active)
             _ctx.modsMask[mid / 8] &= ~(1 << (mid % 8));
         }
         // And writeback to PROM
-        CFMgr_setElement(CFG_UTIL_KEY_MODS_ACTIVE_MASK, &_ctx.modsMask[0], MOD_MASK_SZ);
+        AppCore_setConfig(CFG_UTIL_KEY_MODS_ACTIVE_MASK, &_ctx.modsMask[0], MOD_MASK_SZ);
+    }
+}
+
+// Config write-back
+static int cfgWBFind(uint16_t key) {
+    for(int i=0;i<_cfgWB.nDirty;i++) {
+        if (_cfgWB.slots[i].key==key) {
+            return i;
+        }
+    }
+    return -1;
+}
+// Set a config value : nothing is written if it is unchanged, else it is written (and the config change callbacks called) at the next commit
+bool AppCore_setConfig(uint16_t key, void* data, uint8_t len) {
+    int i = cfgWBFind(key);
+    if (i>=0) {
+        // already pending, just update it
+        if (_cfgWB.slots[i].len!=len) {
+            log_warn("AC:cfg %04x len %d but pending as %d", key, len, _cfgWB.slots[i].len);
+            return false;
+        }
+        memcpy(_cfgWB.slots[i].data, data, len);
+        return true;
+    }
+    int cl = CFMgr_getElementLen(key);
+    if (cl==len && len<=CFG_WB_CMP_MAX_LEN && CFMgr_getElement(key, _cfgWB.cmp, len)==len && memcmp(_cfgWB.cmp, data, len)==0) {
+        // unchanged
+        return true;
+    }
+    if (len>CFG_WB_MAX_LEN || _cfgWB.nDirty>=CFG_WB_SLOTS || (cl>=0 && cl!=len)) {
+        // can't hold it (or it will fail) : write through
+        return CFMgr_setElement(key, data, len);
+    }
+    i = _cfgWB.nDirty++;
+    _cfgWB.slots[i].key = key;
+    _cfgWB.slots[i].len = len;
+    memcpy(_cfgWB.slots[i].data, data, len);
+    return true;
+}
+// Get a config value, including any pending write
+int AppCore_getConfig(uint16_t key, void* data, uint8_t maxlen) {
+    int i = cfgWBFind(key);
+    if (i>=0) {
+        int l = (_cfgWB.slots[i].len < maxlen ? _cfgWB.slots[i].len : maxlen);
+        memcpy(data, _cfgWB.slots[i].data, l);
+        return l;
+    }
+    return CFMgr_getElement(key, data, maxlen);
+}
+// Write the pending config values to PROM
+void AppCore_commitConfig() {
+    // Each slot is freed before its write as the change callbacks may set config values (which are then also written here)
+    while(_cfgWB.nDirty>0) {
+        _cfgWB.nDirty--;
+        uint16_t key = _cfgWB.slots[_cfgWB.nDirty].key;
+        uint8_t len = _cfgWB.slots[_cfgWB.nDirty].len;
+        uint8_t data[CFG_WB_MAX_LEN];
+        memcpy(data, _cfgWB.slots[_cfgWB.nDirty].data, len);
+        if (!CFMgr_setElement(key, data, len)) {
+            log_warn("AC:cfg commit %04x fails", key);
+        }
     }
 }
 
+// Subscribe to changes of the config keys firstKey to lastKey (inclusive)
+// Note asserts if table is full
+void AppCore_subscribeConfig(uint16_t firstKey, uint16_t lastKey, APP_CORE_CFG_CBFN_t cb, void* ctx)
+{
+    assert(_cfgSubs.nSubs < MAX_CFG_SUBS);
+    assert(cb != NULL && firstKey <= lastKey);
+    _cfgSubs.subs[_cfgSubs.nSubs].firstKey = firstKey;
+    _cfgSubs.subs[_cfgSubs.nSubs].lastKey = lastKey;
+    _cfgSubs.subs[_cfgSubs.nSubs].cb = cb;
+    _cfgSubs.subs[_cfgSubs.nSubs].ctx = ctx;
+    _cfgSubs.nSubs++;
+}
+
 // register a DL action handler
 // Note asserts if id already registered, or table is full
 void AppCore_registerAction(uint8_t id, ACTIONFN_t cb)
 {
-    assert(_ctx.nActions < MAX_DL_ACTIONS);
+    int aidx = actionIdx(id);
+    // tag must be generic (< APP_CORE_DL_GENERIC_MAX) or app specific
+    assert(aidx >= 0);
     assert(cb != NULL);
     // Check noone else has registerd this
-    for (int i = 0; i < _ctx.nActions; i++)
-    {
-        if (_ctx.actions[i].id == id)
-        {
-            assert(0);
-        }
-    }
-    _ctx.actions[_ctx.nActions].id = id;
-    _ctx.actions[_ctx.nActions].fn = cb;
-    _ctx.nActions++;
+    assert(_ctx.actions[aidx] == NULL);
+    _ctx.actions[aidx] = cb;
 //    log_debug("AC: RA [%d]", id);
 }
 // Find action fn or NULL
 ACTIONFN_t AppCore_findAction(uint8_t id)
 {
-    for (int i = 0; i < _ctx.nActions; i++)
-    {
-        if (_ctx.actions[i].id == id)
-        {
-            return _ctx.actions[i].fn;
-        }
-    }
-    return NULL;
+    int aidx = actionIdx(id);
+    return (aidx >= 0 ? _ctx.actions[aidx] : NULL);
 }
 
 // Last UL sent time (relative, seconds)
@@ -1240,6 +2455,11 @@ uint32_t AppCore_lastULTime()
 {
     return _ctx.lastULTime;
 }
+// Time in ms from boot to the first UL that went out ok (0 if none yet)
+uint32_t AppCore_getBootToFirstULMS()
+{
+    return _ctx.bootToULMS;
+}
 // Time in ms to next UL
 uint32_t AppCore_getTimeToNextUL()
 {
@@ -1274,7 +2494,9 @@ static void executeDL(struct appctx *ctx, APP_CORE_DL_t *data)
     // Execute actions only if the dlid is not the last one we did, OR always if it is 0 (ie backend does not handle dlid)
     if ((data->dlId==0) || (data->dlId != ctx->lastDLId))
     {
-        if (app_core_msg_dl_execute(data))
+        bool executed;
+        APP_PROF(APP_PROF_CODEC_SITE(APP_PROF_DL_EXECUTE), executed = app_core_msg_dl_execute(data));
+        if (executed)
         {
             // If the id in the DL was 0, we don't update as this was not a 'controlled' case
             if (data->dlId!=0) {
@@ -1282,7 +2504,7 @@ static void executeDL(struct appctx *ctx, APP_CORE_DL_t *data)
                 // Can update last dl id since we did its actions
                 ctx->lastDLId = data->dlId;
                 // Store in case we reboot
-                CFMgr_setElement(CFG_UTIL_KEY_DL_ID, &ctx->lastDLId, sizeof(uint8_t));
+                AppCore_setConfig(CFG_UTIL_KEY_DL_ID, &ctx->lastDLId, sizeof(uint8_t));
             } else {
                 log_info("AC: exec DL id 0, current last dlId was %d", ctx->lastDLId);
             }
@@ -1305,7 +2527,7 @@ static void A_reboot(uint8_t *v, uint8_t l)
     if (l>0 && v[0]==1) {
         // Update to say we ARE in stock mode
         _ctx.notStockMode = 0;
-        CFMgr_setElement(CFG_UTIL_KEY_STOCK_MODE, &_ctx.notStockMode, 1);
+        AppCore_setConfig(CFG_UTIL_KEY_STOCK_MODE, &_ctx.notStockMode, 1);
     }
     // must wait till execute actions finished
     _ctx.doReboot = true;
@@ -1323,7 +2545,7 @@ static void A_setConfig(uint8_t *v, uint8_t l)
     uint8_t exlen = CFMgr_getElementLen(key);
     if (exlen == (l - 2))
     {
-        if (CFMgr_setElement(key, v + 2, l - 2))
+        if (AppCore_setConfig(key, v + 2, l - 2))
         {
             log_info("AC:action SETCONFIG (%04x) to %d len value OK", key, l - 2);
         }
@@ -1347,7 +2569,7 @@ static void A_getConfig(uint8_t *v, uint8_t l)
     // value is 2 bytes config id
     uint16_t key = Util_readLE_uint16_t(v, 2);
     uint8_t vb[20]; // 2 bytes key, 1 byte len, only allow to get keys up to 16 bytes..
-    int cl = CFMgr_getElement(key, &vb[3], 16);
+    int cl = AppCore_getConfig(key, &vb[3], 16);
     if (cl > 0)
     {
         log_info("AC:action GETCONFIG (%04x) value [", key);
@@ -1437,6 +2659,21 @@ static void A_settime(uint8_t *v, uint8_t l)
     // now should be epoch time
     TMMgr_setTimeSecs(now);
 }
+// Backend lost track of the values the delta ULs refer to
+static void A_ulResync(uint8_t *v, uint8_t l)
+{
+    log_info("AC:action UL RESYNC");
+    app_core_msg_ul_delta_resync();
+}
+// Backend got the ULs with these app ack sequence numbers (1 byte each)
+static void A_appAck(uint8_t *v, uint8_t l)
+{
+    log_info("AC:action APP ACK");
+    for (int i = 0; i < l; i++)
+    {
+        app_core_msg_ul_appAck_rx(v[i]);
+    }
+}
 // Return state of modules?
 static void A_getmods(uint8_t *v, uint8_t l)
 {
@@ -1453,4 +2690,6 @@ static void registerActions()
     AppCore_registerAction(APP_CORE_DL_FLASH_LED2, &A_flashled2);
     AppCore_registerAction(APP_CORE_DL_FOTA, &A_fota);
     AppCore_registerAction(APP_CORE_DL_GET_MODS, &A_getmods);
+    AppCore_registerAction(APP_CORE_DL_UL_RESYNC, &A_ulResync);
+    AppCore_registerAction(APP_CORE_DL_APP_ACK, &A_appAck);
 }
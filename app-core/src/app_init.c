@@ -20,6 +20,7 @@
 #include "wyres-generic/timemgr.h"
 #include "wyres-generic/rebootmgr.h"
 #include "wyres-generic/uartselector.h"
+#include "app-core/app_prof.h"
 
 /**
  *  create devices for app level. Called once base system is up, but before modules/core are initialised
@@ -46,5 +47,9 @@ void app_core_init(void) {
     log_info("app init - reset %04x, last assert at [0x%08x], res[%d]", 
         RMMgr_getResetReasonCode(), 
         RMMgr_getLastAssertCallerFn(), res);
+#if MYNEWT_VAL(APP_CORE_PROFILE)
+    // before the modules init, so their callbacks are counted from the start
+    app_prof_init();
+#endif
 
 }
@@ -19,10 +19,147 @@
 #include "os/os.h"
 
 #include "wyres-generic/wutils.h"
+#include "wyres-generic/configmgr.h"
+#include "wyres-generic/timemgr.h"
 #include "app-core/app_msg.h"
 #include "app-core/app_core.h"
+#include "app-core/app_prof.h"
 
 
+#define UL_BACKLOG_SZ MYNEWT_VAL(UL_BACKLOG_SZ)
+#if (UL_BACKLOG_SZ < 1 || UL_BACKLOG_SZ > APP_CORE_UL_BACKLOG_MAX)
+#error "UL_BACKLOG_SZ must be between 1 and APP_CORE_UL_BACKLOG_MAX"
+#endif
+// Backlog slot as saved in its config element
+typedef struct {
+    uint32_t seq;       // order in which they were saved, 0=free slot
+    uint8_t sz;
+    uint8_t payload[APP_CORE_UL_MAX_SZ];
+} UL_BACKLOG_SLOT_t;
+static struct {
+    uint32_t nextSeq;
+    UL_BACKLOG_SLOT_t slots[UL_BACKLOG_SZ];
+    uint32_t savedAt[UL_BACKLOG_SZ];     // secs since boot when saved, 0=saved before the last reboot
+    int8_t txSlot;                       // slot being txd, -1 if none
+    uint32_t txSeq;
+    uint8_t txbuf[APP_CORE_UL_MAX_SZ];
+} _backlog;
+
+// Compact TLV encoding : a TLV in the dictionary is replaced by its 1 byte code (no length as its fixed) then its fields, 
+// each one in the encoding given by the field string :
+//  'B' : 1 byte as is
+//  'I' : 4 bytes as is
+//  'u' : uint16 as a varint (LEB128 : 7 bits per byte, LSB first, b7 set if more follow)
+//  's' : int16 as a zigzag varint
+//  'z' : int32 as a zigzag varint
+//  'A' : uint32 timestamp (secs since boot) as the zigzag varint of its age at tx
+// Other TLVs are copied as is (their tag is never a dictionary code). Only used if its smaller than the TLV as is.
+// The dictionary is part of the protocol : never change an entry, only add new ones (up to 16, the codes reserved in APP_CORE_UL_TAGS).
+#define COMPACT_CODE_BASE (APP_CORE_UL_COMPACT_START)
+static const struct {
+    uint8_t tag;
+    uint8_t len;
+    const char* fields;
+} COMPACT_DICT[] = {
+    { APP_CORE_UL_ENV_MOVE, 4, "A" },
+    { APP_CORE_UL_ENV_FALL, 4, "A" },
+    { APP_CORE_UL_ENV_SHOCK, 4, "A" },
+    { APP_CORE_UL_GPS, 22, "BIIzzAB" },        // status, lat, lon, alt, prec, rxAt, nSats
+    { APP_CORE_UL_GPS, 1, "B" },                // status only
+    { APP_CORE_UL_VERSION, 8, "BBuI" },         // maj, min, build, target name hash
+    { APP_CORE_UL_ENV_TEMP, 2, "s" },
+    { APP_CORE_UL_ENV_PRESSURE, 4, "z" },
+    { APP_CORE_UL_ENV_BATTERY, 2, "u" },
+    { APP_CORE_UL_ENV_LIGHT, 1, "B" },
+    { APP_CORE_UL_ENV_HUMIDIT, 1, "B" },
+    { APP_CORE_UL_ENV_ORIENT, 4, "I" },
+    { APP_CORE_UL_ENV_NOISE, 6, "ABB" },        // time, freq, level
+    { APP_CORE_UL_BACKLOG_AGE, 2, "u" },
+};
+#define COMPACT_DICT_SZ (sizeof(COMPACT_DICT)/sizeof(COMPACT_DICT[0]))
+_Static_assert(COMPACT_DICT_SZ <= (APP_CORE_UL_APP_SPECIFIC_START - APP_CORE_UL_COMPACT_START), "compact codes must stay in their reserved tag range");
+static bool _compact = false;
+
+// Delta mode : only tags up to 63 (so they fit in an 8 byte mask). Never sent as unchanged : answers to DL requests, 
+// ack requests, and the backlog/delta info itself
+#define DELTA_MAX_TAG (63)
+#define DELTA_NEVER ((1ULL<<APP_CORE_UL_CONFIG) | (1ULL<<APP_CORE_UL_APP_ACK_REQ) | (1ULL<<APP_CORE_UL_BACKLOG_AGE) | (1ULL<<APP_CORE_UL_DELTA))
+#define FNV_INIT (2166136261UL)
+#define FNV_PRIME (16777619UL)
+static struct {
+    uint8_t resyncRounds;       // 0=delta mode off
+    uint8_t roundsSinceSync;
+    bool resyncReq;
+    uint64_t known;             // tags whose value (hash) as last sent is in hash[]
+    uint32_t hash[DELTA_MAX_TAG+1];
+    // The round being sent : its hashes become the reference at the next round, if its last UL went ok and none went to the backlog
+    // (an UL lost with no tx result is in neither case)
+    bool pending;
+    bool pendingIsSync;
+    bool pendingFailed;
+    bool pendingAllSent;
+    uint64_t pendingMask;
+    uint32_t pendingHash[DELTA_MAX_TAG+1];
+    // The TLVs removed from the round being sent : if its UL with the mask goes to the backlog they go with it (in full, as the
+    // mask would be resolved against the reference of when the backlog is sent)
+    uint16_t heldSz;
+    uint8_t held[APP_CORE_UL_MAX_NB * (APP_CORE_UL_MAX_SZ - 2)];
+} _delta = {
+    .resyncReq = true,      // nothing known after a reboot
+};
+
+// App level ack : the TLVs of events whose loss matters (button, enter/exit, contacts) are kept after the UL that carried
+// them was txd ok, until the backend acks its APP_CORE_UL_APP_ACK_REQ sequence number with an APP_CORE_DL_APP_ACK. The backend
+// can only answer in the RX of a listening UL (the first of each round) : if not acked after UL_APP_ACK_WAIT_ULS of them, they
+// alone are resent (as a backlog message with its own ack request), at most UL_APP_ACK_MAX_RESENDS times. Only tags up to 63.
+#define APP_ACK_MAX_TAG (63)
+#define APP_ACK_TAGS ((1ULL<<APP_CORE_UL_ENV_BUTTON) | (1ULL<<APP_CORE_UL_BLE_ENTER) | (1ULL<<APP_CORE_UL_BLE_EXIT) | \
+                      (1ULL<<APP_CORE_UL_BLE_PROX_ENTER) | (1ULL<<APP_CORE_UL_BLE_PROX_EXIT) | \
+                      (1ULL<<APP_CORE_UL_BLE_ENTER_LIST) | (1ULL<<APP_CORE_UL_BLE_EXIT_LIST))
+#define APP_ACK_REQ_SZ (2+1)
+// Kept TLVs per entry : what fits in a backlog message with its ack request (a bigger TLV is only sent once)
+#define APP_ACK_ENTRY_MAX_SZ (APP_CORE_UL_APP_ACK_TLV_MAX_SZ)
+#define APP_ACK_MAX_PENDING MYNEWT_VAL(UL_APP_ACK_MAX_PENDING)
+typedef struct {
+    bool used;
+    uint8_t seq;            // that the backend will ack
+    uint8_t listens;        // listening ULs since it was (re)sent, including its own
+    bool resending;         // resend is in the backlog, not txd yet
+    uint8_t resends;
+    uint8_t sz;
+    uint8_t tlvs[APP_ACK_ENTRY_MAX_SZ];
+} APP_ACK_ENTRY_t;
+static struct {
+    bool on;
+    uint8_t nextSeq;
+    // the UL being txd : its ack seq and the TLVs to keep if it goes
+    uint8_t txSeq;
+    bool txListen;
+    uint8_t txSz;           // its TLVs are in _scratch.ackTLVs
+    APP_ACK_ENTRY_t pending[APP_ACK_MAX_PENDING];
+} _appAck = {
+    .nextSeq = 1,
+};
+static bool pushBlock(uint8_t* payload, uint8_t sz);
+
+// Scratch area for the steps of an UL round that never run at the same time : the TLVs collected by pack and delta (at the
+// start of the round, before any tx), and the app ack TLVs of the UL being txd (from its prepareTx to its tx result, so
+// pack and delta drop them). Compact encoding works in place.
+#define PACK_MAX_TLVS (64)     // a round with more TLVs is not repacked, and is sent in full in delta mode
+static union {
+    struct {
+        uint8_t data[APP_CORE_UL_MAX_NB * (APP_CORE_UL_MAX_SZ - 2)];
+        struct {
+            uint16_t off;           // in data
+            uint8_t sz;             // TLV size including its TL
+            uint8_t bin;            // UL it goes in
+            uint8_t blk;            // block it goes in
+        } tlvs[PACK_MAX_TLVS];
+        uint8_t order[PACK_MAX_TLVS];         // by decreasing size
+        uint16_t binSz[APP_CORE_UL_MAX_NB];
+    } pack;
+    uint8_t ackTLVs[APP_CORE_UL_MAX_TX_SZ];
+} _scratch;
 
 // return true if parity is even, false if not for the given byte
 static bool evenParity(uint8_t d) {
@@ -39,14 +176,54 @@ void app_core_msg_ul_init(APP_CORE_UL_t* ul) {
     ul->msgNbFilling=0;     // which message are we currently filling in?
     ul->msbNbTxing=-1;      // which message are we currently txing: -1as we inc in prepareNextTx before starting
     ul->msgs[ul->msgNbFilling].sz = 2;     // skip header which we add later
+    ul->txFirst=0;
+    ul->maxRoundSz = APP_CORE_UL_MAX_NB * (APP_CORE_UL_MAX_SZ - 2);
+    ul->quotaEnd = APP_CORE_UL_NO_QUOTA;
+}
+void app_core_msg_ul_setMaxRoundSz(APP_CORE_UL_t* ul, uint16_t maxSz) {
+    assert(ul!=NULL);
+    ul->maxRoundSz = maxSz;
+}
+// bytes of data in all the blocks
+static uint16_t usedSz(APP_CORE_UL_t* ul) {
+    uint16_t used = 0;
+    for(int i=0;i<=ul->msgNbFilling;i++) {
+        used += (ul->msgs[i].sz - 2);
+    }
+    return used;
+}
+void app_core_msg_ul_setQuota(APP_CORE_UL_t* ul, uint16_t quota) {
+    assert(ul!=NULL);
+    if (quota==APP_CORE_UL_NO_QUOTA) {
+        ul->quotaEnd = APP_CORE_UL_NO_QUOTA;
+    } else {
+        ul->quotaEnd = usedSz(ul) + quota;
+    }
+}
+void app_core_msg_ul_addValue(APP_CORE_UL_t* ul, uint8_t v) {
+    assert(ul!=NULL);
+    ul->value += (v > APP_CORE_UL_VALUE_CRIT ? APP_CORE_UL_VALUE_CRIT : v);
+}
+uint16_t app_core_msg_ul_getValue(APP_CORE_UL_t* ul) {
+    assert(ul!=NULL);
+    return ul->value;
+}
+// bytes of data that can still be added before hitting the max for the round (or the current quota)
+static uint16_t roundSpaceLeft(APP_CORE_UL_t* ul) {
+    uint16_t used = usedSz(ul);
+    uint16_t max = (ul->quotaEnd < ul->maxRoundSz ? ul->quotaEnd : ul->maxRoundSz);
+    return (used < max ? (max - used) : 0);
 }
 // Add TLV into payload if possible
-bool app_core_msg_ul_addTLV(APP_CORE_UL_t* ul, uint8_t t, uint8_t l, void* v) {
+static bool ulAddTLV(APP_CORE_UL_t* ul, uint8_t t, uint8_t l, void* v) {
     assert(ul!=NULL);
     // Check if too big for message (taking into account header (2) and TL (2))
     if ((l+2+2) > APP_CORE_UL_MAX_SZ) {
         return NULL;        // this will never fit in any UL, sorry
     }
+    if ((l+2) > roundSpaceLeft(ul)) {
+        return false;
+    }
     if ((ul->msgs[ul->msgNbFilling].sz + l + 2) > APP_CORE_UL_MAX_SZ) {
         if ((ul->msgNbFilling+1)>= APP_CORE_UL_MAX_NB) {
             // out of messages, stay on this message one but say no joy for caller
@@ -67,12 +244,15 @@ bool app_core_msg_ul_addTLV(APP_CORE_UL_t* ul, uint8_t t, uint8_t l, void* v) {
     return true;
 }
 // Add TL and return pointer to V space unless too full
-uint8_t* app_core_msg_ul_addTLgetVP(APP_CORE_UL_t* ul, uint8_t t, uint8_t l) {
+static uint8_t* ulAddTLgetVP(APP_CORE_UL_t* ul, uint8_t t, uint8_t l) {
     assert(ul!=NULL);
     // Check if too big for message (taking into account header (2) and TL (2))
     if ((l+2+2) > APP_CORE_UL_MAX_SZ) {
         return NULL;        // this will never fit in any UL, sorry
     }
+    if ((l+2) > roundSpaceLeft(ul)) {
+        return NULL;
+    }
     if ((ul->msgs[ul->msgNbFilling].sz + l + 2) > APP_CORE_UL_MAX_SZ) {
         if ((ul->msgNbFilling+1)>= APP_CORE_UL_MAX_NB) {
             // out of messages, stay on this message one but say no joy for caller
@@ -87,6 +267,17 @@ uint8_t* app_core_msg_ul_addTLgetVP(APP_CORE_UL_t* ul, uint8_t t, uint8_t l) {
     ul->msgs[ul->msgNbFilling].sz+=l;
     return vp;
 }
+// The TLV adds are where the modules' getULData time goes, so they are profiled
+bool app_core_msg_ul_addTLV(APP_CORE_UL_t* ul, uint8_t t, uint8_t l, void* v) {
+    bool ret;
+    APP_PROF(APP_PROF_CODEC_SITE(APP_PROF_UL_ADDTLV), ret = ulAddTLV(ul, t, l, v));
+    return ret;
+}
+uint8_t* app_core_msg_ul_addTLgetVP(APP_CORE_UL_t* ul, uint8_t t, uint8_t l) {
+    uint8_t* ret;
+    APP_PROF(APP_PROF_CODEC_SITE(APP_PROF_UL_ADDTLV), ret = ulAddTLgetVP(ul, t, l));
+    return ret;
+}
 // get the max continugous data block we know how to send in UL
 uint8_t app_core_msg_ul_maxBlockSz() {
     return (APP_CORE_UL_MAX_SZ - 2);        // coz header
@@ -94,57 +285,793 @@ uint8_t app_core_msg_ul_maxBlockSz() {
 
 // Return number of bytes still available in this UL
 uint8_t app_core_msg_ul_remainingSz(APP_CORE_UL_t* ul) {
-    return (APP_CORE_UL_MAX_SZ - ul->msgs[ul->msgNbFilling].sz);
+    uint16_t left = roundSpaceLeft(ul);
+    uint8_t ret = (APP_CORE_UL_MAX_SZ - ul->msgs[ul->msgNbFilling].sz);
+    return (left < ret ? left : ret);
 }
 // Total space in all ULs left?
 uint8_t app_core_msg_ul_getTotalSpaceAvailable(APP_CORE_UL_t* ul) {
-    return app_core_msg_ul_remainingSz(ul) + 
+    uint16_t ret = (APP_CORE_UL_MAX_SZ - ul->msgs[ul->msgNbFilling].sz) + 
             ((APP_CORE_UL_MAX_NB - (ul->msgNbFilling+1)) * app_core_msg_ul_maxBlockSz());
+    uint16_t left = roundSpaceLeft(ul);
+    if (left < ret) {
+        ret = left;
+    }
+    return (ret > 255 ? 255 : ret);
 }
 
 // Force switch to next UL, and return number of bytes allowed in it
 // returns 0 if no more ULs available... (and does NOT switch in this case in case someelse wants to use them)
 uint8_t app_core_msg_ul_requestNextUL(APP_CORE_UL_t* ul) {
     // If incrementing takes us beyond end, don't and return 0
-    if ((ul->msgNbFilling+1)>= APP_CORE_UL_MAX_NB) {
+    if ((ul->msgNbFilling+1)>= APP_CORE_UL_MAX_NB || roundSpaceLeft(ul)==0) {
         return 0;
     }
     ul->msgNbFilling++;
     ul->msgs[ul->msgNbFilling].sz = 2;     // skip header which we add later
-    return (APP_CORE_UL_MAX_SZ - ul->msgs[ul->msgNbFilling].sz);
+    return app_core_msg_ul_remainingSz(ul);
 }
 
 // Step back a UL message in the current tx set so that next call to prepareNextTx will retry it
 void app_core_msg_ul_retry(APP_CORE_UL_t* ul) {
-    // we set the 'currently txing' index to 1 less so that the next call to prepareNext will get the same one (as it incs the index)
+    // we set the 'currently txing' index to before the first block of the UL so that the next call to prepareNext will get the same one (as it incs the index)
     if (ul->msbNbTxing>-1) {
-        ul->msbNbTxing--;
+        ul->msbNbTxing = ul->txFirst-1;
     }
 }
 
+// Write the UL header for a message of sz bytes
+static void setULHeader(uint8_t* payload, uint8_t sz, uint8_t lastDLId, bool willListen, uint8_t version) {
+    // 2 byte fixed header: 
+    //	0 : b0-3: ULrespid, b4-5: protocol version, b6: 1=listening for DL, 0=not listening, b7: force even parity for this byte
+    //	1 : length of following TLV block
+    //	- allows backend to reliably (mostly) detect this type of message - if 1st byte parity=0 and 2nd byte value+2=message length then its probably this format....
+    //	- 00 00 is the most basic valid message
+    payload[0] = (lastDLId & 0x0f) | ((version & 0x03)<<4) | (willListen?0x40:0x00);
+    if (!evenParity(payload[0])) {
+        payload[0] |= 0x80;        // not even, add parity bit
+    }
+    payload[1] = sz-2;      // length of the TLV section
+}
+// Time on air in 1/4 symbols (Semtech AN1200.13 : BW 125kHz, CR 4/5, 8 symbol preamble, explicit header, CRC on)
+uint32_t app_core_msg_loraQSymbols(uint8_t sf, uint8_t phySz) {
+    int de = (sf >= 11 ? 1 : 0); // low data rate optimise
+    int num = 8 * phySz - 4 * sf + 28 + 16;
+    int den = 4 * (sf - 2 * de);
+    int nPayload = 8 + (num > 0 ? ((num + den - 1) / den) * 5 : 0);
+    return 49 + (nPayload * 4);     // preamble is 12.25 symbols
+}
+// Cost of an UL with sz bytes of TLVs (0 if no UL)
+static uint32_t ulCost(uint16_t sz, uint8_t sf) {
+    return (sz>0 ? app_core_msg_loraQSymbols(sf, sz + 2 + LORAWAN_UL_OVERHEAD) : 0);
+}
+static uint8_t clampTxSz(uint8_t maxTxSz) {
+    if (maxTxSz < APP_CORE_UL_MAX_SZ) {
+        return APP_CORE_UL_MAX_SZ;       // a block always fits
+    }
+    if (maxTxSz > APP_CORE_UL_MAX_TX_SZ) {
+        return APP_CORE_UL_MAX_TX_SZ;
+    }
+    return maxTxSz;
+}
+// TLVs in decreasing size order for first fit decreasing
+static void sortTLVs(int n, uint8_t* order) {
+    for(int i=0;i<n;i++) {
+        order[i] = i;
+    }
+    for(int i=1;i<n;i++) {
+        uint8_t o = order[i];
+        int j = i-1;
+        while(j>=0 && _scratch.pack.tlvs[order[j]].sz < _scratch.pack.tlvs[o].sz) {
+            order[j+1] = order[j];
+            j--;
+        }
+        order[j+1] = o;
+    }
+}
+bool app_core_msg_ul_pack(APP_CORE_UL_t* ul, uint8_t maxTxSz, uint8_t sf) {
+    assert(ul!=NULL);
+    if (ul->msbNbTxing!=-1) {
+        return false;       // already txing
+    }
+    uint16_t binMax = clampTxSz(maxTxSz) - 2;
+    _appAck.txSz = 0;
+    // Collect the TLVs, and the cost of the ULs as prepareNextTx would make them from the current blocks
+    int n = 0;
+    uint16_t dsz = 0;
+    uint32_t curCost = 0;
+    uint16_t curSz = 0;
+    for(int b=0;b<=ul->msgNbFilling;b++) {
+        uint8_t bsz = ul->msgs[b].sz - 2;
+        if ((b>0 && ul->msgs[b].newTx) || (curSz + bsz) > binMax) {
+            curCost += ulCost(curSz, sf);
+            curSz = 0;
+        }
+        curSz += bsz;
+        for(int off=2; off < ul->msgs[b].sz; ) {
+            uint8_t tsz = ul->msgs[b].payload[off+1] + 2;
+            assert((off + tsz) <= ul->msgs[b].sz);
+            if (n >= PACK_MAX_TLVS) {
+                return false;       // too many to reorder, keep it as it is
+            }
+            memcpy(&_scratch.pack.data[dsz], &ul->msgs[b].payload[off], tsz);
+            _scratch.pack.tlvs[n].off = dsz;
+            _scratch.pack.tlvs[n].sz = tsz;
+            dsz += tsz;
+            off += tsz;
+            n++;
+        }
+    }
+    curCost += ulCost(curSz, sf);
+    if (n<2) {
+        return false;       // nothing to reorder
+    }
+    // First fit decreasing into ULs of binMax
+    uint8_t* order = &_scratch.pack.order[0];
+    sortTLVs(n, order);
+    int nbins = 0;
+    memset(_scratch.pack.binSz, 0, sizeof(_scratch.pack.binSz));
+    for(int i=0;i<n;i++) {
+        int t = order[i];
+        int b = 0;
+        while(b<nbins && (_scratch.pack.binSz[b] + _scratch.pack.tlvs[t].sz) > binMax) {
+            b++;
+        }
+        if (b>=APP_CORE_UL_MAX_NB) {
+            return false;
+        }
+        if (b==nbins) {
+            nbins++;
+        }
+        _scratch.pack.tlvs[t].bin = b;
+        _scratch.pack.binSz[b] += _scratch.pack.tlvs[t].sz;
+    }
+    // Then move single TLVs between ULs while it lowers the time on air (its a step function of the size so the fill matters)
+    bool moved = true;
+    for(int pass=0; moved && pass<8; pass++) {
+        moved = false;
+        for(int t=0;t<n;t++) {
+            uint8_t from = _scratch.pack.tlvs[t].bin;
+            uint8_t tsz = _scratch.pack.tlvs[t].sz;
+            for(int b=0;b<nbins;b++) {
+                if (b==from || _scratch.pack.binSz[b]==0 || (_scratch.pack.binSz[b] + tsz) > binMax) {
+                    continue;
+                }
+                uint32_t before = ulCost(_scratch.pack.binSz[from], sf) + ulCost(_scratch.pack.binSz[b], sf);
+                uint32_t after = ulCost(_scratch.pack.binSz[from] - tsz, sf) + ulCost(_scratch.pack.binSz[b] + tsz, sf);
+                if (after < before) {
+                    _scratch.pack.binSz[from] -= tsz;
+                    _scratch.pack.binSz[b] += tsz;
+                    _scratch.pack.tlvs[t].bin = b;
+                    from = b;
+                    moved = true;
+                }
+            }
+        }
+    }
+    uint32_t newCost = 0;
+    for(int b=0;b<nbins;b++) {
+        newCost += ulCost(_scratch.pack.binSz[b], sf);
+    }
+    if (newCost >= curCost) {
+        return false;
+    }
+    // Lay each UL out in blocks (first fit decreasing again, as a TLV can't be split over 2 blocks)
+    uint8_t blkSz[APP_CORE_UL_MAX_NB];
+    uint8_t blkBin[APP_CORE_UL_MAX_NB];
+    int nblks = 0;
+    for(int b=0;b<nbins;b++) {
+        int first = nblks;
+        for(int i=0;i<n;i++) {
+            int t = order[i];
+            if (_scratch.pack.tlvs[t].bin!=b) {
+                continue;
+            }
+            int k = first;
+            while(k<nblks && (blkSz[k] + _scratch.pack.tlvs[t].sz) > (APP_CORE_UL_MAX_SZ - 2)) {
+                k++;
+            }
+            if (k>=APP_CORE_UL_MAX_NB) {
+                return false;       // doesn't fit in the blocks, keep it as it is
+            }
+            if (k==nblks) {
+                blkSz[k] = 0;
+                blkBin[k] = b;
+                nblks++;
+            }
+            _scratch.pack.tlvs[t].blk = k;
+            blkSz[k] += _scratch.pack.tlvs[t].sz;
+        }
+    }
+    for(int k=0;k<nblks;k++) {
+        ul->msgs[k].sz = 2;
+        ul->msgs[k].newTx = (k==0 || blkBin[k]!=blkBin[k-1]);
+    }
+    for(int t=0;t<n;t++) {
+        uint8_t k = _scratch.pack.tlvs[t].blk;
+        memcpy(&ul->msgs[k].payload[ul->msgs[k].sz], &_scratch.pack.data[_scratch.pack.tlvs[t].off], _scratch.pack.tlvs[t].sz);
+        ul->msgs[k].sz += _scratch.pack.tlvs[t].sz;
+    }
+    for(int k=nblks;k<=ul->msgNbFilling;k++) {
+        ul->msgs[k].sz = 0;
+        ul->msgs[k].newTx = false;
+    }
+    ul->msgNbFilling = nblks-1;
+    log_debug("AC:UL repacked %d TLVs in %d ULs, airtime %d->%d qsyms", n, nbins, curCost, newCost);
+    return true;
+}
+// Delta mode
+void app_core_msg_ul_setDelta(uint8_t resyncRounds) {
+    if (resyncRounds!=_delta.resyncRounds) {
+        _delta.resyncRounds = resyncRounds;
+        _delta.resyncReq = true;
+    }
+}
+void app_core_msg_ul_delta_resync() {
+    _delta.resyncReq = true;
+}
+static uint32_t fnv1a(uint32_t h, uint8_t* d, int n) {
+    for(int i=0;i<n;i++) {
+        h = (h ^ d[i]) * FNV_PRIME;
+    }
+    return h;
+}
+// The last round becomes the reference if all its ULs went, else all is sent in full next time
+static void deltaCommit() {
+    if (!_delta.pending) {
+        return;
+    }
+    _delta.pending = false;
+    if (_delta.pendingFailed || !_delta.pendingAllSent) {
+        _delta.resyncReq = true;
+        return;
+    }
+    if (_delta.pendingIsSync) {
+        _delta.known = 0;
+    }
+    for(int t=0;t<=DELTA_MAX_TAG;t++) {
+        if (_delta.pendingMask & (1ULL<<t)) {
+            _delta.hash[t] = _delta.pendingHash[t];
+        }
+    }
+    _delta.known |= _delta.pendingMask;
+}
+// Lay the TLVs collected in _scratch.pack out in the blocks one after the other (except those with a tag in skip), after the TLV first if not NULL
+static bool layoutTLVs(APP_CORE_UL_t* ul, int n, uint64_t skip, uint8_t* first, uint8_t firstSz) {
+    int b = 0;
+    ul->msgs[0].sz = 2;
+    ul->msgs[0].newTx = false;
+    if (first!=NULL) {
+        memcpy(&ul->msgs[0].payload[2], first, firstSz);
+        ul->msgs[0].sz += firstSz;
+    }
+    for(int i=0;i<n;i++) {
+        uint8_t* tlv = &_scratch.pack.data[_scratch.pack.tlvs[i].off];
+        if (tlv[0]<=DELTA_MAX_TAG && (skip & (1ULL<<tlv[0]))) {
+            continue;
+        }
+        if ((ul->msgs[b].sz + _scratch.pack.tlvs[i].sz) > APP_CORE_UL_MAX_SZ) {
+            if ((b+1)>=APP_CORE_UL_MAX_NB) {
+                return false;
+            }
+            b++;
+            ul->msgs[b].sz = 2;
+            ul->msgs[b].newTx = false;
+        }
+        memcpy(&ul->msgs[b].payload[ul->msgs[b].sz], tlv, _scratch.pack.tlvs[i].sz);
+        ul->msgs[b].sz += _scratch.pack.tlvs[i].sz;
+    }
+    for(int k=b+1;k<=ul->msgNbFilling;k++) {
+        ul->msgs[k].sz = 0;
+    }
+    ul->msgNbFilling = b;
+    return true;
+}
+bool app_core_msg_ul_delta(APP_CORE_UL_t* ul) {
+    assert(ul!=NULL);
+    if (_delta.resyncRounds==0 || ul->msbNbTxing!=-1) {
+        return false;
+    }
+    deltaCommit();
+    _delta.heldSz = 0;
+    _appAck.txSz = 0;
+    // Collect the TLVs, and hash the value(s) of each tag in this round (all of them, even if too many to collect)
+    int n = 0;
+    bool tooMany = false;
+    uint16_t dsz = 0;
+    _delta.pendingMask = 0;
+    for(int b=0;b<=ul->msgNbFilling;b++) {
+        for(int off=2; off < ul->msgs[b].sz; ) {
+            uint8_t t = ul->msgs[b].payload[off];
+            uint8_t tsz = ul->msgs[b].payload[off+1] + 2;
+            assert((off + tsz) <= ul->msgs[b].sz);
+            if (t<=DELTA_MAX_TAG && (DELTA_NEVER & (1ULL<<t))==0) {
+                if ((_delta.pendingMask & (1ULL<<t))==0) {
+                    _delta.pendingMask |= (1ULL<<t);
+                    _delta.pendingHash[t] = FNV_INIT;
+                }
+                // length is hashed too, and a tag present more than once is unchanged only if all its TLVs are
+                _delta.pendingHash[t] = fnv1a(_delta.pendingHash[t], &ul->msgs[b].payload[off+1], tsz-1);
+            }
+            if (n < PACK_MAX_TLVS) {
+                memcpy(&_scratch.pack.data[dsz], &ul->msgs[b].payload[off], tsz);
+                _scratch.pack.tlvs[n].off = dsz;
+                _scratch.pack.tlvs[n].sz = tsz;
+                dsz += tsz;
+                n++;
+            } else {
+                tooMany = true;
+            }
+            off += tsz;
+        }
+    }
+    _delta.pending = true;
+    _delta.pendingFailed = false;
+    _delta.pendingAllSent = false;
+    _delta.pendingIsSync = false;
+    if (_delta.resyncReq || (_delta.roundsSinceSync+1) >= _delta.resyncRounds) {
+        // Full resync : all is sent as is. No marker for it, as the backend can tell from the frame counter when it has
+        // missed ULs, and ask for a resync if it has
+        _delta.roundsSinceSync = 0;
+        _delta.resyncReq = false;
+        _delta.pendingIsSync = true;
+        log_debug("AC:UL delta resync");
+        return false;
+    }
+    _delta.roundsSinceSync++;
+    if (tooMany) {
+        return false;       // sent in full, its hashes are still the reference for the next round
+    }
+    uint64_t unchanged = (_delta.pendingMask & _delta.known);
+    for(int t=0;t<=DELTA_MAX_TAG;t++) {
+        if ((unchanged & (1ULL<<t)) && _delta.pendingHash[t]!=_delta.hash[t]) {
+            unchanged &= ~(1ULL<<t);
+        }
+    }
+    if (unchanged==0) {
+        return false;
+    }
+    // Delta TLV : the mask of the unchanged tags (LE, only up to the highest byte used)
+    uint8_t dtlv[2+8];
+    uint8_t ml = 8;
+    while(ml>1 && ((unchanged >> ((ml-1)*8)) & 0xff)==0) {
+        ml--;
+    }
+    dtlv[0] = APP_CORE_UL_DELTA;
+    dtlv[1] = ml;
+    for(int i=0;i<ml;i++) {
+        dtlv[2+i] = (unchanged >> (i*8)) & 0xff;
+    }
+    uint16_t saved = 0;
+    for(int i=0;i<n;i++) {
+        uint8_t t = _scratch.pack.data[_scratch.pack.tlvs[i].off];
+        if (t<=DELTA_MAX_TAG && (unchanged & (1ULL<<t))) {
+            saved += _scratch.pack.tlvs[i].sz;
+        }
+    }
+    if (saved <= (2+ml)) {
+        return false;       // not worth it
+    }
+    if (!layoutTLVs(ul, n, unchanged, dtlv, 2+ml)) {
+        // Can't happen as its smaller than before, but put it back as it was just in case (all of it fits as it did before)
+        layoutTLVs(ul, n, 0, NULL, 0);
+        return false;
+    }
+    for(int i=0;i<n;i++) {
+        uint8_t t = _scratch.pack.data[_scratch.pack.tlvs[i].off];
+        if (t<=DELTA_MAX_TAG && (unchanged & (1ULL<<t))) {
+            memcpy(&_delta.held[_delta.heldSz], &_scratch.pack.data[_scratch.pack.tlvs[i].off], _scratch.pack.tlvs[i].sz);
+            _delta.heldSz += _scratch.pack.tlvs[i].sz;
+        }
+    }
+    log_debug("AC:UL delta %d bytes saved, unchanged tags %08x%08x", saved-(2+ml), (uint32_t)(unchanged>>32), (uint32_t)unchanged);
+    return true;
+}
+void app_core_msg_ul_setCompact(bool on) {
+    _compact = on;
+}
+static int putVarint(uint8_t* b, int off, uint32_t v) {
+    do {
+        b[off++] = (v & 0x7f) | (v>0x7f ? 0x80 : 0x00);
+        v >>= 7;
+    } while(v>0);
+    return off;
+}
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+static int findCompactCode(uint8_t t, uint8_t l) {
+    for(int i=0;i<COMPACT_DICT_SZ;i++) {
+        if (COMPACT_DICT[i].tag==t && COMPACT_DICT[i].len==l) {
+            return i;
+        }
+    }
+    return -1;
+}
+// Compact encode the value v of dictionary entry d into out. Returns size written (at most 1+(5*len/4)+1)
+static int encodeCompact(int d, uint8_t* v, uint8_t* out, uint32_t now) {
+    int o = 0;
+    int vi = 0;
+    out[o++] = COMPACT_CODE_BASE + d;
+    for(const char* f=COMPACT_DICT[d].fields; *f!='\0'; f++) {
+        switch(*f) {
+            case 'B': out[o++] = v[vi++]; break;
+            case 'I': memcpy(&out[o], &v[vi], 4); o+=4; vi+=4; break;
+            case 'u': o = putVarint(out, o, Util_readLE_uint16_t(&v[vi], 2)); vi+=2; break;
+            case 's': o = putVarint(out, o, zigzag((int16_t)Util_readLE_uint16_t(&v[vi], 2))); vi+=2; break;
+            case 'z': o = putVarint(out, o, zigzag((int32_t)Util_readLE_uint32_t(&v[vi], 4))); vi+=4; break;
+            case 'A': o = putVarint(out, o, zigzag((int32_t)(now - Util_readLE_uint32_t(&v[vi], 4)))); vi+=4; break;
+            default: assert(0);
+        }
+    }
+    return o;
+}
+// Replace the TLVs of the UL in buf (of sz bytes including header) by their compact encoding where it saves space. Done in place
+// as a TLV is never bigger once encoded. Returns the new size, and if anything was changed (else the UL is left as v1)
+static uint8_t compactUL(uint8_t* buf, uint8_t sz, bool* changed) {
+    uint32_t now = TMMgr_getRelTimeSecs();
+    uint8_t enc[1 + APP_CORE_UL_MAX_SZ + APP_CORE_UL_MAX_SZ/4];
+    int o = 2;
+    *changed = false;
+    for(int off=2; off < sz; ) {
+        uint8_t t = buf[off];
+        uint8_t l = buf[off+1];
+        int d = findCompactCode(t, l);
+        int esz = (d>=0 ? encodeCompact(d, &buf[off+2], enc, now) : (l+2));
+        if (d>=0 && esz < (l+2)) {
+            memcpy(&buf[o], enc, esz);
+            o += esz;
+            *changed = true;
+        } else {
+            memmove(&buf[o], &buf[off], l+2);
+            o += (l+2);
+        }
+        off += (l+2);
+    }
+    return o;
+}
+// App ack : note the event TLVs of the UL about to be txd, and add the ack request for them if there is space (else they get
+// one when resent). A resent message already has its request.
+static uint8_t appAckTx(uint8_t* buf, uint8_t sz, uint8_t maxSz, bool willListen) {
+    _appAck.txSz = 0;
+    _appAck.txListen = willListen;
+    if (!_appAck.on) {
+        return sz;
+    }
+    int reqAt = -1;
+    for(int off=2; off < sz; off += (buf[off+1]+2)) {
+        uint8_t t = buf[off];
+        uint8_t tsz = buf[off+1]+2;
+        if (t==APP_CORE_UL_APP_ACK_REQ && tsz==APP_ACK_REQ_SZ) {
+            reqAt = off;
+        } else if (t<=APP_ACK_MAX_TAG && (APP_ACK_TAGS & (1ULL<<t)) && tsz<=APP_ACK_ENTRY_MAX_SZ) {
+            memcpy(&_scratch.ackTLVs[_appAck.txSz], &buf[off], tsz);
+            _appAck.txSz += tsz;
+        }
+    }
+    if (_appAck.txSz==0) {
+        return sz;
+    }
+    if (reqAt>=0) {
+        _appAck.txSeq = buf[reqAt+2];
+        return sz;
+    }
+    _appAck.txSeq = _appAck.nextSeq++;
+    if ((sz + APP_ACK_REQ_SZ) <= maxSz) {
+        buf[sz++] = APP_CORE_UL_APP_ACK_REQ;
+        buf[sz++] = 1;
+        buf[sz++] = _appAck.txSeq;
+    } else {
+        log_debug("AC:no space for app ack req %d", _appAck.txSeq);
+    }
+    return sz;
+}
+// Last step before tx : app ack request, compact encoding if enabled, and the header
+static uint8_t finaliseUL(uint8_t* buf, uint8_t sz, uint8_t maxSz, uint8_t lastDLId, bool willListen) {
+    bool compacted = false;
+    sz = appAckTx(buf, sz, maxSz, willListen);
+    if (_compact) {
+        sz = compactUL(buf, sz, &compacted);
+    }
+    setULHeader(buf, sz, lastDLId, willListen, (compacted ? APP_CORE_MSGS_VERSION_UL_COMPACT : APP_CORE_MSGS_VERSION_UL));
+    return sz;
+}
+// Another message to tx after the current one?
+bool app_core_msg_ul_hasNextTx(APP_CORE_UL_t* ul) {
+    return ((ul->msbNbTxing+1) <= ul->msgNbFilling);
+}
 // Prepare next tx msg (header etc) and return the size of the final UL
-uint8_t app_core_msg_ul_prepareNextTx(APP_CORE_UL_t* ul, uint8_t lastDLId, bool willListen) {
+uint8_t app_core_msg_ul_prepareNextTx(APP_CORE_UL_t* ul, uint8_t lastDLId, bool willListen, uint8_t maxTxSz) {
     uint8_t ret = 0;
+    maxTxSz = clampTxSz(maxTxSz);
     ul->msbNbTxing++;
-    if (ul->msbNbTxing<APP_CORE_UL_MAX_NB) {
-        // 2 byte fixed header: 
-        //	0 : b0-3: ULrespid, b4-5: protocol version, b6: 1=listening for DL, 0=not listening, b7: force even parity for this byte
-        //	1 : length of following TLV block
-        //	- allows backend to reliably (mostly) detect this type of message - if 1st byte parity=0 and 2nd byte value+2=message length then its probably this format....
-        //	- 00 00 is the most basic valid message
-        ul->msgs[ul->msbNbTxing].payload[0] = (lastDLId & 0x0f) | ((APP_CORE_MSGS_VERSION_UL & 0x03)<<4) | (willListen?0x40:0x00);
-        if (!evenParity(ul->msgs[ul->msbNbTxing].payload[0])) {
-            ul->msgs[ul->msbNbTxing].payload[0] |= 0x80;        // not even, add parity bit
-        }
-        ul->msgs[ul->msbNbTxing].payload[1] = (ul->msgs[ul->msbNbTxing].sz)-2;      // length of the TLV section
-        ret = ul->msgs[ul->msbNbTxing].sz;
-        // Must have msgNbTxing pointing to the message we have finalised
+    ul->txFirst = ul->msbNbTxing;
+    if (ul->msbNbTxing<APP_CORE_UL_MAX_NB && ul->msbNbTxing<=ul->msgNbFilling) {
+        // Copy the TLVs of as many blocks as fit after the header
+        ret = 2;
+        while(ul->msbNbTxing<=ul->msgNbFilling && (ret + ul->msgs[ul->msbNbTxing].sz - 2) <= maxTxSz &&
+                (ul->msbNbTxing==ul->txFirst || !ul->msgs[ul->msbNbTxing].newTx)) {
+            memcpy(&ul->txbuf[ret], &ul->msgs[ul->msbNbTxing].payload[2], ul->msgs[ul->msbNbTxing].sz - 2);
+            ret += (ul->msgs[ul->msbNbTxing].sz - 2);
+            ul->msbNbTxing++;
+        }
+        // Must have msgNbTxing pointing to the last block we have finalised
+        ul->msbNbTxing--;
+        ret = finaliseUL(&ul->txbuf[0], ret, maxTxSz, lastDLId, willListen);
     } // else we're done tx 
     return ret;
 }
 // Get pointer to payload for current 'to tx' message
 uint8_t* app_core_msg_ul_getTxPayload(APP_CORE_UL_t* ul) {
-    return &(ul->msgs[ul->msbNbTxing].payload[0]);
+    return &(ul->txbuf[0]);
+}
+
+// UL backlog : each slot is a config element so only the changed slot is written to PROM
+static void saveBacklogSlot(int i) {
+    CFMgr_setElement(CFG_UTIL_KEY_UL_BACKLOG_SLOT0+i, &_backlog.slots[i], sizeof(UL_BACKLOG_SLOT_t));
+}
+static int oldestBacklogSlot() {
+    int ret = -1;
+    for(int i=0;i<UL_BACKLOG_SZ;i++) {
+        if (_backlog.slots[i].seq!=0 && (ret<0 || _backlog.slots[i].seq < _backlog.slots[ret].seq)) {
+            ret = i;
+        }
+    }
+    return ret;
+}
+void app_core_msg_ul_backlog_init() {
+    _backlog.nextSeq = 1;
+    _backlog.txSlot = -1;
+    for(int i=0;i<UL_BACKLOG_SZ;i++) {
+        memset(&_backlog.slots[i], 0, sizeof(UL_BACKLOG_SLOT_t));
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_UL_BACKLOG_SLOT0+i, &_backlog.slots[i], sizeof(UL_BACKLOG_SLOT_t));
+        if (_backlog.slots[i].seq!=0 && (_backlog.slots[i].sz<=2 || _backlog.slots[i].sz>APP_CORE_UL_MAX_SZ)) {
+            log_warn("AC:bad UL backlog slot %d, freed", i);
+            memset(&_backlog.slots[i], 0, sizeof(UL_BACKLOG_SLOT_t));
+            saveBacklogSlot(i);
+        }
+        if (_backlog.slots[i].seq >= _backlog.nextSeq) {
+            _backlog.nextSeq = _backlog.slots[i].seq+1;
+        }
+        _backlog.savedAt[i] = 0;        // its age is unknown
+    }
+    if (app_core_msg_ul_backlog_count()>0) {
+        log_info("AC:UL backlog has %d msgs", app_core_msg_ul_backlog_count());
+    }
+}
+// Keep a block (with space for its header) in a free slot, or the oldest one
+static bool pushBlock(uint8_t* payload, uint8_t sz) {
+    if (sz<=2) {
+        return false;       // nothing in it
+    }
+    int slot = -1;
+    for(int i=0;i<UL_BACKLOG_SZ;i++) {
+        if (_backlog.slots[i].seq==0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot<0) {
+        slot = oldestBacklogSlot();
+        log_warn("AC:UL backlog full, oldest dropped");
+    }
+    _backlog.slots[slot].seq = _backlog.nextSeq++;
+    _backlog.slots[slot].sz = sz;
+    memcpy(&_backlog.slots[slot].payload[0], payload, sz);
+    // 0 means 'before reboot'
+    _backlog.savedAt[slot] = (TMMgr_getRelTimeSecs()>0 ? TMMgr_getRelTimeSecs() : 1);
+    saveBacklogSlot(slot);
+    log_debug("AC:UL sz %d kept in backlog slot %d", _backlog.slots[slot].sz, slot);
+    return true;
+}
+// Keep a block of a delta round : the one with the mask goes without it, followed by the TLVs the mask stood for
+static bool pushDeltaBlock(uint8_t* payload, uint8_t sz) {
+    int at = -1;
+    for(int off=2; off < sz; off += (payload[off+1]+2)) {
+        if (payload[off]==APP_CORE_UL_DELTA) {
+            at = off;
+            break;
+        }
+    }
+    if (at<0) {
+        return pushBlock(payload, sz);
+    }
+    uint8_t blk[APP_CORE_UL_MAX_SZ];
+    uint8_t dsz = payload[at+1]+2;
+    memcpy(&blk[0], payload, at);
+    memcpy(&blk[at], &payload[at+dsz], sz-(at+dsz));
+    bool ret = pushBlock(blk, sz-dsz);
+    uint8_t bsz = 2;
+    for(int off=0; off < _delta.heldSz; ) {
+        uint8_t tsz = _delta.held[off+1]+2;
+        if ((bsz + tsz) > APP_CORE_UL_MAX_SZ) {
+            ret |= pushBlock(blk, bsz);
+            bsz = 2;
+        }
+        memcpy(&blk[bsz], &_delta.held[off], tsz);
+        bsz += tsz;
+        off += tsz;
+    }
+    ret |= pushBlock(blk, bsz);
+    _delta.heldSz = 0;
+    return ret;
+}
+bool app_core_msg_ul_backlog_push(APP_CORE_UL_t* ul) {
+    assert(ul!=NULL);
+    if (ul->msbNbTxing<0 || ul->msbNbTxing>=APP_CORE_UL_MAX_NB) {
+        return false;       // no message
+    }
+    bool ret = false;
+    for(int b=ul->txFirst;b<=ul->msbNbTxing;b++) {
+        ret |= pushDeltaBlock(ul->msgs[b].payload, ul->msgs[b].sz);
+    }
+    // its deltas can't be the reference as the backend doesn't have it yet
+    _delta.pendingFailed = true;
+    return ret;
+}
+bool app_core_msg_ul_txOK(APP_CORE_UL_t* ul) {
+    assert(ul!=NULL);
+    if (ul->msbNbTxing>=ul->msgNbFilling) {
+        _delta.pendingAllSent = true;
+        return true;
+    }
+    return false;
+}
+uint8_t app_core_msg_ul_backlog_count() {
+    uint8_t n = 0;
+    for(int i=0;i<UL_BACKLOG_SZ;i++) {
+        if (_backlog.slots[i].seq!=0) {
+            n++;
+        }
+    }
+    return n;
+}
+uint8_t app_core_msg_ul_backlog_prepareTx(uint8_t lastDLId, bool willListen) {
+    _backlog.txSlot = oldestBacklogSlot();
+    if (_backlog.txSlot<0) {
+        return 0;
+    }
+    UL_BACKLOG_SLOT_t* s = &_backlog.slots[_backlog.txSlot];
+    _backlog.txSeq = s->seq;
+    uint8_t sz = s->sz;
+    memcpy(&_backlog.txbuf[0], &s->payload[0], sz);
+    // Tell backend how old it is if it fits (in minutes, 0xFFFF if from before a reboot)
+    if ((sz + 2 + 2) <= APP_CORE_UL_MAX_SZ) {
+        uint32_t ageMins = 0xFFFF;
+        if (_backlog.savedAt[_backlog.txSlot]!=0) {
+            ageMins = (TMMgr_getRelTimeSecs() - _backlog.savedAt[_backlog.txSlot]) / 60;
+            if (ageMins > 0xFFFE) {
+                ageMins = 0xFFFE;
+            }
+        }
+        _backlog.txbuf[sz++] = APP_CORE_UL_BACKLOG_AGE;
+        _backlog.txbuf[sz++] = 2;
+        Util_writeLE_uint16_t(_backlog.txbuf, sz, ageMins);
+        sz+=2;
+    }
+    return finaliseUL(&_backlog.txbuf[0], sz, APP_CORE_UL_MAX_SZ, lastDLId, willListen);
+}
+uint8_t* app_core_msg_ul_backlog_getTxPayload() {
+    return &_backlog.txbuf[0];
+}
+void app_core_msg_ul_backlog_pop() {
+    // check its still there (it may have been dropped for a newer one)
+    if (_backlog.txSlot>=0 && _backlog.slots[_backlog.txSlot].seq==_backlog.txSeq) {
+        memset(&_backlog.slots[_backlog.txSlot], 0, sizeof(UL_BACKLOG_SLOT_t));
+        saveBacklogSlot(_backlog.txSlot);
+    }
+    _backlog.txSlot = -1;
+}
+void app_core_msg_ul_backlog_clear() {
+    for(int i=0;i<UL_BACKLOG_SZ;i++) {
+        if (_backlog.slots[i].seq!=0) {
+            memset(&_backlog.slots[i], 0, sizeof(UL_BACKLOG_SLOT_t));
+            saveBacklogSlot(i);
+        }
+    }
+    _backlog.txSlot = -1;
+}
+
+// App level ack
+void app_core_msg_ul_setAppAck(bool on) {
+    _appAck.on = on;
+    if (!on) {
+        memset(&_appAck.pending[0], 0, sizeof(_appAck.pending));
+        _appAck.txSz = 0;
+    }
+}
+void app_core_msg_ul_appAck_txOK() {
+    // The backend had its chance to ack the kept ones in this UL's RX (which is before the tx result)
+    bool found = false;
+    for(int i=0;i<APP_ACK_MAX_PENDING;i++) {
+        if (!_appAck.pending[i].used) {
+            continue;
+        }
+        if (_appAck.txSz>0 && _appAck.pending[i].seq==_appAck.txSeq) {
+            // A resent one : restart its wait
+            _appAck.pending[i].listens = (_appAck.txListen ? 1 : 0);
+            _appAck.pending[i].resending = false;
+            found = true;
+        } else if (_appAck.txListen && !_appAck.pending[i].resending && _appAck.pending[i].listens<255) {
+            _appAck.pending[i].listens++;
+        }
+    }
+    // Else keep its TLVs in as many entries as needed (a TLV is never split)
+    for(int off=0; !found && off < _appAck.txSz; ) {
+        int e = -1;
+        for(int i=0;i<APP_ACK_MAX_PENDING;i++) {
+            if (!_appAck.pending[i].used) {
+                e = i;
+                break;
+            }
+            if (e<0 || _appAck.pending[i].listens > _appAck.pending[e].listens) {
+                e = i;
+            }
+        }
+        if (_appAck.pending[e].used) {
+            log_warn("AC:app ack list full, seq %d dropped", _appAck.pending[e].seq);
+        }
+        APP_ACK_ENTRY_t* pe = &_appAck.pending[e];
+        memset(pe, 0, sizeof(APP_ACK_ENTRY_t));
+        pe->used = true;
+        pe->seq = _appAck.txSeq;
+        pe->listens = (_appAck.txListen ? 1 : 0);
+        while(off < _appAck.txSz && (pe->sz + _scratch.ackTLVs[off+1] + 2) <= APP_ACK_ENTRY_MAX_SZ) {
+            uint8_t tsz = _scratch.ackTLVs[off+1] + 2;
+            memcpy(&pe->tlvs[pe->sz], &_scratch.ackTLVs[off], tsz);
+            pe->sz += tsz;
+            off += tsz;
+        }
+    }
+    _appAck.txSz = 0;
+}
+void app_core_msg_ul_appAck_rx(uint8_t seq) {
+    if (_appAck.txSz>0 && _appAck.txSeq==seq) {
+        // in the RX of the UL being txd : nothing to keep
+        _appAck.txSz = 0;
+    }
+    for(int i=0;i<APP_ACK_MAX_PENDING;i++) {
+        if (_appAck.pending[i].used && _appAck.pending[i].seq==seq) {
+            _appAck.pending[i].used = false;
+            log_debug("AC:app ack seq %d", seq);
+        }
+    }
+}
+void app_core_msg_ul_appAck_round() {
+    for(int i=0;i<APP_ACK_MAX_PENDING;i++) {
+        APP_ACK_ENTRY_t* pe = &_appAck.pending[i];
+        if (!pe->used || pe->resending || pe->listens < MYNEWT_VAL(UL_APP_ACK_WAIT_ULS)) {
+            continue;
+        }
+        if (pe->resends >= MYNEWT_VAL(UL_APP_ACK_MAX_RESENDS)) {
+            log_warn("AC:no app ack for seq %d after %d resends, dropped", pe->seq, pe->resends);
+            pe->used = false;
+            continue;
+        }
+        // Resend only the kept TLVs, with a new seq so a late ack of the previous one isn't taken for this one
+        uint8_t blk[APP_CORE_UL_MAX_SZ];
+        uint8_t sz = 2;
+        memcpy(&blk[sz], &pe->tlvs[0], pe->sz);
+        sz += pe->sz;
+        pe->seq = _appAck.nextSeq++;
+        blk[sz++] = APP_CORE_UL_APP_ACK_REQ;
+        blk[sz++] = 1;
+        blk[sz++] = pe->seq;
+        pe->resends++;
+        pe->listens = 0;
+        pe->resending = true;
+        log_info("AC:no app ack, resend %d as seq %d", pe->resends, pe->seq);
+        pushBlock(blk, sz);
+    }
+}
+uint8_t app_core_msg_ul_appAck_count() {
+    uint8_t n = 0;
+    for(int i=0;i<APP_ACK_MAX_PENDING;i++) {
+        if (_appAck.pending[i].used) {
+            n++;
+        }
+    }
+    return n;
 }
 
 void app_core_msg_dl_init(APP_CORE_DL_t* dl) {
@@ -0,0 +1,115 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Execution time profiling of the module callbacks and of the UL/DL codec : min/max/total per call site.
+ * Only the counting is behind APP_CORE_PROFILE, the getters are always there (and find nothing if it is off).
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "os/os.h"
+
+#include "wyres-generic/wutils.h"
+#include "app-core/app_core.h"
+#include "app-core/app_prof.h"
+
+#if MYNEWT_VAL(APP_CORE_PROFILE)
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+// Cortex-M3/M4 DWT cycle counter (not in the M0, and it stops when the core sleeps, which is what we want here)
+#define DEMCR (*(volatile uint32_t*)0xE000EDFC)
+#define DEMCR_TRCENA (1u << 24)
+#define DWT_CTRL (*(volatile uint32_t*)0xE0001000)
+#define DWT_CTRL_CYCCNTENA (1u << 0)
+#define DWT_CYCCNT (*(volatile uint32_t*)0xE0001004)
+#define PROF_DWT
+#define PROF_UNIT "cycles"
+#else
+// host build
+#include <time.h>
+#define PROF_UNIT "ns"
+#endif
+
+static APP_PROF_STATS_t _prof[APP_PROF_NB_SITES];
+
+void app_prof_init() {
+#ifdef PROF_DWT
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
+    app_prof_reset();
+}
+uint32_t app_prof_now() {
+#ifdef PROF_DWT
+    return DWT_CYCCNT;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+#endif
+}
+// 32 bit counts wrap (after 134s at 32MHz, 4s in ns) : fine for callbacks, which must be a lot quicker than that
+void app_prof_add(uint16_t site, uint32_t start) {
+    uint32_t d = app_prof_now() - start;
+    assert(site < APP_PROF_NB_SITES);
+    APP_PROF_STATS_t* st = &_prof[site];
+    if (st->nCalls == 0 || d < st->min) {
+        st->min = d;
+    }
+    if (d > st->max) {
+        st->max = d;
+    }
+    st->total += d;
+    st->nCalls++;
+}
+#endif
+
+bool app_prof_get(uint16_t site, APP_PROF_STATS_t* st) {
+#if MYNEWT_VAL(APP_CORE_PROFILE)
+    if (site < APP_PROF_NB_SITES && _prof[site].nCalls > 0) {
+        *st = _prof[site];
+        return true;
+    }
+#endif
+    return false;
+}
+
+void app_prof_siteName(uint16_t site, const char** what, const char** fn) {
+    static const char* MODCB_NAMES[APP_PROF_NB_MODCB] = { "start", "stop", "getULData", "tic" };
+    static const char* CODEC_NAMES[APP_PROF_NB_CODEC] = { "ul_addTLV", "ul_delta", "ul_pack", "ul_prepareNextTx",
+        "ul_backlog_prepareTx", "dl_decode", "dl_execute" };
+    if (site < APP_PROF_CODEC_SITE(0)) {
+        *what = AppCore_getModuleName(site / APP_PROF_NB_MODCB);
+        *fn = MODCB_NAMES[site % APP_PROF_NB_MODCB];
+    } else if (site < APP_PROF_NB_SITES) {
+        *what = "codec";
+        *fn = CODEC_NAMES[site - APP_PROF_CODEC_SITE(0)];
+    } else {
+        *what = "NA";
+        *fn = "NA";
+    }
+}
+
+const char* app_prof_unit() {
+#if MYNEWT_VAL(APP_CORE_PROFILE)
+    return PROF_UNIT;
+#else
+    return "none";
+#endif
+}
+
+void app_prof_reset() {
+#if MYNEWT_VAL(APP_CORE_PROFILE)
+    memset(&_prof[0], 0, sizeof(_prof));
+#endif
+}
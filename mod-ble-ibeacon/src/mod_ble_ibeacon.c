@@ -59,26 +59,29 @@ static void ble_cb(WBLE_EVENT_t e, void* d) {
     }
 }
 
-// My api functions
-static uint32_t start() {
-    // ibeaconning is normally running, but redo the start each time to get any param changes.
-    // Default major/minor are the low 4 bytes from the lora devEUI...
-    uint8_t devEUI[8];
-    memset(&devEUI[0], 0, 8);       // Ensure all 0s if no deveui available
-    CFMgr_getElement(CFG_UTIL_KEY_LORA_DEVEUI, &devEUI[0], 8);
-
-    _ctx.major = (devEUI[4] << 8) + devEUI[5];
-    _ctx.minor = (devEUI[6] << 8) + devEUI[7];
-    _ctx.beaconPeriodMS = 500;
-    _ctx.txpower = -20;
-
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_PERIOD_MS, &_ctx.beaconPeriodMS, sizeof(uint32_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_MAJOR, &_ctx.major, sizeof(uint16_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_MINOR, &_ctx.minor, sizeof(uint16_t));
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_TXPOWER, &_ctx.txpower, sizeof(int8_t));
+// Read my config : all of it at init (key=CFG_KEY_ILLEGAL), then only the element that changed
+static void readConfig(void* ctx, uint16_t key) {
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_IBEACON_PERIOD_MS) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_PERIOD_MS, &_ctx.beaconPeriodMS, sizeof(uint32_t));
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_IBEACON_MAJOR) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_MAJOR, &_ctx.major, sizeof(uint16_t));
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_IBEACON_MINOR) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_MINOR, &_ctx.minor, sizeof(uint16_t));
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_IBEACON_TXPOWER) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_TXPOWER, &_ctx.txpower, sizeof(int8_t));
+    }
     // NOte that if uuid in config is all 0, then the default wyres uuid is used for scanning and for ibeaconing
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.UUID, UUID_SZ);
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_IBEACON_UUID) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.UUID, UUID_SZ);
+    }
+}
 
+// My api functions
+static uint32_t start() {
+    // ibeaconning is normally running, but redo the start each time to get any param changes (kept up to date by readConfig())
     // Start BLE module if wasn't already (will call me back)
     wble_start(_ctx.wbleCtx, ble_cb);
 
@@ -108,12 +111,28 @@ static APP_CORE_API_t _api = {
     .getULDataCB = &getData,    
     .ticCB = NULL,    
 };
+// Shares the BLE card uart (and power) with the other BLE modules
+static APP_MOD_RESOURCES_t _res = MOD_BLE_RESOURCES;
 // Initialise module
 void mod_ble_ibeacon_init(void) {
+    // Default major/minor are the low 4 bytes from the lora devEUI...
+    uint8_t devEUI[8];
+    memset(&devEUI[0], 0, 8);       // Ensure all 0s if no deveui available
+    CFMgr_getElement(CFG_UTIL_KEY_LORA_DEVEUI, &devEUI[0], 8);
+
+    _ctx.major = (devEUI[4] << 8) + devEUI[5];
+    _ctx.minor = (devEUI[6] << 8) + devEUI[7];
+    _ctx.beaconPeriodMS = 500;
+    _ctx.txpower = -20;
+    // Get config once, and keep our copy up to date when it changes
+    readConfig(NULL, CFG_KEY_ILLEGAL);
+    AppCore_subscribeConfig(CFG_UTIL_KEY_BLE_IBEACON_UUID, CFG_UTIL_KEY_BLE_IBEACON_TXPOWER, readConfig, NULL);
+
     // initialise access
     _ctx.wbleCtx = wble_mgr_init(MYNEWT_VAL(MOD_BLE_UART), MYNEWT_VAL(MOD_BLE_UART_BAUDRATE), MYNEWT_VAL(MOD_BLE_PWRIO), MYNEWT_VAL(MOD_BLE_UARTIO), MYNEWT_VAL(MOD_BLE_UART_SELECT));
 
     // hook app-core for ble access - serialised as competing for UART
     AppCore_registerModule("BLE-IB", APP_MOD_BLE_IB, &_api, EXEC_SERIAL);
+    AppCore_registerModuleResources(APP_MOD_BLE_IB, &_res);
 //    log_debug("MBB:mod-ble-ibeacon inited");
 }
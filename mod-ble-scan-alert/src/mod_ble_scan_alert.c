@@ -41,6 +41,9 @@ static struct {
     uint32_t bleTableHash;
     ibeacon_data_t iblist[MAX_BLE_TOSCAN];
     ibeacon_data_t bestiblist[MAX_BLE_TOSEND];
+    MOD_BLE_UL_ENTRY_t ullist[MAX_BLE_TOSEND];
+    uint8_t compactLists;
+    uint32_t bleScanTimeMS;
     uint8_t uuid[UUID_SZ];
 } _ctx;     // inited to 0 by definition
 
@@ -79,15 +82,29 @@ static uint32_t generateBLEListHash(int tbsz, ibeacon_data_t* list) {
     return hash;
 }
 // My api functions
+// Read my config : all of it at init (key=CFG_KEY_ILLEGAL), then only the element that changed
+static void readConfig(void* ctx, uint16_t key) {
+    // Get max BLEs, validate value is ok to avoid issues...
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_MAX_NAV_PER_UL) {
+        _ctx.maxNavPerUL = MAX_BLE_TOSEND;
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_NAV_PER_UL, &_ctx.maxNavPerUL, 1, MAX_BLE_TOSEND);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS, &_ctx.compactLists, 0, 1);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_SCAN_TIME_MS) {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, &_ctx.bleScanTimeMS, 1000, 60000);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_IBEACON_UUID) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.uuid, UUID_SZ);
+    }
+}
+
 static uint32_t start() {
     // When device is inactive this module is not used
     if (!AppCore_isDeviceActive()) {
         return 0;
     }
-    // Get max BLEs, validate value is ok to avoid issues...
-    _ctx.maxNavPerUL = MAX_BLE_TOSEND;
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_NAV_PER_UL, &_ctx.maxNavPerUL, 1, MAX_BLE_TOSEND);
-
     // no errors yet
     _ctx.bleErrorMask = 0;
     // get hash of list before
@@ -95,11 +112,7 @@ static uint32_t start() {
     // and tell ble to go with a callback to tell me when its got something
     wble_start(_ctx.wbleCtx, ble_cb);
     // Return the scan time
-    uint32_t bleScanTimeMS = MYNEWT_VAL(MOD_BLE_DEFAULT_SCAN_TIME_MS);
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, &bleScanTimeMS, 1000, 60000);
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.uuid, UUID_SZ);
-
-    return bleScanTimeMS;
+    return _ctx.bleScanTimeMS;
 }
 
 static void stop() {
@@ -140,17 +153,13 @@ static bool getData(APP_CORE_UL_t* ul) {
             nbSent = _ctx.maxNavPerUL;      // can limit to less than the max
         }
         // put it into UL if possible
-        uint8_t* vp = app_core_msg_ul_addTLgetVP(ul, APP_CORE_UL_BLE_CURR,nbSent*5);
-        if (vp!=NULL) {
-            for(int i=0;i<nbSent;i++) {
-                *vp++ = (_ctx.bestiblist[i].major & 0xff);
-                // no point in sending up MSB of major, not used in id
-//                *vp++ = ((_ctx.bestiblist[i].major >> 8) & 0xff);
-                *vp++ = (_ctx.bestiblist[i].minor & 0xff);
-                *vp++ = ((_ctx.bestiblist[i].minor >> 8) & 0xff);
-                *vp++ = _ctx.bestiblist[i].rssi;
-                *vp++ = _ctx.bestiblist[i].extra;
-            }
+        for(int i=0;i<nbSent;i++) {
+            _ctx.ullist[i].id = MOD_BLE_UL_ID(_ctx.bestiblist[i].major, _ctx.bestiblist[i].minor);
+            _ctx.ullist[i].rssi = _ctx.bestiblist[i].rssi;
+            _ctx.ullist[i].val = _ctx.bestiblist[i].extra;
+        }
+        if (mod_ble_ul_addList(ul, MOD_BLE_UL_LIST_CURR, (_ctx.compactLists!=0), _ctx.ullist, nbSent) < nbSent) {
+            _ctx.bleErrorMask |= EM_UL_NOSPACE;
         }
         // Set a global flag so gps knows we saw 'indoor' type localisation stuff
         // TODO
@@ -180,15 +189,22 @@ static APP_CORE_API_t _api = {
     .getULDataCB = &getData,    
     .ticCB = NULL,    
 };
+// Shares the BLE card uart (and power) with the other BLE modules
+static APP_MOD_RESOURCES_t _res = MOD_BLE_RESOURCES;
 // Initialise module
 void mod_ble_scan_alert_init(void) {
     // _ctx initied to 0 by definition (bss). Set any non-0 defaults here
-    _ctx.maxNavPerUL = MAX_BLE_TOSEND;
+    _ctx.compactLists = MYNEWT_VAL(MOD_BLE_UL_COMPACT_LISTS);
+    _ctx.bleScanTimeMS = MYNEWT_VAL(MOD_BLE_DEFAULT_SCAN_TIME_MS);
+    // Get config once, and keep our copy up to date when it changes
+    readConfig(NULL, CFG_KEY_ILLEGAL);
+    AppCore_subscribeConfig(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS, readConfig, NULL);
 
     // initialise access
     _ctx.wbleCtx = wble_mgr_init(MYNEWT_VAL(MOD_BLE_UART), MYNEWT_VAL(MOD_BLE_UART_BAUDRATE), MYNEWT_VAL(MOD_BLE_PWRIO), MYNEWT_VAL(MOD_BLE_UARTIO), MYNEWT_VAL(MOD_BLE_UART_SELECT));
 
     // hook app-core for ble scan - serialised as competing for UART
     AppCore_registerModule("BLE-SCAN-ALERT", APP_MOD_BLE_SCAN_ALERT, &_api, EXEC_SERIAL);
+    AppCore_registerModuleResources(APP_MOD_BLE_SCAN_ALERT, &_res);
 //    log_debug("MB:mod-ble-scan-alert inited");
 }
@@ -12,11 +12,13 @@
 */
 
 // BLE SCAN NAV : scan BLE beacons for navigation use (reflects how the scan results are treated/sent)
+#include <string.h>
 #include "os/os.h"
 #include "bsp/bsp.h"
 
 #include "wyres-generic/wutils.h"
 #include "wyres-generic/configmgr.h"
+#include "wyres-generic/timemgr.h"
 #include "wyres-generic/wblemgr.h"
 #include "cbor.h"
 #include "app-core/app_core.h"
@@ -38,6 +40,16 @@ static struct {
     uint8_t bleErrorMask;
     ibeacon_data_t iblist[MAX_BLE_TOSCAN];
     ibeacon_data_t bestiblist[MAX_BLE_TOSEND];
+    MOD_BLE_UL_ENTRY_t ullist[MAX_BLE_TOSEND];
+    // value of the list : against the best beacons of the last list that went in an UL
+    bool refValid;
+    uint8_t nbRefIds;
+    uint32_t refIds[MAX_BLE_TOSEND];
+    uint8_t nbLastIds;              // list given this round, becomes the reference once the round's UL is sent
+    uint32_t lastIds[MAX_BLE_TOSEND];
+    bool lastListGiven;
+    uint8_t compactLists;
+    uint32_t bleScanTimeMS;
     uint8_t uuid[UUID_SZ];
 } _ctx;     // inited to 0 by definition
 
@@ -67,26 +79,78 @@ static void ble_cb(WBLE_EVENT_t e, void* d) {
     }
 }
 
+// Read my config : all of it at init (key=CFG_KEY_ILLEGAL), then only the element that changed
+static void readConfig(void* ctx, uint16_t key) {
+    // Get max BLEs, validate value is ok to avoid issues...
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_MAX_NAV_PER_UL) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_NAV_PER_UL, &_ctx.maxNavPerUL, 1, MAX_BLE_TOSEND);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS, &_ctx.compactLists, 0, 1);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_SCAN_TIME_MS) {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, &_ctx.bleScanTimeMS, 1000, 60000);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_IBEACON_UUID) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.uuid, UUID_SZ);
+    }
+}
+
 // My api functions
+static bool hasId(uint32_t* ids, int nb, uint32_t id) {
+    for(int i=0;i<nb;i++) {
+        if (ids[i]==id) {
+            return true;
+        }
+    }
+    return false;
+}
+// How much this best list is worth sending, against the last one the backend got : none of the same beacons is a new place,
+// a new best one is half way there, else each one swapped in/out counts (the order is left out as it is mostly rssi noise)
+static uint8_t listValue(uint32_t* ids, int nb) {
+    _ctx.nbLastIds = nb;
+    memcpy(_ctx.lastIds, ids, nb*sizeof(uint32_t));
+    _ctx.lastListGiven = true;
+    if (!_ctx.refValid) {
+        return MOD_BLE_VALUE_PLACE;
+    }
+    // 'no BLEs seen' is as important as a new place, but not when it is the same again
+    if (nb==0 || _ctx.nbRefIds==0) {
+        return (nb==_ctx.nbRefIds ? 0 : MOD_BLE_VALUE_PLACE);
+    }
+    int nbNew = 0;
+    for(int i=0;i<nb;i++) {
+        nbNew += (hasId(_ctx.refIds, _ctx.nbRefIds, ids[i]) ? 0 : 1);
+    }
+    if (nbNew==nb) {
+        return MOD_BLE_VALUE_PLACE;
+    }
+    if (!hasId(_ctx.refIds, _ctx.nbRefIds, ids[0])) {
+        return MOD_BLE_VALUE_PLACE/2;
+    }
+    int nbGone = 0;
+    for(int i=0;i<_ctx.nbRefIds;i++) {
+        nbGone += (hasId(ids, nb, _ctx.refIds[i]) ? 0 : 1);
+    }
+    int nbChanged = (nbNew > nbGone ? nbNew : nbGone);
+    if (nbChanged==0) {
+        return MOD_BLE_VALUE_SAME;
+    }
+    return (nbChanged*MOD_BLE_VALUE_CHANGE < MOD_BLE_VALUE_PLACE ? nbChanged*MOD_BLE_VALUE_CHANGE : MOD_BLE_VALUE_PLACE);
+}
+
 static uint32_t start() {
     // When device is inactive this module is not used
     if (!AppCore_isDeviceActive()) {
         return 0;
     }
-    // Get max BLEs, validate value is ok to avoid issues...
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_NAV_PER_UL, &_ctx.maxNavPerUL, 1, MAX_BLE_TOSEND);
-
     // no errors yet
     _ctx.bleErrorMask = 0;
 
     // and tell ble to go with a callback to tell me when its got something
     wble_start(_ctx.wbleCtx, ble_cb);
     // Return the scan time
-    uint32_t bleScanTimeMS = 3000;
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, &bleScanTimeMS, 1000, 60000);
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.uuid, UUID_SZ);
-
-    return bleScanTimeMS;
+    return _ctx.bleScanTimeMS;
 }
 
 static void stop() {
@@ -105,6 +169,7 @@ static void deepsleep() {
 }
 
 static bool getData(APP_CORE_UL_t* ul) {
+    _ctx.lastListGiven = false;
     // When device is inactive this module is not used
     if (!AppCore_isDeviceActive()) {
         return false;
@@ -122,22 +187,23 @@ static bool getData(APP_CORE_UL_t* ul) {
     // This module is concerned with the fixed navigation ones - we sent up a short 'best rsssi' list every time
     // Get list of ibs in order into this array please
     int nbSent = wble_getSortedIBList(_ctx.wbleCtx, MAX_BLE_TOSEND, _ctx.bestiblist);
+    uint32_t ids[MAX_BLE_TOSEND];
+    if (nbSent>_ctx.maxNavPerUL) {
+        nbSent = _ctx.maxNavPerUL;      // can limit to less than the max
+    }
+    for(int i=0;i<nbSent;i++) {
+        ids[i] = MOD_BLE_UL_ID(_ctx.bestiblist[i].major, _ctx.bestiblist[i].minor);
+    }
+    uint8_t value = listValue(ids, (nbSent>0 ? nbSent : 0));
     if (nbSent>0) {
-        if (nbSent>_ctx.maxNavPerUL) {
-            nbSent = _ctx.maxNavPerUL;      // can limit to less than the max
-        }
         // put it into UL if possible
-        uint8_t* vp = app_core_msg_ul_addTLgetVP(ul, APP_CORE_UL_BLE_CURR,nbSent*5);
-        if (vp!=NULL) {
-            for(int i=0;i<nbSent;i++) {
-                *vp++ = (_ctx.bestiblist[i].major & 0xff);
-                // no point in sending up MSB of major, not used in id
-//                *vp++ = ((_ctx.bestiblist[i].major >> 8) & 0xff);
-                *vp++ = (_ctx.bestiblist[i].minor & 0xff);
-                *vp++ = ((_ctx.bestiblist[i].minor >> 8) & 0xff);
-                *vp++ = _ctx.bestiblist[i].rssi;
-                *vp++ = _ctx.bestiblist[i].extra;
-            }
+        for(int i=0;i<nbSent;i++) {
+            _ctx.ullist[i].id = ids[i];
+            _ctx.ullist[i].rssi = _ctx.bestiblist[i].rssi;
+            _ctx.ullist[i].val = _ctx.bestiblist[i].extra;
+        }
+        if (mod_ble_ul_addList(ul, MOD_BLE_UL_LIST_CURR, (_ctx.compactLists!=0), _ctx.ullist, nbSent) < nbSent) {
+            _ctx.bleErrorMask |= EM_UL_NOSPACE;
         }
         // Set a global flag so gps knows we saw 'indoor' type localisation stuff
         // TODO
@@ -150,9 +216,20 @@ static bool getData(APP_CORE_UL_t* ul) {
         app_core_msg_ul_addTLV(ul, APP_CORE_UL_BLE_ERRORMASK, 1, &_ctx.bleErrorMask);
     }
 
-    log_info("MBN:UL saw %d sent best %d err %02x", wble_getNbIBActive(_ctx.wbleCtx, 0), nbSent, _ctx.bleErrorMask);
-//    return (nbSent>0);
-    return true;        // always gotta send UL as 'no BLEs seen' is also important!
+    log_info("MBN:UL saw %d sent best %d err %02x value %d", wble_getNbIBActive(_ctx.wbleCtx, 0), nbSent, _ctx.bleErrorMask, value);
+    // Not critical : app-core decides if the change is worth the UL
+    app_core_msg_ul_addValue(ul, value);
+    return false;
+}
+// The round's UL went : the backend has the list given to it
+static void ulSent() {
+    if (_ctx.lastListGiven) {
+        _ctx.refValid = true;
+        _ctx.nbRefIds = _ctx.nbLastIds;
+        memcpy(_ctx.refIds, _ctx.lastIds, sizeof(_ctx.refIds));
+        _ctx.lastListGiven = false;
+        log_debug("MBN:list of %d sent, is the reference", _ctx.nbRefIds);
+    }
 }
 
 static APP_CORE_API_t _api = {
@@ -162,16 +239,25 @@ static APP_CORE_API_t _api = {
     .deepsleepCB = &deepsleep,
     .getULDataCB = &getData,    
     .ticCB = NULL,    
+    .ulSentCB = &ulSent,
 };
+// Shares the BLE card uart (and power) with the other BLE modules
+static APP_MOD_RESOURCES_t _res = MOD_BLE_RESOURCES;
 // Initialise module
 void mod_ble_scan_nav_init(void) {
     // _ctx initied to 0 by definition (bss). Set any non-0 defaults here
     _ctx.maxNavPerUL = MAX_BLE_TOSEND;
+    _ctx.compactLists = MYNEWT_VAL(MOD_BLE_UL_COMPACT_LISTS);
+    _ctx.bleScanTimeMS = 3000;
+    // Get config once, and keep our copy up to date when it changes
+    readConfig(NULL, CFG_KEY_ILLEGAL);
+    AppCore_subscribeConfig(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS, readConfig, NULL);
 
     // initialise access
     _ctx.wbleCtx = wble_mgr_init(MYNEWT_VAL(MOD_BLE_UART), MYNEWT_VAL(MOD_BLE_UART_BAUDRATE), MYNEWT_VAL(MOD_BLE_PWRIO), MYNEWT_VAL(MOD_BLE_UARTIO), MYNEWT_VAL(MOD_BLE_UART_SELECT));
 
     // hook app-core for ble scan - serialised as competing for UART
     AppCore_registerModule("BLE-SCAN-NAV", APP_MOD_BLE_SCAN_NAV, &_api, EXEC_SERIAL);
+    AppCore_registerModuleResources(APP_MOD_BLE_SCAN_NAV, &_res);
 //    log_debug("MB:mod-ble-scan-nav inited");
 }
@@ -59,6 +59,9 @@ static struct {
     uint8_t nbNav;
     uint8_t bleErrorMask;
     uint8_t nbULRepeats;
+    MOD_BLE_UL_ENTRY_t ullist[MAX_BLE_TRACKED];
+    uint8_t compactLists;
+    uint32_t bleScanTimeMS;
     uint8_t uuid[UUID_SZ];
 //    uint8_t cborbuf[MAX_BLE_ENTER*6];
 } _ctx;
@@ -92,33 +95,53 @@ static void ble_cb(WBLE_EVENT_t e, void* d) {
 }
 
 // My api functions
+// Read my config : all of it at init (key=CFG_KEY_ILLEGAL), then only the element that changed
+static void readConfig(void* ctx, uint16_t key) {
+    // exit timeout should actually be in function of the delay between scans...
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_EXIT_TIMEOUT_MINS) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_EXIT_TIMEOUT_MINS, &_ctx.exitTimeoutMins, 1, 4*60);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_MAX_ENTER_PER_UL) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_ENTER_PER_UL, &_ctx.maxContactsPerUL, 1, 255);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS, &_ctx.compactLists, 0, 1);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_PROX_UL_REPS) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_PROX_UL_REPS, &_ctx.nbULRepeats, 1, 10);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_PROX_STIME_MINS) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_PROX_STIME_MINS, &_ctx.contactSignifTimeMins, 1, 60);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_PROX_SRSSI) {
+        CFMgr_getOrAddElementCheckRangeINT8(CFG_UTIL_KEY_BLE_PROX_SRSSI, &_ctx.contactSignifRSSI, -100, 0);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_IBEACON_UUID) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.uuid, UUID_SZ);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_SCAN_TIME_MS) {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, &_ctx.bleScanTimeMS, 1000, 60000);
+    }
+}
+
+// Times each contact enter/exit is repeated in the ULs : none if app-core gets them acked by the backend (it resends them itself)
+static uint8_t nbULRepeats() {
+    return (AppCore_isAppAckOn() ? 0 : _ctx.nbULRepeats);
+}
+
 static uint32_t start() {
     // When device is inactive this module is not used
     if (!AppCore_isDeviceActive()) {
         return 0;
     }
-    // Read config each start() to take into account any changes
-    // exit timeout should actually be in function of the delay between scans...
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_EXIT_TIMEOUT_MINS, &_ctx.exitTimeoutMins, 1, 4*60);
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_ENTER_PER_UL, &_ctx.maxContactsPerUL, 1, 255);
-
-    // Allow these config items to be updated all the time
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_PROX_UL_REPS, &_ctx.nbULRepeats, 1, 10);
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_PROX_STIME_MINS, &_ctx.contactSignifTimeMins, 1, 60);
-    CFMgr_getOrAddElementCheckRangeINT8(CFG_UTIL_KEY_BLE_PROX_SRSSI, &_ctx.contactSignifRSSI, -100, 0);
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.uuid, UUID_SZ);
-
     // no errors yet
     _ctx.bleErrorMask = 0;
     // start ble to go (may already be running), with a callback to tell me when its comm is ok (may be immediate if already running)
     // Request to scan is sent once comm is ok
     wble_start(_ctx.wbleCtx, ble_cb);
 
-    // Return the scan time (checking config is ok)
-    uint32_t bleScanTimeMS = 3000;
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, &bleScanTimeMS, 1000, 60000);
-
-    return bleScanTimeMS;
+    // Return the scan time (config read at init and kept up to date by readConfig())
+    return _ctx.bleScanTimeMS;
 }
 
 static void stop() {
@@ -239,17 +262,13 @@ static bool getData(APP_CORE_UL_t* ul) {
     }
     if (_ctx.nbNav>0) {
         // put it into UL if possible
-        uint8_t* vp = app_core_msg_ul_addTLgetVP(ul, APP_CORE_UL_BLE_CURR,_ctx.nbNav*5);
-        if (vp!=NULL) {
-            for(int i=0;i<_ctx.nbNav;i++) {
-                *vp++ = (_ctx.navIBList[i].major & 0xff);
-                // no point in sending up MSB of major, not used in id
-//                *vp++ = ((_ctx.bestiblist[i].major >> 8) & 0xff);
-                *vp++ = (_ctx.navIBList[i].minor & 0xff);
-                *vp++ = ((_ctx.navIBList[i].minor >> 8) & 0xff);
-                *vp++ = _ctx.navIBList[i].rssi;
-                *vp++ = _ctx.navIBList[i].extra;
-            }
+        for(int i=0;i<_ctx.nbNav;i++) {
+            _ctx.ullist[i].id = MOD_BLE_UL_ID(_ctx.navIBList[i].major, _ctx.navIBList[i].minor);
+            _ctx.ullist[i].rssi = _ctx.navIBList[i].rssi;
+            _ctx.ullist[i].val = _ctx.navIBList[i].extra;
+        }
+        if (mod_ble_ul_addList(ul, MOD_BLE_UL_LIST_CURR, (_ctx.compactLists!=0), _ctx.ullist, _ctx.nbNav) < _ctx.nbNav) {
+            _ctx.bleErrorMask |= EM_UL_NOSPACE;
         }
     } else {
         // add empty TLV to signal we scanned but didnt see them
@@ -276,6 +295,7 @@ static bool getData(APP_CORE_UL_t* ul) {
         nbContactEnd = _ctx.maxContactsPerUL;
     }
 
+#ifdef SEND_DEVADDR
     // put up to max enter elemnents into UL.
     if (nbContactNew>0) {
         int nbAdded = 0;
@@ -308,25 +328,16 @@ static bool getData(APP_CORE_UL_t* ul) {
                     vp = app_core_msg_ul_addTLgetVP(ul, PROX_ENTER_TAG, nbThisUL*PROX_ENTER_UL_SZ);
                 }
                 if (vp!=NULL) {
-#ifdef SEND_DEVADDR
                     int seenSinceMins = ((now - _ctx.iblist[i].firstSeenAt) / 60);
                     // new format with devAddr/timeSinceEntered/RSSI 
                     memcpy(vp, &_ctx.iblist[i].devaddr[0], DEVADDR_SZ);
                     vp+=DEVADDR_SZ;
                     *vp++ = _ctx.iblist[i].rssi;
                     *vp++ = (seenSinceMins<255 ? seenSinceMins : 255);      // Total time seen in minutes, max'd at 255
-#else
-                    // add maj/min to UL (number of bytes == ENTER_UL_SZ)
-                    *vp++ = (_ctx.iblist[i].major & 0xFF);        // Just LSB of major
-                    *vp++ = (_ctx.iblist[i].minor & 0xff);
-                    *vp++ = ((_ctx.iblist[i].minor >> 8) & 0xff);
-                    *vp++ = _ctx.iblist[i].rssi;
-                    *vp++ = _ctx.iblist[i].extra;
-#endif
                     
-                    // we want to tell backend at least twice per contact
+                    // tell backend several times per contact, unless app-core gets it acked
                     _ctx.iblist[i].inULCnt++;  
-                    if (_ctx.iblist[i].inULCnt > _ctx.nbULRepeats) {
+                    if (_ctx.iblist[i].inULCnt > nbULRepeats()) {
                         _ctx.iblist[i].new = false;     // we've told the backend several times!
                         _ctx.iblist[i].inULCnt = 0;     // ready for reuse
                     }
@@ -377,22 +388,14 @@ static bool getData(APP_CORE_UL_t* ul) {
                 }
                 if (vp!=NULL) {
                     int seenSinceMins = ((now - _ctx.iblist[i].firstSeenAt) / 60);
-#ifdef SEND_DEVADDR
                     // new format with devAddr/timeSinceEntered 
                     memcpy(vp, &_ctx.iblist[i].devaddr[0], DEVADDR_SZ);
                     vp+=DEVADDR_SZ;
                     *vp++ = (seenSinceMins<255 ? seenSinceMins : 255);      // Total time seen in minutes, max'd at 255
-#else
-                    // add maj/min to UL : must be number of bytes equal to EXIT_UL_SZ
-                    *vp++ = (_ctx.iblist[i].major & 0xFF);        // Just LSB of major
-                    *vp++ = (_ctx.iblist[i].minor & 0xff);
-                    *vp++ = ((_ctx.iblist[i].minor >> 8) & 0xff);
-                    *vp++ = (seenSinceMins<255 ? seenSinceMins : 255);      // Total time seen in minutes, max'd at 255
-#endif
                     _ctx.iblist[i].inULCnt++;  
                     // TODO Problem here - intermittant reception can mean getting a 'exit' in 1 or 2 UL, but then we rx, so no longer in exit,
                     // but not new, so didn't get an enter.... backend will be confused...
-                    if (_ctx.iblist[i].inULCnt > _ctx.nbULRepeats) {
+                    if (_ctx.iblist[i].inULCnt > nbULRepeats()) {
                         // delete from active list
                         _ctx.iblist[i].lastSeenAt=0;
                         _ctx.iblist[i].inULCnt=0;       // reset for next time
@@ -413,6 +416,71 @@ static bool getData(APP_CORE_UL_t* ul) {
         }
     }
 
+#else
+    // put up to max enter elemnents into UL (major/minor ids, so can use the common list encoding)
+    if (nbContactNew>0) {
+        int nb = 0;
+        for(int i=0;i<MAX_BLE_TRACKED && nb<nbContactNew; i++) {
+            // If entry is valid, and of type enter/exit, and is new, then...
+            if ((_ctx.iblist[i].lastSeenAt>0) 
+                    && (((_ctx.iblist[i].major & 0xFF00) >> 8) == BLE_TYPE_PROXIMITY)
+                    && _ctx.iblist[i].new) {
+                _ctx.ullist[nb].id = MOD_BLE_UL_ID(_ctx.iblist[i].major, _ctx.iblist[i].minor);
+                _ctx.ullist[nb].rssi = _ctx.iblist[i].rssi;
+                _ctx.ullist[nb].val = _ctx.iblist[i].extra;
+                _ctx.ullist[nb].ref = i;
+                nb++;
+            }
+        }
+        int nbAdded = mod_ble_ul_addList(ul, MOD_BLE_UL_LIST_ENTER, (_ctx.compactLists!=0), _ctx.ullist, nb);
+        for(int j=0;j<nbAdded;j++) {
+            int i = _ctx.ullist[j].ref;
+            // tell backend several times per contact, unless app-core gets it acked
+            _ctx.iblist[i].inULCnt++;  
+            if (_ctx.iblist[i].inULCnt > nbULRepeats()) {
+                _ctx.iblist[i].new = false;     // we've told the backend several times!
+                _ctx.iblist[i].inULCnt = 0;     // ready for reuse
+            }
+        }
+        if (nbAdded<nb) {
+            log_debug("MBP: no UL space for contacts %d",(nb-nbAdded));
+            _ctx.bleErrorMask |= EM_UL_NONEXTUL;
+        }
+    }
+    if (nbContactEnd>0) {
+        int nb = 0;
+        for(int i=0;i<MAX_BLE_TRACKED && nb<nbContactEnd; i++) {
+            // If a valid entry, and of proximity ble type, and has timed out...
+            if ((_ctx.iblist[i].lastSeenAt>0) 
+                    && (((_ctx.iblist[i].major & 0xFF00) >> 8) == BLE_TYPE_PROXIMITY) 
+                    && ((now-_ctx.iblist[i].lastSeenAt)>(_ctx.exitTimeoutMins*60))) {
+                int seenSinceMins = ((now - _ctx.iblist[i].firstSeenAt) / 60);
+                _ctx.ullist[nb].id = MOD_BLE_UL_ID(_ctx.iblist[i].major, _ctx.iblist[i].minor);
+                _ctx.ullist[nb].val = (seenSinceMins<255 ? seenSinceMins : 255);      // Total time seen in minutes, max'd at 255
+                _ctx.ullist[nb].ref = i;
+                nb++;
+            }
+        }
+        int nbAdded = mod_ble_ul_addList(ul, MOD_BLE_UL_LIST_EXIT, (_ctx.compactLists!=0), _ctx.ullist, nb);
+        for(int j=0;j<nbAdded;j++) {
+            int i = _ctx.ullist[j].ref;
+            _ctx.iblist[i].inULCnt++;  
+            // TODO Problem here - intermittant reception can mean getting a 'exit' in 1 or 2 UL, but then we rx, so no longer in exit,
+            // but not new, so didn't get an enter.... backend will be confused...
+            if (_ctx.iblist[i].inULCnt > nbULRepeats()) {
+                // delete from active list
+                _ctx.iblist[i].lastSeenAt=0;
+                _ctx.iblist[i].inULCnt=0;       // reset for next time
+            }
+            log_debug("MBP: %04x:%04x exit, been in %d UL", _ctx.iblist[i].major, _ctx.iblist[i].minor, _ctx.iblist[i].inULCnt);
+        }
+        if (nbAdded<nb) {
+            log_debug("MBP: no UL space for exit %d",(nb-nbAdded));
+            _ctx.bleErrorMask |= EM_UL_NONEXTUL;
+        }
+    }
+#endif
+
 /*    if (nbSent>0) {
         // Build CBOR array block first then add to message (as we don't know its size)
         CborEncoder encoder, blearray;
@@ -461,6 +529,8 @@ static APP_CORE_API_t _api = {
     .getULDataCB = &getData,    
     .ticCB = NULL,    
 };
+// Shares the BLE card uart (and power) with the other BLE modules
+static APP_MOD_RESOURCES_t _res = MOD_BLE_RESOURCES;
 // Initialise module
 void mod_ble_scan_prox_init(void) {
     // _ctx in bss -> set to 0 by default
@@ -468,8 +538,13 @@ void mod_ble_scan_prox_init(void) {
     _ctx.exitTimeoutMins=4;
     _ctx.maxContactsPerUL=50;
     _ctx.nbULRepeats = 2;
+    _ctx.compactLists = MYNEWT_VAL(MOD_BLE_UL_COMPACT_LISTS);
     _ctx.contactSignifTimeMins = MYNEWT_VAL(MOD_BLE_PROX_SIGNIF_CONTACT);
     _ctx.contactSignifRSSI = MYNEWT_VAL(MOD_BLE_PROX_SIGNIF_RSSI);
+    _ctx.bleScanTimeMS = 3000;
+    // Get config once, and keep our copy up to date when it changes
+    readConfig(NULL, CFG_KEY_ILLEGAL);
+    AppCore_subscribeConfig(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS, readConfig, NULL);
     // initialise access (this is resistant to multiple calls...)
     _ctx.wbleCtx = wble_mgr_init(MYNEWT_VAL(MOD_BLE_UART), MYNEWT_VAL(MOD_BLE_UART_BAUDRATE), MYNEWT_VAL(MOD_BLE_PWRIO), MYNEWT_VAL(MOD_BLE_UARTIO), MYNEWT_VAL(MOD_BLE_UART_SELECT));
 
@@ -488,6 +563,7 @@ void mod_ble_scan_prox_init(void) {
     }
 
     // hook app-core for ble scan - serialised as competing for UART. Note we claim we're an ibeaon module
-    AppCore_registerModule("BLE-SCAN-PROX", APP_MOD_BLE_IB, &_api, EXEC_SERIAL);
+    AppCore_registerModule("BLE-SCAN-PROX", APP_MOD_BLE_SCAN_PROX, &_api, EXEC_SERIAL);
+    AppCore_registerModuleResources(APP_MOD_BLE_SCAN_PROX, &_res);
 //    log_debug("MB:mod-ble-scan-prox inited");
 }
@@ -186,8 +186,6 @@ static ibeacon_data_t STATIC_TEST_IBLIST_COUNT[] = {
 };
 #endif
 
-#define ENTER_UL_SZ (5)
-#define EXIT_UL_SZ (4)
 #define COUNT_UL_SZ (2)
 #define PRESENCE_HDR_UL_SZ (2)
 #define TL_HDR_UL_SZ (2)
@@ -195,7 +193,6 @@ static ibeacon_data_t STATIC_TEST_IBLIST_COUNT[] = {
 // Max ibeacons we track in the scan history. We give ourselves some space over the defined limit to deal with the 'exit' timeouts.
 #define MAX_BLE_TRACKED (MYNEWT_VAL(MOD_BLE_MAXIBS_TAG_INZONE)+10)
 
-#define BLE_NTYPES ((BLE_TYPE_COUNTABLE_END-BLE_TYPE_COUNTABLE_START)+1)
 // don't want these on the stack, and trying to avoid malloc
 
 
@@ -206,9 +203,17 @@ static struct {
     uint8_t maxExitPerUL;
     uint8_t presenceMinorMSB;
     ibeacon_data_t iblist[MAX_BLE_TRACKED];
+    MOD_BLE_UL_ENTRY_t ullist[MAX_BLE_TRACKED];
+    uint8_t compactLists;
+    uint32_t bleScanTimeMS;
     uint8_t bleErrorMask;
     uint8_t tcount[BLE_NTYPES];
     uint8_t uuid[UUID_SZ];
+    // value of the counts/presence : against a hash of the last ones that went in an UL
+    bool refValid;
+    uint32_t refSummary;
+    uint32_t lastSummary;           // ones given this round, become the reference once the round's UL is sent
+    bool lastSummaryGiven;
 //    uint8_t cborbuf[MAX_BLE_ENTER*6];
 } _ctx;
 #if 0
@@ -281,31 +286,44 @@ static void ble_cb(WBLE_EVENT_t e, void* d) {
 }
 
 // My api functions
+// Read my config : all of it at init (key=CFG_KEY_ILLEGAL), then only the element that changed
+static void readConfig(void* ctx, uint16_t key) {
+    // exit timeout should actually be in function of the delay between scans...
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_EXIT_TIMEOUT_MINS) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_EXIT_TIMEOUT_MINS, &_ctx.exitTimeoutMins, 1, 4*60);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_MAX_ENTER_PER_UL) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_ENTER_PER_UL, &_ctx.maxEnterPerUL, 1, 255);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_MAX_EXIT_PER_UL) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_EXIT_PER_UL, &_ctx.maxExitPerUL, 1, 255);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS, &_ctx.compactLists, 0, 1);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_PRESENCE_MINOR) {
+        CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_PRESENCE_MINOR, &_ctx.presenceMinorMSB, 0, 255);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_SCAN_TIME_MS) {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, &_ctx.bleScanTimeMS, 1000, 60000);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_BLE_IBEACON_UUID) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.uuid, UUID_SZ);
+    }
+}
+
 static uint32_t start() {
     // When device is inactive this module is not used
     if (!AppCore_isDeviceActive()) {
         return 0;
     }
-    // Read config each start() to take into account any changes
-    // exit timeout should actually be in function of the delay between scans...
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_EXIT_TIMEOUT_MINS, &_ctx.exitTimeoutMins, 1, 4*60);
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_ENTER_PER_UL, &_ctx.maxEnterPerUL, 1, 255);
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_MAX_EXIT_PER_UL, &_ctx.maxExitPerUL, 1, 255);
-    CFMgr_getOrAddElementCheckRangeUINT8(CFG_UTIL_KEY_BLE_PRESENCE_MINOR, &_ctx.presenceMinorMSB, 0, 255);
-
     // no errors yet
     _ctx.bleErrorMask = 0;
 
     // and tell ble to go with a callback to tell me when its got something
     wble_start(_ctx.wbleCtx, ble_cb);
-    // Return the scan time (checking config is ok)
-    uint32_t bleScanTimeMS = 3000;
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, &bleScanTimeMS, 1000, 60000);
-    
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_BLE_IBEACON_UUID, &_ctx.uuid, UUID_SZ);
-
-
-    return bleScanTimeMS;
+    // Return the scan time (config read at init and kept up to date by readConfig())
+    return _ctx.bleScanTimeMS;
 }
 
 static void stop() {
@@ -321,7 +339,43 @@ static void deepsleep() {
     // nothing to do
 }
 
+// Our config of the tracked list handling
+static void tagCfg(MOD_BLE_TAG_CFG_t* cfg) {
+    cfg->exitTimeoutMins = _ctx.exitTimeoutMins;
+    cfg->maxEnterPerUL = _ctx.maxEnterPerUL;
+    cfg->maxExitPerUL = _ctx.maxExitPerUL;
+    cfg->presenceMinorMSB = _ctx.presenceMinorMSB;
+    cfg->compactLists = (_ctx.compactLists!=0);
+    cfg->proximityIsEnterExit = true;
+}
+// FNV-1a, to see if the counts/presence changed without keeping them
+static uint32_t hashBytes(uint32_t h, const uint8_t* b, int n) {
+    for(int i=0;i<n;i++) {
+        h = (h ^ b[i]) * 16777619u;
+    }
+    return h;
+}
+// How much the counts/presence are worth sending, against the last ones the backend got
+static uint8_t summaryValue(uint32_t summary) {
+    _ctx.lastSummary = summary;
+    _ctx.lastSummaryGiven = true;
+    return ((_ctx.refValid && summary==_ctx.refSummary) ? MOD_BLE_VALUE_SAME : MOD_BLE_VALUE_CHANGE);
+}
+// Tell app-core how much UL space we would like (before it gets our data)
+static uint16_t getULNeed(uint8_t* prio) {
+    *prio = APP_MOD_UL_PRIO_NORMAL;
+    // When device is inactive this module is not used
+    if (!AppCore_isDeviceActive()) {
+        return 0;
+    }
+    MOD_BLE_TAG_CFG_t cfg;
+    MOD_BLE_TAG_COUNTS_t c;
+    tagCfg(&cfg);
+    return mod_ble_tag_countUL(_ctx.iblist, MAX_BLE_TRACKED, TMMgr_getRelTimeSecs(), &cfg, &c, NULL);
+}
+
 static bool getData(APP_CORE_UL_t* ul) {
+    _ctx.lastSummaryGiven = false;
         // When device is inactive this module is not used
     if (!AppCore_isDeviceActive()) {
         return false;
@@ -336,112 +390,29 @@ static bool getData(APP_CORE_UL_t* ul) {
     //      'enter/exit' : major = 0x80xx
     //      'presence' : major=0x81xx, minor = 0xZZxx where ZZ is configured for this device.
     // This module deals with the long range types
-    int nbEnter=0;
-    int nbExit=0;
-    int nbCount=0;
-        // Presence guys : this is a single TLV (we only track 1 minor block per device)
-    int maxMinorIdPresence = -1;        // to work out if we see any, and if so, the max id seen (to economise space)
-    uint16_t majorPresence=0;         // Normally we expect all presence guys to have same major...
-
     uint32_t now = TMMgr_getRelTimeSecs();
-    
-    // reset countables counts
-    memset(&_ctx.tcount[0], 0, sizeof(_ctx.tcount));
+    MOD_BLE_TAG_CFG_t cfg;
+    MOD_BLE_TAG_COUNTS_t c;
+    tagCfg(&cfg);
     // Check if table is full.
     int nActive = wble_getNbIBActive(_ctx.wbleCtx,0);
     log_debug("MBT: proc %d active BLE", nActive);
     if (nActive==MAX_BLE_TRACKED) {
         _ctx.bleErrorMask |= EM_BLE_TABLE_FULL;        
     }
-    // for each one seen, check its type, flagging new ones, doing the count, etc
-    for(int i=0;i<MAX_BLE_TRACKED;i++) {
-        if (_ctx.iblist[i].lastSeenAt>0) {      // its a valid entry
-            uint8_t bletype = (_ctx.iblist[i].major & 0xff00) >> 8;
-            if (bletype==BLE_TYPE_NAV) {
-                // ignore, shouldn't happen as the scanner was told to ignore these guys
-                log_warn("MBT:remove unex NAV type");
-                _ctx.bleErrorMask |= EM_BLE_RX_BADMAJ;
-                // Free up his space
-                _ctx.iblist[i].lastSeenAt=0;
-            } else if (bletype==BLE_TYPE_ENTEREXIT || bletype==BLE_TYPE_PROXIMITY) {
-                // Note we treat covid proximity tracker beacons as enter/exit types too
-                // exit/enter type : if new, we want to put in enter list in the outgoing message
-                if (_ctx.iblist[i].new) {
-                    nbEnter++;
-                } else {
-                    //  if not seen for last X minutes, we want to put in the exit list
-                    if ( (now - _ctx.iblist[i].lastSeenAt)>(_ctx.exitTimeoutMins*60)) {
-                        nbExit++;       // gonna need to flag up as exit
-                    }
-                    // Note for enter/exits we only remove them when we have managed to send their id in the UL
-                }
-            } else if (bletype==BLE_TYPE_PRESENCE) {
-                // Presence type: we only indicate each time if we see or not the minor set we are looking for
-                if (((_ctx.iblist[i].minor & 0xff00) >> 8) == _ctx.presenceMinorMSB) {
-                    // is he timed out (exited)? (using same timeout as enter/exit case)
-                    if ((now-_ctx.iblist[i].lastSeenAt)>(_ctx.exitTimeoutMins*60)) {
-                        // Yes, he's not present (and we'll 'delete' him by resetting his lastSeenAt)
-                        _ctx.iblist[i].lastSeenAt=0;
-                    } else {
-                        // He's present
-                        uint8_t minorId = (_ctx.iblist[i].minor & 0xff);     // bit position
-                        if (minorId > maxMinorIdPresence) {
-                            maxMinorIdPresence = minorId;
-                        }
-                        if (majorPresence!=_ctx.iblist[i].major) {
-                            majorPresence = _ctx.iblist[i].major;
-                            // Should only happen when set first time...
-                            log_debug("MBT:presence major=%d", majorPresence);
-                        }
-                    }
-                } else  {
-                    // we don't care about ones with a minor that we're not looking for - remove from our list to avoid blocking a slot
-                    _ctx.iblist[i].lastSeenAt=0;
-                    log_debug("MBT:remove uncon pres minor=%d", _ctx.iblist[i].minor);
-                }
-            } else if (bletype>=BLE_TYPE_COUNTABLE_START && bletype<=BLE_TYPE_COUNTABLE_END) {
-                // Ensure remove from our list if timed out
-                if ((now-_ctx.iblist[i].lastSeenAt)>(_ctx.exitTimeoutMins*60)) {
-                    // Yes, he's gone so we'll 'delete' him by setting his lastSeenAt to 0
-                    _ctx.iblist[i].lastSeenAt=0;
-                } else {
-                    // countable type : inc its counter
-                    int idx = (bletype - BLE_TYPE_COUNTABLE_START);
-                    if (idx>=0 && idx<=BLE_NTYPES) {
-                        // dont wrap the counter. 255==too many to count...
-                        if (_ctx.tcount[idx]<255) {
-                            _ctx.tcount[idx]++;
-                        }
-                        nbCount++;
-                    } // else should not happen 
-                }
-            } else {
-                // ignore, shouldn't happen as the scanner was told to ignore these guys
-                log_warn("MBT:remove unex type=%d", bletype);
-                _ctx.bleErrorMask |= EM_BLE_RX_BADMAJ;
-                // Free up the space
-                _ctx.iblist[i].lastSeenAt=0;
-            }
-        }
-    }
-    // Limit numbers in the UL to configured maxes
-    if (nbExit>_ctx.maxExitPerUL) {
-        nbExit = _ctx.maxExitPerUL;
-    }
-    if (nbEnter>_ctx.maxEnterPerUL) {
-        nbEnter = _ctx.maxEnterPerUL;
-    }
-    // Count number of types with non-zero counts
-    int nbTypes = 0;
-    for(int i=0;(i<BLE_NTYPES);i++) {
-        if (_ctx.tcount[i]>0) {
-            nbTypes++;
-        }
+    // Drop the ones that are done with, then count what is to go in the UL
+    if (mod_ble_tag_purge(_ctx.iblist, MAX_BLE_TRACKED, now, &cfg)>0) {
+        _ctx.bleErrorMask |= EM_BLE_RX_BADMAJ;
     }
+    int bytesRequired = mod_ble_tag_countUL(_ctx.iblist, MAX_BLE_TRACKED, now, &cfg, &c, _ctx.tcount);
+    int nbEnter = c.nbEnter;
+    int nbExit = c.nbExit;
+    int nbCount = c.nbCount;
+    int nbTypes = c.nbTypes;
+    int maxMinorIdPresence = c.maxMinorIdPresence;
+    uint16_t majorPresence = c.majorPresence;
 
-    // Adjust numbers to divide up remaining UL space 'fairly' between enter/exit/types
-    // how much space would it take (assuming spread over 4 UL packets)
-    int bytesRequired = nbEnter*ENTER_UL_SZ + nbExit*EXIT_UL_SZ + nbTypes*COUNT_UL_SZ + TL_HDR_UL_SZ*6;
+    // Adjust numbers to divide up remaining UL space 'fairly' between enter/exit/types (app-core has already limited it to our share)
     int bytesAvailable = app_core_msg_ul_getTotalSpaceAvailable(ul);
     // Assume splitting space evenly ie 1/3 each so everyone has same reduction %age if required
     int percentReduc = (bytesAvailable>bytesRequired) ? 100 : (bytesAvailable*100 / bytesRequired);
@@ -449,114 +420,58 @@ static bool getData(APP_CORE_UL_t* ul) {
     int nbExitToAdd = (nbExit * percentReduc) / 100;
     int nbTypesToAdd = (nbTypes * percentReduc) / 100;
     log_debug("MBT:br:%d ba:%d pr:%d ne:%d nea:%d",bytesRequired, bytesAvailable, percentReduc, nbEnter, nbEnterToAdd);
+    int nbEvents = 0;       // enter/exit added
+    uint32_t summary = hashBytes(2166136261u, _ctx.tcount, BLE_NTYPES);
     // Now add the appropriate numbers of each element
     if (nbExitToAdd>0) {
-        int nbAdded = 0;
-        uint8_t* vp = NULL;
-        int nbThisUL = 0;
-        for(int i=0;i<MAX_BLE_TRACKED && nbAdded<nbExitToAdd; i++) {
+        int nb = 0;
+        for(int i=0;i<MAX_BLE_TRACKED && nb<nbExitToAdd; i++) {
             // If a valid entry, and of enter/exit ble type, and has timed out...
             if ((_ctx.iblist[i].lastSeenAt>0) 
                     && (((_ctx.iblist[i].major & 0xFF00) >> 8) == BLE_TYPE_ENTEREXIT) 
                     && (now-_ctx.iblist[i].lastSeenAt)>(_ctx.exitTimeoutMins*60)) {
-                if (nbThisUL <= 0) {
-                    // Find space in UL
-                    int bytesInUL = app_core_msg_ul_remainingSz(ul);
-                    // Check if space for TL and 1 ble at least
-                    if (bytesInUL < (TL_HDR_UL_SZ + EXIT_UL_SZ)) {
-                        // move to next message and get size (0=no next!)
-                        if ((bytesInUL = app_core_msg_ul_requestNextUL(ul)) <= 0) {
-                            // no more messages, sorry
-                            log_debug("MBN: unexpected no next UL still got %d",(nbExitToAdd-nbAdded));
-                            _ctx.bleErrorMask |= EM_UL_NONEXTUL;
-                            break;      // from for, we're done here
-                        }
-                    }
-                    nbThisUL = (bytesInUL-TL_HDR_UL_SZ) / EXIT_UL_SZ; 
-                    if (nbThisUL > (nbExitToAdd-nbAdded)) {
-                        // should always give a >0 answer as nbAdded is never >= nbExitToAdd here
-                        nbThisUL = (nbExitToAdd-nbAdded);
-                        assert(nbThisUL>0);
-                    }
-                    vp = app_core_msg_ul_addTLgetVP(ul, APP_CORE_UL_BLE_EXIT, nbThisUL*EXIT_UL_SZ);
-                }
-                if (vp!=NULL) {
-                    int seenSinceMins = ((now - _ctx.iblist[i].firstSeenAt) / 60);
-                    // add maj/min to UL : must be number of bytes equal to EXIT_UL_SZ
-                    *vp++=(_ctx.iblist[i].major & 0xFF);        // Just LSB of major
-                    *vp++ = (_ctx.iblist[i].minor & 0xff);
-                    *vp++ = ((_ctx.iblist[i].minor >> 8) & 0xff);
-                    *vp++ = (seenSinceMins<255 ? seenSinceMins : 255);      // Total time seen in minutes, max'd at 255
-                    // delete from active list
-                    _ctx.iblist[i].lastSeenAt=0;
-                    nbAdded++;
-                    nbThisUL--;
-                    if (nbAdded>=nbExitToAdd) {
-                        break;      // added all that we're allowed
-                    }
-
-                } else {
-                    // this should not happen if the previous calculations were correct...
-                    log_debug("MBN: unexpected no space in UL for %d",nbThisUL);
-                    _ctx.bleErrorMask |= EM_UL_NOSPACE;
-                    break;
-                }
+                int seenSinceMins = ((now - _ctx.iblist[i].firstSeenAt) / 60);
+                _ctx.ullist[nb].id = MOD_BLE_UL_ID(_ctx.iblist[i].major, _ctx.iblist[i].minor);
+                _ctx.ullist[nb].val = (seenSinceMins<255 ? seenSinceMins : 255);      // Total time seen in minutes, max'd at 255
+                _ctx.ullist[nb].ref = i;
+                nb++;
             }
         }
+        int nbAdded = mod_ble_ul_addList(ul, MOD_BLE_UL_LIST_EXIT, (_ctx.compactLists!=0), _ctx.ullist, nb);
+        nbEvents += nbAdded;
+        for(int j=0;j<nbAdded;j++) {
+            // delete from active list
+            _ctx.iblist[_ctx.ullist[j].ref].lastSeenAt=0;
+        }
+        if (nbAdded<nb) {
+            log_debug("MBT: no UL space for exit %d",(nb-nbAdded));
+            _ctx.bleErrorMask |= EM_UL_NONEXTUL;
+        }
     }
     // put up to max enter elemnents into UL.
     if (nbEnterToAdd>0) {
-        int nbAdded = 0;
-        uint8_t* vp = NULL;
-        int nbThisUL = 0;
-        for(int i=0;i<MAX_BLE_TRACKED && nbAdded<nbEnterToAdd; i++) {
+        int nb = 0;
+        for(int i=0;i<MAX_BLE_TRACKED && nb<nbEnterToAdd; i++) {
             // If entry is valid, and of type enter/exit, and is new, then...
             if ((_ctx.iblist[i].lastSeenAt>0) 
                     && (((_ctx.iblist[i].major & 0xFF00) >> 8) == BLE_TYPE_ENTEREXIT)
                     && _ctx.iblist[i].new) {
-                if (nbThisUL <= 0) {
-                    // Find space in UL
-                    int bytesInUL = app_core_msg_ul_remainingSz(ul);
-                    // Check if space for TL and 1 ble at least
-                    if (bytesInUL < (TL_HDR_UL_SZ + ENTER_UL_SZ)) {
-                        // move to next message and get size (0=no next!)
-                        if ((bytesInUL = app_core_msg_ul_requestNextUL(ul)) <= 0) {
-                            // no more messages, sorry
-                            log_debug("MBN: unexpected no next UL still got enter %d",(nbEnterToAdd-nbAdded));
-                            _ctx.bleErrorMask |= EM_UL_NONEXTUL;
-                            break;      // from for, we're done here
-                        }
-                    }
-                    nbThisUL = (bytesInUL-TL_HDR_UL_SZ) / ENTER_UL_SZ; 
-                    if (nbThisUL > (nbEnterToAdd-nbAdded)) {
-                        // should always give a >0 answer as nbAdded is never >= nbEnterToAdd here
-                        nbThisUL = (nbEnterToAdd-nbAdded);
-                        assert(nbThisUL>0);
-                    }
-                    vp = app_core_msg_ul_addTLgetVP(ul, APP_CORE_UL_BLE_ENTER, nbThisUL*ENTER_UL_SZ);
-                }
-                if (vp!=NULL) {
-                    // add maj/min to UL (number of bytes == ENTER_UL_SZ)
-                    *vp++ = (_ctx.iblist[i].major & 0xFF);        // Just LSB of major
-                    *vp++ = (_ctx.iblist[i].minor & 0xff);
-                    *vp++ = ((_ctx.iblist[i].minor >> 8) & 0xff);
-                    *vp++ = _ctx.iblist[i].rssi;
-                    *vp++ = _ctx.iblist[i].extra;
-                    _ctx.iblist[i].new = false;
-                    nbAdded++;
-                    nbThisUL--;
-                    if (nbAdded>=nbEnterToAdd) {
-                        break;      // added all that we're allowed
-                    }
-
-                } else {
-                    // this should not happen if the previous calculations were correct...
-                    log_debug("MBN: no space in UL for enter %d",nbThisUL);
-                    _ctx.bleErrorMask |= EM_UL_NOSPACE;
-                    break;
-                }
+                _ctx.ullist[nb].id = MOD_BLE_UL_ID(_ctx.iblist[i].major, _ctx.iblist[i].minor);
+                _ctx.ullist[nb].rssi = _ctx.iblist[i].rssi;
+                _ctx.ullist[nb].val = _ctx.iblist[i].extra;
+                _ctx.ullist[nb].ref = i;
+                nb++;
             }
         }
+        int nbAdded = mod_ble_ul_addList(ul, MOD_BLE_UL_LIST_ENTER, (_ctx.compactLists!=0), _ctx.ullist, nb);
+        nbEvents += nbAdded;
+        for(int j=0;j<nbAdded;j++) {
+            _ctx.iblist[_ctx.ullist[j].ref].new = false;
+        }
+        if (nbAdded<nb) {
+            log_debug("MBT: no UL space for enter %d",(nb-nbAdded));
+            _ctx.bleErrorMask |= EM_UL_NONEXTUL;
+        }
     }
     // put in types and counts
     // WARNING : backend must handle case where set of type/counts split across multiple ULs - must deal with set of ULs together...
@@ -612,22 +527,27 @@ static bool getData(APP_CORE_UL_t* ul) {
     // Ask for space for TLV if we see any presence guys as active
     if (maxMinorIdPresence>=0)  { 
         uint8_t* vp = app_core_msg_ul_addTLgetVP(ul, APP_CORE_UL_BLE_PRESENCE, PRESENCE_HDR_UL_SZ+((maxMinorIdPresence/8)+1));
-        *vp++ = (majorPresence & 0xff);
-        *vp++ = _ctx.presenceMinorMSB;
-        for(int i=0;i<MAX_BLE_TRACKED;i++) {
-            // Is this a valid entry, and a presence type, and for the minor range we monitor?
-            if ((_ctx.iblist[i].lastSeenAt>0) &&
-                (((_ctx.iblist[i].major & 0xff00) >> 8) == BLE_TYPE_PRESENCE) &&
-                (((_ctx.iblist[i].minor & 0xff00) >> 8) == _ctx.presenceMinorMSB)) {
-                uint8_t minorId = (_ctx.iblist[i].minor & 0xff);     // bit position
-                if (minorId<=maxMinorIdPresence) {
-                    // set this bit in byte array
-                    vp[minorId/8] |= (1<<(minorId%8));
-                } else {
-                    // never happens? should be assert?
-                    log_warn("MBT:pres:minorid(%d)>maxminor(%d)", minorId, maxMinorIdPresence);
+        if (vp==NULL) {
+            log_warn("MBT:no UL space for presence");
+        } else {
+            *vp++ = (majorPresence & 0xff);
+            *vp++ = _ctx.presenceMinorMSB;
+            for(int i=0;i<MAX_BLE_TRACKED;i++) {
+                // Is this a valid entry, and a presence type, and for the minor range we monitor?
+                if ((_ctx.iblist[i].lastSeenAt>0) &&
+                    (((_ctx.iblist[i].major & 0xff00) >> 8) == BLE_TYPE_PRESENCE) &&
+                    (((_ctx.iblist[i].minor & 0xff00) >> 8) == _ctx.presenceMinorMSB)) {
+                    uint8_t minorId = (_ctx.iblist[i].minor & 0xff);     // bit position
+                    if (minorId<=maxMinorIdPresence) {
+                        // set this bit in byte array
+                        vp[minorId/8] |= (1<<(minorId%8));
+                    } else {
+                        // never happens? should be assert?
+                        log_warn("MBT:pres:minorid(%d)>maxminor(%d)", minorId, maxMinorIdPresence);
+                    }
                 }
             }
+            summary = hashBytes(summary, vp, (maxMinorIdPresence/8)+1);
         }
     } else {
         // add empty TLV to signal we scanned but didnt see them
@@ -670,10 +590,27 @@ static bool getData(APP_CORE_UL_t* ul) {
     if (_ctx.bleErrorMask!=0) {
         app_core_msg_ul_addTLV(ul, APP_CORE_UL_BLE_ERRORMASK, 1, &_ctx.bleErrorMask);
     }
-    log_info("MBT:UL enter %d/%d exit %d/%d types %d/%d/%d, maxPId %d err %02x", 
-        nbEnter, nbEnterToAdd, nbExit, nbExitToAdd, nbCount, nbTypes, nbTypesToAdd, maxMinorIdPresence, _ctx.bleErrorMask);
-//    return (nbEnterToAdd>0 || nbExitToAdd>0 || nbTypesToAdd>0 || _ctx.bleErrorMask!=0);
-    return true;        // always gotta send UL as 'no BLEs seen' is also important!
+    // enter/exit are events (gone from the tracked list once in the UL) : always worth it. Otherwise app-core decides if
+    // the change in the counts/presence (or the error) is worth the UL
+    uint8_t value = summaryValue(summary);
+    if (_ctx.bleErrorMask!=0 && value<MOD_BLE_VALUE_CHANGE) {
+        value = MOD_BLE_VALUE_CHANGE;
+    }
+    log_info("MBT:UL enter %d/%d exit %d/%d types %d/%d/%d, maxPId %d err %02x value %d", 
+        nbEnter, nbEnterToAdd, nbExit, nbExitToAdd, nbCount, nbTypes, nbTypesToAdd, maxMinorIdPresence, _ctx.bleErrorMask, (nbEvents>0 ? APP_CORE_UL_VALUE_CRIT : value));
+    if (nbEvents>0) {
+        return true;
+    }
+    app_core_msg_ul_addValue(ul, value);
+    return false;
+}
+// The round's UL went : the backend has the counts/presence given to it
+static void ulSent() {
+    if (_ctx.lastSummaryGiven) {
+        _ctx.refValid = true;
+        _ctx.refSummary = _ctx.lastSummary;
+        _ctx.lastSummaryGiven = false;
+    }
 }
 
 static APP_CORE_API_t _api = {
@@ -683,7 +620,11 @@ static APP_CORE_API_t _api = {
     .deepsleepCB = &deepsleep,
     .getULDataCB = &getData,    
     .ticCB = NULL,    
+    .getULNeedCB = &getULNeed,
+    .ulSentCB = &ulSent,
 };
+// Shares the BLE card uart (and power) with the other BLE modules
+static APP_MOD_RESOURCES_t _res = MOD_BLE_RESOURCES;
 // Initialise module
 void mod_ble_scan_tag_init(void) {
     // _ctx in bss -> set to 0 by default
@@ -691,10 +632,16 @@ void mod_ble_scan_tag_init(void) {
     _ctx.exitTimeoutMins=5;
     _ctx.maxEnterPerUL=50;
     _ctx.maxExitPerUL=50;
+    _ctx.compactLists = MYNEWT_VAL(MOD_BLE_UL_COMPACT_LISTS);
+    _ctx.bleScanTimeMS = 3000;
+    // Get config once, and keep our copy up to date when it changes
+    readConfig(NULL, CFG_KEY_ILLEGAL);
+    AppCore_subscribeConfig(CFG_UTIL_KEY_BLE_SCAN_TIME_MS, CFG_UTIL_KEY_BLE_UL_COMPACT_LISTS, readConfig, NULL);
     // initialise access (this is resistant to multiple calls...)
     _ctx.wbleCtx = wble_mgr_init(MYNEWT_VAL(MOD_BLE_UART), MYNEWT_VAL(MOD_BLE_UART_BAUDRATE), MYNEWT_VAL(MOD_BLE_PWRIO), MYNEWT_VAL(MOD_BLE_UARTIO), MYNEWT_VAL(MOD_BLE_UART_SELECT));
 
     // hook app-core for ble scan - serialised as competing for UART
     AppCore_registerModule("BLE-SCAN-TAG", APP_MOD_BLE_SCAN_TAGS, &_api, EXEC_SERIAL);
+    AppCore_registerModuleResources(APP_MOD_BLE_SCAN_TAGS, &_res);
 //    log_debug("MB:mod-ble-scan-nav inited");
 }
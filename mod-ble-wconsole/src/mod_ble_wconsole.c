@@ -110,12 +110,15 @@ static APP_CORE_API_t _api = {
     .getULDataCB = &getData,    
     .ticCB = NULL,    
 };
+// Shares the BLE card uart (and power) with the other BLE modules
+static APP_MOD_RESOURCES_t _res = MOD_BLE_RESOURCES;
 // Initialise module
 void mod_ble_wconsole_init(void) {
     // initialise access (this is resistant to multiple calls...)
     _ctx.wbleCtx = wble_mgr_init(MYNEWT_VAL(MOD_BLE_UART), MYNEWT_VAL(MOD_BLE_UART_BAUDRATE), MYNEWT_VAL(MOD_BLE_PWRIO), MYNEWT_VAL(MOD_BLE_UARTIO), MYNEWT_VAL(MOD_BLE_UART_SELECT)); 
     // hook app-core for ble scan - serialised as competing for UART. Note we claim we're an ibeaon module
     AppCore_registerModule("BLE-WCONSOLE", APP_MOD_BLE_CONSOLE, &_api, EXEC_SERIAL);
+    AppCore_registerModuleResources(APP_MOD_BLE_CONSOLE, &_res);
 //    log_debug("MB:mod-ble-wconsole inited");
 }
 
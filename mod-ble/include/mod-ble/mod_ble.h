@@ -15,6 +15,9 @@
 #define H_MOD_BLE_H
 
 #include <inttypes.h>
+#include <stdbool.h>
+#include "app-core/app_msg.h"
+#include "wyres-generic/wblemgr.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,6 +30,11 @@ extern "C" {
 #define BLE_TYPE_PRESENCE   (0x81)
 #define BLE_TYPE_PROXIMITY   (0x82)
 #define UUID_SZ (16)
+// Number of countable tag types
+#define BLE_NTYPES ((BLE_TYPE_COUNTABLE_END-BLE_TYPE_COUNTABLE_START)+1)
+
+// Resources used by a module driving the BLE card, to initialise its static APP_MOD_RESOURCES_t for AppCore_registerModuleResources()
+#define MOD_BLE_RESOURCES { .uartDev=MYNEWT_VAL(MOD_BLE_UART), .uartSelect=MYNEWT_VAL(MOD_BLE_UART_SELECT), .i2cBus=-1, .pwrIO=MYNEWT_VAL(MOD_BLE_PWRIO) }
 
 // BLE error bitmasks
 // BLE comm failed
@@ -39,6 +47,66 @@ extern "C" {
 // BLE historical table is full (which may lead to missing targets in scan)
 #define EM_BLE_TABLE_FULL   (0x10)
 
+// Beacon lists in the UL : each entry is the beacon id (LSB of major, minor) and either its rssi and extra byte (CURR/ENTER lists) or a 1 byte value (EXIT lists).
+// As is (5 or 4 bytes per entry) in the APP_CORE_UL_BLE_CURR/ENTER/EXIT TLVs, or in the compact encoding in the APP_CORE_UL_BLE_xxx_LIST ones 
+// (entries sorted by id, see mod_ble_ul.c) if it is enabled and smaller.
+typedef enum { MOD_BLE_UL_LIST_CURR, MOD_BLE_UL_LIST_ENTER, MOD_BLE_UL_LIST_EXIT } MOD_BLE_UL_LIST_t;
+typedef struct {
+    uint32_t id;        // (LSB of major << 16) | minor
+    int8_t rssi;
+    uint8_t val;        // extra byte for the CURR/ENTER lists, the value (eg minutes seen) for the EXIT lists
+    uint16_t ref;       // for the caller (eg its table index)
+} MOD_BLE_UL_ENTRY_t;
+#define MOD_BLE_UL_ID(major, minor) ((((uint32_t)(major) & 0xff) << 16) | (minor))
+// Value of the scan data for the UL decision of app-core (see app_core_msg_ul_addValue()) : a change of place (a new best
+// beacon, a tag enter/exit) is worth an UL on its own, changes in what is around less so, the same again very little.
+#define MOD_BLE_VALUE_PLACE (APP_CORE_UL_VALUE_CRIT)
+#define MOD_BLE_VALUE_CHANGE (20)
+#define MOD_BLE_VALUE_SAME (5)
+// Typical size of an entry in the compact encoding (close ids, no extra byte), to estimate the UL space needed
+#define MOD_BLE_UL_COMPACT_ENTRY_SZ (3)
+/*
+ * Add the nb entries to the UL, in as many TLVs as needed (moving to the next block when one is full). If not all fit, the first ones 
+ * (in the given order) are added : an entry is never added after one before it was left out. With app acks on, the ENTER/EXIT
+ * TLVs are at most APP_CORE_UL_APP_ACK_TLV_MAX_SZ, so that they can be resent.
+ * The entries added are the first ones on return (in id order within each compact TLV).
+ * <returns>Returns the number of entries added</returns>
+ */
+int mod_ble_ul_addList(APP_CORE_UL_t* ul, MOD_BLE_UL_LIST_t type, bool compact, MOD_BLE_UL_ENTRY_t* e, int nb);
+
+// Tracked list of the tag scanning modules (see mod_ble_tag.c)
+typedef struct {
+    uint8_t exitTimeoutMins;
+    uint8_t maxEnterPerUL;
+    uint8_t maxExitPerUL;
+    uint8_t presenceMinorMSB;
+    bool compactLists;
+    bool proximityIsEnterExit;      // covid proximity tracker beacons are treated as enter/exit types too
+} MOD_BLE_TAG_CFG_t;
+// What there is to send in the UL
+typedef struct {
+    int nbEnter;
+    int nbExit;
+    int nbCount;
+    int nbTypes;
+    // Presence guys : this is a single TLV (we only track 1 minor block per device)
+    int maxMinorIdPresence;        // max id seen (to economise space), -1 if none seen
+    uint16_t majorPresence;        // Normally we expect all presence guys to have same major...
+} MOD_BLE_TAG_COUNTS_t;
+/*
+ * Count what there is to send in the UL from the tracked list (free entries have lastSeenAt==0), limited to the configured maxes.
+ * The list is not changed, so this can be called to get the UL need as well as when adding the data. 
+ * If tcount is not NULL it gets the number seen of each countable type (BLE_NTYPES entries, max 255).
+ * <returns>Returns the UL space required to send it all</returns>
+ */
+int mod_ble_tag_countUL(const ibeacon_data_t* list, int n, uint32_t now, const MOD_BLE_TAG_CFG_t* cfg, MOD_BLE_TAG_COUNTS_t* c, uint8_t* tcount);
+/*
+ * Free the entries that will never go in an UL : presence ones of other minors, presence and countable ones not seen for the exit
+ * timeout, and types that are not for us. Enter/exit ones are left for the caller to free once their exit was sent.
+ * <returns>Returns the number freed of types that are not for us</returns>
+ */
+int mod_ble_tag_purge(ibeacon_data_t* list, int n, uint32_t now, const MOD_BLE_TAG_CFG_t* cfg);
+
 
 #ifdef __cplusplus
 }
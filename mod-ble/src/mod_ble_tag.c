@@ -0,0 +1,129 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Tracked list of the tag scanning modules (scan-tag, scanA-tag) : what there is to send in the UL, and the entries that can go.
+ * Tag types (major MSB) : 'count only' 0x01-0x7F, 'enter/exit' 0x80 (and 0x82 proximity if configured so),
+ * 'presence' 0x81 with the minor MSB configured for this device.
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "os/os.h"
+
+#include "wyres-generic/wutils.h"
+#include "app-core/app_core.h"
+#include "app-core/app_msg.h"
+#include "mod-ble/mod_ble.h"
+
+#define ENTER_UL_SZ (5)
+#define EXIT_UL_SZ (4)
+#define COUNT_UL_SZ (2)
+#define TL_HDR_UL_SZ (2)
+
+static bool isEnterExit(uint8_t bletype, const MOD_BLE_TAG_CFG_t* cfg) {
+    return (bletype==BLE_TYPE_ENTEREXIT || (cfg->proximityIsEnterExit && bletype==BLE_TYPE_PROXIMITY));
+}
+static bool timedOut(const ibeacon_data_t* ib, uint32_t now, const MOD_BLE_TAG_CFG_t* cfg) {
+    return ((now - ib->lastSeenAt) > (cfg->exitTimeoutMins*60));
+}
+
+int mod_ble_tag_countUL(const ibeacon_data_t* list, int n, uint32_t now, const MOD_BLE_TAG_CFG_t* cfg, MOD_BLE_TAG_COUNTS_t* c, uint8_t* tcount) {
+    uint8_t typesSeen[(BLE_NTYPES+7)/8];
+    memset(c, 0, sizeof(MOD_BLE_TAG_COUNTS_t));
+    memset(typesSeen, 0, sizeof(typesSeen));
+    c->maxMinorIdPresence = -1;
+    if (tcount!=NULL) {
+        memset(tcount, 0, BLE_NTYPES);
+    }
+    for(int i=0;i<n;i++) {
+        if (list[i].lastSeenAt==0) {
+            continue;       // free entry
+        }
+        uint8_t bletype = (list[i].major & 0xff00) >> 8;
+        if (isEnterExit(bletype, cfg)) {
+            // exit/enter type : if new, it goes in the enter list, if not seen for the exit timeout, in the exit one
+            if (list[i].new) {
+                c->nbEnter++;
+            } else if (timedOut(&list[i], now, cfg)) {
+                c->nbExit++;
+            }
+        } else if (bletype==BLE_TYPE_PRESENCE) {
+            // Present if its one of our minors and not timed out (using same timeout as enter/exit case)
+            if (((list[i].minor & 0xff00) >> 8) == cfg->presenceMinorMSB && !timedOut(&list[i], now, cfg)) {
+                uint8_t minorId = (list[i].minor & 0xff);     // bit position
+                if (minorId > c->maxMinorIdPresence) {
+                    c->maxMinorIdPresence = minorId;
+                }
+                // Normally we expect all presence guys to have same major...
+                c->majorPresence = list[i].major;
+            }
+        } else if (bletype>=BLE_TYPE_COUNTABLE_START && bletype<=BLE_TYPE_COUNTABLE_END) {
+            if (!timedOut(&list[i], now, cfg)) {
+                int idx = (bletype - BLE_TYPE_COUNTABLE_START);
+                // dont wrap the counter. 255==too many to count...
+                if (tcount!=NULL && tcount[idx]<255) {
+                    tcount[idx]++;
+                }
+                if ((typesSeen[idx/8] & (1<<(idx%8)))==0) {
+                    typesSeen[idx/8] |= (1<<(idx%8));
+                    c->nbTypes++;
+                }
+                c->nbCount++;
+            }
+        }
+        // other types are not for us (see mod_ble_tag_purge())
+    }
+    // Limit numbers in the UL to configured maxes
+    if (c->nbExit>cfg->maxExitPerUL) {
+        c->nbExit = cfg->maxExitPerUL;
+    }
+    if (c->nbEnter>cfg->maxEnterPerUL) {
+        c->nbEnter = cfg->maxEnterPerUL;
+    }
+    // how much space would it take (assuming spread over 4 UL packets)
+    if (cfg->compactLists) {
+        return (c->nbEnter+c->nbExit)*MOD_BLE_UL_COMPACT_ENTRY_SZ + c->nbTypes*COUNT_UL_SZ + TL_HDR_UL_SZ*6;
+    }
+    return c->nbEnter*ENTER_UL_SZ + c->nbExit*EXIT_UL_SZ + c->nbTypes*COUNT_UL_SZ + TL_HDR_UL_SZ*6;
+}
+
+int mod_ble_tag_purge(ibeacon_data_t* list, int n, uint32_t now, const MOD_BLE_TAG_CFG_t* cfg) {
+    int nbUnex = 0;
+    for(int i=0;i<n;i++) {
+        if (list[i].lastSeenAt==0) {
+            continue;
+        }
+        uint8_t bletype = (list[i].major & 0xff00) >> 8;
+        if (isEnterExit(bletype, cfg)) {
+            // only removed once their exit went in an UL
+        } else if (bletype==BLE_TYPE_PRESENCE) {
+            if (((list[i].minor & 0xff00) >> 8) != cfg->presenceMinorMSB) {
+                // we don't care about ones with a minor that we're not looking for - remove from our list to avoid blocking a slot
+                log_debug("MB:remove uncon pres minor=%d", list[i].minor);
+                list[i].lastSeenAt=0;
+            } else if (timedOut(&list[i], now, cfg)) {
+                list[i].lastSeenAt=0;
+            }
+        } else if (bletype>=BLE_TYPE_COUNTABLE_START && bletype<=BLE_TYPE_COUNTABLE_END) {
+            if (timedOut(&list[i], now, cfg)) {
+                list[i].lastSeenAt=0;
+            }
+        } else {
+            // NAV or unknown : shouldn't happen as the scanner was told to ignore these guys
+            log_warn("MB:remove unex type=%d", bletype);
+            list[i].lastSeenAt=0;
+            nbUnex++;
+        }
+    }
+    return nbUnex;
+}
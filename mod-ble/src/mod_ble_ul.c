@@ -0,0 +1,166 @@
+/**
+ * Copyright 2019 Wyres
+ * Licensed under the Apache License, Version 2.0 (the "License"); 
+ * you may not use this file except in compliance with the License. 
+ * You may obtain a copy of the License at
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * Unless required by applicable law or agreed to in writing, 
+ * software distributed under the License is distributed on 
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, 
+ * either express or implied. See the License for the specific 
+ * language governing permissions and limitations under the License.
+*/
+/**
+ * Beacon lists in the UL, shared by the BLE scanning modules.
+ * Compact encoding (APP_CORE_UL_BLE_xxx_LIST TLVs) : entries sorted by id, each one is
+ *  - the id as the varint (7 bits per byte, LSB first, b7 set if another byte follows) of its difference to the previous one (to 0 for the 1st)
+ *  - CURR/ENTER lists : 1 byte b0-4 : rssi quantised ((rssi+127)/3, ie rssi = -127 + 3*q), b5 : extra byte follows (omitted when 0)
+ *  - EXIT lists : the 1 byte value
+ * Each TLV is decoded on its own (the id difference restarts at 0).
+ */
+
+#include <string.h>
+#include <assert.h>
+#include "os/os.h"
+
+#include "wyres-generic/wutils.h"
+#include "app-core/app_core.h"
+#include "app-core/app_msg.h"
+#include "mod-ble/mod_ble.h"
+
+#define TL_HDR_UL_SZ (2)
+#define RSSI_Q_MIN (-127)
+#define RSSI_Q_STEP (3)
+#define RSSI_Q_MAX (31)
+#define ENTRY_HAS_EXTRA (0x20)
+
+static const struct {
+    uint8_t tag;            // as is
+    uint8_t compactTag;
+    uint8_t entrySz;        // as is
+    bool withRSSI;
+    bool isEvent;           // app acked (see app_core_msg_ul_setAppAck())
+} LISTS[] = {
+    [MOD_BLE_UL_LIST_CURR] = { APP_CORE_UL_BLE_CURR, APP_CORE_UL_BLE_CURR_LIST, 5, true, false },
+    [MOD_BLE_UL_LIST_ENTER] = { APP_CORE_UL_BLE_ENTER, APP_CORE_UL_BLE_ENTER_LIST, 5, true, true },
+    [MOD_BLE_UL_LIST_EXIT] = { APP_CORE_UL_BLE_EXIT, APP_CORE_UL_BLE_EXIT_LIST, 4, false, true },
+};
+
+static int varintSz(uint32_t v) {
+    int n = 1;
+    while(v > 0x7f) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+static uint8_t quantRSSI(int8_t rssi) {
+    int q = (rssi - RSSI_Q_MIN) / RSSI_Q_STEP;
+    return (q < 0 ? 0 : (q > RSSI_Q_MAX ? RSSI_Q_MAX : q));
+}
+// Size of the compact encoding of the n entries (sorted by id)
+static int compactSz(MOD_BLE_UL_LIST_t type, MOD_BLE_UL_ENTRY_t* e, int n) {
+    int sz = 0;
+    uint32_t prev = 0;
+    for(int i=0;i<n;i++) {
+        sz += varintSz(e[i].id - prev) + 1 + ((LISTS[type].withRSSI && e[i].val!=0) ? 1 : 0);
+        prev = e[i].id;
+    }
+    return sz;
+}
+// Size in the smaller of the 2 encodings
+static int listSz(MOD_BLE_UL_LIST_t type, bool compact, MOD_BLE_UL_ENTRY_t* e, int n) {
+    int sz = n * LISTS[type].entrySz;
+    if (compact) {
+        int csz = compactSz(type, e, n);
+        if (csz < sz) {
+            return csz;
+        }
+    }
+    return sz;
+}
+// Take the first entries of e (in the given order) that fit in space bytes and return how many : it stops at the first one that
+// doesn't fit, so a later one never goes before it. The ones taken are put in id order if compact.
+static int takeEntries(MOD_BLE_UL_LIST_t type, bool compact, MOD_BLE_UL_ENTRY_t* e, int n, int space) {
+    int k = 0;
+    for(int j=0;j<n;j++) {
+        MOD_BLE_UL_ENTRY_t c = e[j];
+        int p = k;
+        while(compact && p>0 && e[p-1].id > c.id) {
+            p--;
+        }
+        memmove(&e[p+1], &e[p], (j-p) * sizeof(MOD_BLE_UL_ENTRY_t));
+        e[p] = c;
+        if (listSz(type, compact, e, k+1) > space) {
+            // put it back, the rest go in the next TLV
+            memmove(&e[p], &e[p+1], (j-p) * sizeof(MOD_BLE_UL_ENTRY_t));
+            e[j] = c;
+            break;
+        }
+        k++;
+    }
+    return k;
+}
+static uint8_t* writeEntries(MOD_BLE_UL_LIST_t type, bool compact, MOD_BLE_UL_ENTRY_t* e, int n, uint8_t* vp) {
+    uint32_t prev = 0;
+    for(int i=0;i<n;i++) {
+        if (compact) {
+            uint32_t d = e[i].id - prev;
+            prev = e[i].id;
+            do {
+                *vp++ = (d & 0x7f) | (d > 0x7f ? 0x80 : 0x00);
+                d >>= 7;
+            } while(d > 0);
+            if (LISTS[type].withRSSI) {
+                *vp++ = quantRSSI(e[i].rssi) | (e[i].val!=0 ? ENTRY_HAS_EXTRA : 0);
+                if (e[i].val!=0) {
+                    *vp++ = e[i].val;
+                }
+            } else {
+                *vp++ = e[i].val;
+            }
+        } else {
+            *vp++ = (e[i].id >> 16) & 0xff;         // Just LSB of major
+            *vp++ = (e[i].id & 0xff);
+            *vp++ = ((e[i].id >> 8) & 0xff);
+            if (LISTS[type].withRSSI) {
+                *vp++ = e[i].rssi;
+            }
+            *vp++ = e[i].val;
+        }
+    }
+    return vp;
+}
+int mod_ble_ul_addList(APP_CORE_UL_t* ul, MOD_BLE_UL_LIST_t type, bool compact, MOD_BLE_UL_ENTRY_t* e, int nb) {
+    assert(ul!=NULL);
+    int added = 0;
+    bool newBlock = false;
+    while(added < nb) {
+        int space = app_core_msg_ul_remainingSz(ul) - TL_HDR_UL_SZ;
+        // with app acks, an event list TLV is only kept for a resend if it is small enough : split it in TLVs of that size
+        if (LISTS[type].isEvent && AppCore_isAppAckOn() && space > (APP_CORE_UL_APP_ACK_TLV_MAX_SZ - TL_HDR_UL_SZ)) {
+            space = APP_CORE_UL_APP_ACK_TLV_MAX_SZ - TL_HDR_UL_SZ;
+        }
+        int k = (space > 0 ? takeEntries(type, compact, &e[added], nb-added, space) : 0);
+        if (k==0) {
+            // move to next message (0=no next!), once
+            if (newBlock || app_core_msg_ul_requestNextUL(ul)==0) {
+                break;
+            }
+            newBlock = true;
+            continue;
+        }
+        newBlock = false;
+        int sz = listSz(type, compact, &e[added], k);
+        bool useCompact = (compact && sz < (k * LISTS[type].entrySz));
+        uint8_t* vp = app_core_msg_ul_addTLgetVP(ul, (useCompact ? LISTS[type].compactTag : LISTS[type].tag), sz);
+        if (vp==NULL) {
+            break;      // can't happen as we checked the space
+        }
+        if (writeEntries(type, useCompact, &e[added], k, vp) != (vp + sz)) {
+            log_warn("MB: list encoding size mismatch");
+        }
+        added += k;
+    }
+    return added;
+}
@@ -36,6 +36,9 @@ static struct appctx {
     uint32_t goodFixCnt;
     uint8_t fixDemanded;   // did we get a DL action asking for a fix?
     uint8_t fixMode;        // operating mode
+    uint8_t powerMode;      // gps power mode between fixes
+    uint32_t coldStartTimeS;    // fix timeout when no recent fix
+    uint32_t warmStartTimeS;    // fix timeout when we had a fix in the last 24h
     bool doFix;             // did we try to do a fix this round?
     bool commFail;             // did the comm fail?
     uint32_t triedAtS;      // TS of last try
@@ -135,21 +138,29 @@ static void gps_cb(GPS_EVENT_TYPE_t e) {
 }
 
 // My api functions
+// Read my config : all of it at init (key=CFG_KEY_ILLEGAL), then only the element that changed
+static void readConfig(void* ctx, uint16_t key) {
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_GPS_COLD_TIME_SECS) {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_GPS_COLD_TIME_SECS, &_ctx.coldStartTimeS, 10, 15*60);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_GPS_WARM_TIME_SECS) {
+        CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_GPS_WARM_TIME_SECS, &_ctx.warmStartTimeS, 1, 15*60);
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_GPS_POWER_MODE) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_GPS_POWER_MODE, &_ctx.powerMode, sizeof(uint8_t));
+    }
+    if (key==CFG_KEY_ILLEGAL || key==CFG_UTIL_KEY_GPS_FIX_MODE) {
+        CFMgr_getOrAddElement(CFG_UTIL_KEY_GPS_FIX_MODE, &_ctx.fixMode, sizeof(uint8_t));
+    }
+}
+
 static uint32_t start() {
     // When device is inactive this module is not used
     if (!AppCore_isDeviceActive()) {
         return 0;
     }
     _ctx.commFail = false;
-    uint32_t coldStartTime=2*60;
-    uint32_t warmStartTime=60;
-    uint8_t powermode = POWER_ONOFF;     
-    _ctx.fixMode = FIX_ALWAYS; // FIX_ON_DEMAND;
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_GPS_COLD_TIME_SECS, &coldStartTime, 10, 15*60);
-    CFMgr_getOrAddElementCheckRangeUINT32(CFG_UTIL_KEY_GPS_WARM_TIME_SECS, &warmStartTime, 1, 15*60);
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_GPS_POWER_MODE, &powermode, sizeof(uint8_t));
-    gps_setPowerMode(powermode);
-    CFMgr_getOrAddElement(CFG_UTIL_KEY_GPS_FIX_MODE, &_ctx.fixMode, sizeof(uint8_t));
+    gps_setPowerMode(_ctx.powerMode);
 
     int32_t fixagemins = gps_lastGPSFixAgeMins();
     uint32_t gpstimeoutsecs = 1;        // 1 second if we don't decide to do a fix
@@ -206,10 +217,10 @@ static uint32_t start() {
         // leaving to do somehting with the GPS, so tell it to go with a callback to tell me when its got something
         if (fixagemins<0 || fixagemins > 24*60) {
             // no fix last time, or was too long ago - could take 5 mins to find satellites?
-            gpstimeoutsecs = coldStartTime;
+            gpstimeoutsecs = _ctx.coldStartTimeS;
         } else {
             // If we had a lock before, and it was <24 hours, we should get a fix rapidly (if we can)
-            gpstimeoutsecs = warmStartTime + (fixagemins/24);      // adjust minimum fix time by up to 60s if last fix is old
+            gpstimeoutsecs = _ctx.warmStartTimeS + (fixagemins/24);      // adjust minimum fix time by up to 60s if last fix is old
         }
         //    log_debug("mod-gps last %d m - next fix in %d s", fixage, gpstimeoutsecs);
         // Start GPS Note we are handling timeouts so pass the fixTimeout as 0 to disable gpsmgr's timeout
@@ -252,15 +263,19 @@ static bool getData(APP_CORE_UL_t* ul) {
                 uint8_t nSats;      // number of satellites used for this fix
             */
             uint8_t* v = app_core_msg_ul_addTLgetVP (ul, APP_CORE_UL_GPS, 22);
-            v[0] = GPS_COMM_OK;       // got a fix;
-            Util_writeLE_int32_t(v, 1, _ctx.goodFix.lat);
-            Util_writeLE_int32_t(v, 5, _ctx.goodFix.lon);
-            Util_writeLE_int32_t(v, 9, _ctx.goodFix.alt);
-            Util_writeLE_int32_t(v, 13, _ctx.goodFix.prec);
-            Util_writeLE_uint32_t(v, 17, _ctx.goodFix.rxAt);
-            v[21] = _ctx.goodFix.nSats;
-            log_info("MG: @%d UL fix %d,%d,%d p=%d from %d sats", 
-                _ctx.goodFix.rxAt, _ctx.goodFix.lat, _ctx.goodFix.lon, _ctx.goodFix.alt, _ctx.goodFix.prec, _ctx.goodFix.nSats);
+            if (v!=NULL) {
+                v[0] = GPS_COMM_OK;       // got a fix;
+                Util_writeLE_int32_t(v, 1, _ctx.goodFix.lat);
+                Util_writeLE_int32_t(v, 5, _ctx.goodFix.lon);
+                Util_writeLE_int32_t(v, 9, _ctx.goodFix.alt);
+                Util_writeLE_int32_t(v, 13, _ctx.goodFix.prec);
+                Util_writeLE_uint32_t(v, 17, _ctx.goodFix.rxAt);
+                v[21] = _ctx.goodFix.nSats;
+                log_info("MG: @%d UL fix %d,%d,%d p=%d from %d sats", 
+                    _ctx.goodFix.rxAt, _ctx.goodFix.lat, _ctx.goodFix.lon, _ctx.goodFix.alt, _ctx.goodFix.prec, _ctx.goodFix.nSats);
+            } else {
+                log_warn("MG: no UL space for fix");
+            }
             // Log this position with timestamp (can be retrieved with DL action)
             logGPSPosition(&_ctx.goodFix);
         } else {
@@ -289,6 +304,13 @@ static APP_CORE_API_t _api = {
     .getULDataCB = &getData,
     .ticCB = NULL,
 };
+// GPS uses its uart (via the selector) and its power rail (which is the I2C bus power)
+static APP_MOD_RESOURCES_t _res = {
+    .uartDev = MYNEWT_VAL(MOD_GPS_UART),
+    .uartSelect = MYNEWT_VAL(MOD_GPS_UART_SELECT),
+    .i2cBus = -1,
+    .pwrIO = MYNEWT_VAL(MOD_GPS_PWRIO),
+};
 
 // DL action to request GPS FIX
 static void A_fixgps(uint8_t* v, uint8_t l) {
@@ -299,10 +321,19 @@ static void A_fixgps(uint8_t* v, uint8_t l) {
 
 // Initialise module
 void mod_gps_init(void) {
+    // Set non-0 defaults before config read
+    _ctx.coldStartTimeS = 2*60;
+    _ctx.warmStartTimeS = 60;
+    _ctx.powerMode = POWER_ONOFF;
+    _ctx.fixMode = FIX_ALWAYS; // FIX_ON_DEMAND;
+    // Get config once, and keep our copy up to date when it changes
+    readConfig(NULL, CFG_KEY_ILLEGAL);
+    AppCore_subscribeConfig(CFG_UTIL_KEY_GPS_COLD_TIME_SECS, CFG_UTIL_KEY_GPS_FIX_MODE, readConfig, NULL);
     // initialise access to GPS
     gps_mgr_init(MYNEWT_VAL(MOD_GPS_UART), MYNEWT_VAL(MOD_GPS_UART_BAUDRATE), MYNEWT_VAL(MOD_GPS_PWRIO), MYNEWT_VAL(MOD_GPS_UART_SELECT));
     // hook app-core for gps operation
     AppCore_registerModule("GPS", APP_MOD_GPS, &_api, EXEC_SERIAL);
+    AppCore_registerModuleResources(APP_MOD_GPS, &_res);
     // Register for the gps action(s)
     AppCore_registerAction(APP_CORE_DL_FIX_GPS, &A_fixgps);
 //    log_debug("mod-gps inited");
@@ -40,6 +40,8 @@ static uint32_t start() {
     SRMgr_start();
     MMMgr_check();
     log_debug("MP:for 1s");
+    // We only report the button state that is already known (from its callback), so no need to wait
+    AppCore_module_done(APP_MOD_PTI);
     return 1*1000;
 }
 